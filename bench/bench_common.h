@@ -0,0 +1,167 @@
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <gl_state.h>
+#include <headless.h>
+#include <mesh.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+// Fixture shared by the benchmarks: timing helpers, the GL context and the
+// scene's meshes uploaded in the float vertex layout of shaders/shader.vs.
+
+inline double now_ms()
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline double median(std::vector<double> samples)
+{
+  std::sort(samples.begin(), samples.end());
+  return samples[samples.size() / 2];
+}
+
+// camera at Timmy's eye height on a circle through the middle of a crowd of
+// the given radius, looking along the circle; t in [0, 1) is one lap
+inline glm::mat4 orbit_view(float radius, float t)
+{
+  const float angle = 6.2831853f * t;
+  const glm::vec3 eye(0.5f * radius * std::cos(angle), 150.0f, 0.5f * radius * std::sin(angle));
+  const glm::vec3 ahead(-std::sin(angle), -0.2f, std::cos(angle));
+  return glm::lookAt(eye, eye + ahead, glm::vec3(0, 1, 0));
+}
+
+// An OpenGL 3.3 core context in a GLFW window, hidden unless asked for, or
+// with headless in an offscreen EGL context (headless.h). Declare it before
+// anything owning GL objects: it goes last, so they are deleted while the
+// context still exists.
+class BenchContext
+{
+public:
+  BenchContext() = default;
+
+  BenchContext(const BenchContext &) = delete;
+  BenchContext &operator=(const BenchContext &) = delete;
+
+  ~BenchContext()
+  {
+    if (window)
+      glfwTerminate();
+  }
+
+  // create and make current the context and load the GL functions; width
+  // and height become the framebuffer's size, which the viewport is set to
+  bool create(const char *title, bool headless, int &width, int &height, bool visible = false)
+  {
+    if (headless)
+      return offscreen.create(width, height);
+
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+    window = glfwCreateWindow(width, height, title, NULL, NULL);
+    if (window == NULL)
+    {
+      printf("Failed to create GLFW window\n");
+      glfwTerminate();
+      return false;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSwapInterval(0);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    {
+      printf("Failed to initialize GLAD\n");
+      return false;
+    }
+    glfwGetFramebufferSize(window, &width, &height);
+    glViewport(0, 0, width, height);
+    return true;
+  }
+
+  // the loader the GL functions were loaded with, for entry points beyond 3.3
+  GLADloadproc loader() const
+  {
+    return window ? (GLADloadproc)glfwGetProcAddress : HeadlessContext::loader();
+  }
+
+  // show the frame and handle the window's events; offscreen frames stay in
+  // the framebuffer and only need to be submitted
+  void swap()
+  {
+    if (window)
+    {
+      glfwSwapBuffers(window);
+      glfwPollEvents();
+    }
+    else
+    {
+      glFlush();
+    }
+  }
+
+private:
+  GLFWwindow *window = NULL;
+  HeadlessContext offscreen;
+};
+
+struct DrawMesh
+{
+  GLuint vao, vbo, ebo;
+  GLsizei index_count;
+  // ranges of the index buffer, finest first
+  std::vector<MeshLod> lods;
+};
+
+inline DrawMesh upload_draw_mesh(const Mesh &mesh)
+{
+  DrawMesh d;
+  glGenVertexArrays(1, &d.vao);
+  glGenBuffers(1, &d.vbo);
+  glGenBuffers(1, &d.ebo);
+  gl_state().bindVertexArray(d.vao);
+  gl_state().bindBuffer(GL_ARRAY_BUFFER, d.vbo);
+  glBufferData(GL_ARRAY_BUFFER, mesh.getVertexBytes(), mesh.getVertices(), GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, position));
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, normal));
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, texcoord));
+  glEnableVertexAttribArray(2);
+  gl_state().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, d.ebo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.getIndexBytes(), mesh.getIndices(), GL_STATIC_DRAW);
+  gl_state().bindVertexArray(0);
+  d.index_count = (GLsizei)mesh.getIndexCount();
+  d.lods.assign(mesh.getLods(), mesh.getLods() + mesh.getLodCount());
+  return d;
+}
+
+// white 1x1 texture in place of the scene's textures, left bound
+inline GLuint white_texture()
+{
+  GLuint white;
+  const unsigned char texel[3] = {255, 255, 255};
+  glGenTextures(1, &white);
+  gl_state().bindTexture(GL_TEXTURE_2D, white);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, texel);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  return white;
+}
+
+#endif // !BENCH_COMMON_H
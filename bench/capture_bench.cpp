@@ -0,0 +1,240 @@
+// Throughput of the screenshot encoders in image_writer.h on one frame, or
+// with --video of the recording path in video_recorder.h.
+//
+//   capture_bench [--runs N] [--threads N] [frame.ppm]
+//   capture_bench --video [--frames N] [--threads N]
+//
+// The frame is a P6 or P3 ppm such as a capture taken with p; without one a
+// 1024x768 frame is tiled from asset/floor.jpeg, so run from the build
+// directory. Every encoder writes to the temp directory and is reported in
+// ms per frame and MB/s of raw RGB pixels.
+//
+// --video tiles a 1920x1080 frame instead, times the RGB to YUV 4:2:0
+// kernels and then streams the frame to a .y4m file in the temp directory,
+// once submitting every frame as fast as possible, which shows how many the
+// recorder drops, and once only when the recorder can take one, which shows
+// the sustained capture rate.
+
+#define STB_IMAGE_IMPLEMENTATION
+
+#include "bench_common.h"
+
+#include <image.h>
+#include <image_writer.h>
+#include <video_recorder.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Frame
+{
+  uint32_t width = 0, height = 0;
+  std::vector<uint8_t> rgba; // bottom row first, like glReadPixels
+};
+
+static bool load_ppm(const std::string &path, Frame &frame)
+{
+  std::ifstream fin(path, std::ios::binary);
+  std::string magic;
+  int max_value = 0;
+  fin >> magic >> frame.width >> frame.height >> max_value;
+  if (!fin || (magic != "P6" && magic != "P3") || max_value != 255)
+    return false;
+  fin.get();
+
+  frame.rgba.assign((size_t)frame.width * frame.height * 4, 255);
+  for (uint32_t y = 0; y < frame.height; y++)
+  {
+    uint8_t *row = frame.rgba.data() + (size_t)(frame.height - y - 1) * frame.width * 4;
+    for (uint32_t x = 0; x < frame.width; x++)
+    {
+      for (int c = 0; c < 3; c++)
+      {
+        if (magic == "P6")
+        {
+          row[4 * x + c] = (uint8_t)fin.get();
+        }
+        else
+        {
+          int v = 0;
+          fin >> v;
+          row[4 * x + c] = (uint8_t)v;
+        }
+      }
+    }
+  }
+  return (bool)fin;
+}
+
+static bool tile_texture(const std::string &path, uint32_t width, uint32_t height, Frame &frame)
+{
+  const Image image = Image::load(path);
+  if (!image.isValid())
+    return false;
+
+  frame.width = width;
+  frame.height = height;
+  frame.rgba.resize((size_t)frame.width * frame.height * 4);
+  const int channels = image.getChannels();
+  for (uint32_t y = 0; y < frame.height; y++)
+  {
+    for (uint32_t x = 0; x < frame.width; x++)
+    {
+      const unsigned char *texel =
+          image.getData() + ((y % image.getHeight()) * image.getWidth() + x % image.getWidth()) * channels;
+      uint8_t *pixel = frame.rgba.data() + ((size_t)y * frame.width + x) * 4;
+      for (int c = 0; c < 3; c++)
+        pixel[c] = texel[std::min(c, channels - 1)];
+      pixel[3] = 255;
+    }
+  }
+  return true;
+}
+
+static void run(const char *label, const Frame &frame, size_t runs, const std::function<bool()> &encode,
+                const std::string &path)
+{
+  std::vector<double> samples;
+  for (size_t i = 0; i < runs; i++)
+  {
+    const double t0 = now_ms();
+    if (!encode())
+    {
+      printf("%-12s  failed to write %s\n", label, path.c_str());
+      return;
+    }
+    samples.push_back(now_ms() - t0);
+  }
+  std::sort(samples.begin(), samples.end());
+
+  const double ms = samples[samples.size() / 2];
+  const double raw_mb = frame.width * frame.height * 3 / 1e6;
+  const double file_mb = std::filesystem::file_size(path) / 1e6;
+  printf("%-12s  %9.2f ms  %9.1f MB/s  %8.2f MB file\n", label, ms, raw_mb / (ms / 1000.0), file_mb);
+}
+
+static void record(const char *label, const Frame &frame, size_t frames, size_t threads, bool wait,
+                   const std::string &path)
+{
+  VideoRecorder recorder(threads);
+  if (!recorder.open(path, false, frame.width, frame.height, 60))
+    return;
+
+  const double t0 = now_ms();
+  for (size_t i = 0; i < frames; i++)
+  {
+    while (wait && !recorder.canAccept())
+      std::this_thread::yield();
+    recorder.submit(frame.rgba.data(), frame.width, frame.height);
+  }
+  recorder.close();
+  const double ms = now_ms() - t0;
+
+  printf("%-12s  %6zu written  %6zu dropped  %7.1f fps sustained  %7.2f ms per frame\n", label,
+         recorder.getWritten(), recorder.getDropped(), recorder.getSustainedFps(),
+         ms / std::max<size_t>(1, recorder.getWritten()));
+}
+
+static int video_bench(size_t frames, size_t threads)
+{
+  Frame frame;
+  if (!tile_texture("asset/floor.jpeg", 1920, 1080, frame))
+  {
+    printf("Failed to load asset/floor.jpeg\n");
+    return 1;
+  }
+
+  const size_t w = frame.width, h = frame.height;
+  std::vector<uint8_t> planes(w * h * 3 / 2);
+  uint8_t *y = planes.data(), *u = y + w * h, *v = u + w * h / 4;
+  std::vector<double> simd, scalar;
+  for (size_t i = 0; i < 10; i++)
+  {
+    double t0 = now_ms();
+    yuv::rgba_to_i420(frame.rgba.data(), w, h, y, u, v);
+    double t1 = now_ms();
+    for (size_t row = 0; row < h; row += 2)
+    {
+      const uint8_t *row0 = frame.rgba.data() + (h - row - 1) * w * 4;
+      yuv::convert_rows_scalar(row0, row0 - w * 4, 0, w, y + row * w, y + (row + 1) * w, u + row / 2 * (w / 2),
+                               v + row / 2 * (w / 2));
+    }
+    double t2 = now_ms();
+    simd.push_back(t1 - t0);
+    scalar.push_back(t2 - t1);
+  }
+  std::sort(simd.begin(), simd.end());
+  std::sort(scalar.begin(), scalar.end());
+  printf("1920x1080 rgb to yuv420: %.2f ms scalar, %.2f ms %s\n", scalar[5], simd[5],
+#ifdef YUV_SSE2
+         "sse2"
+#else
+         "scalar (no simd build)"
+#endif
+  );
+
+  const std::string path = (std::filesystem::temp_directory_path() / "capture_bench.y4m").string();
+  printf("%zu frames to %s, %zu conversion threads\n", frames, path.c_str(), threads);
+  record("as fast", frame, frames, threads, false, path);
+  record("when ready", frame, frames, threads, true, path);
+  std::filesystem::remove(path);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  size_t runs = 5, frames = 120;
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  bool video = false;
+  std::string input;
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "--runs" && i + 1 < argc)
+      runs = std::max(1ul, std::stoul(argv[++i]));
+    else if (arg == "--frames" && i + 1 < argc)
+      frames = std::max(1ul, std::stoul(argv[++i]));
+    else if (arg == "--threads" && i + 1 < argc)
+      threads = std::max(1ul, std::stoul(argv[++i]));
+    else if (arg == "--video")
+      video = true;
+    else
+      input = arg;
+  }
+  if (video)
+    return video_bench(frames, threads);
+
+  Frame frame;
+  if (input.empty() ? !tile_texture("asset/floor.jpeg", 1024, 768, frame) : !load_ppm(input, frame))
+  {
+    printf("Failed to load %s\n", input.empty() ? "asset/floor.jpeg" : input.c_str());
+    return 1;
+  }
+
+  const std::filesystem::path dir = std::filesystem::temp_directory_path();
+  const std::string ppm = (dir / "capture_bench.ppm").string(), png = (dir / "capture_bench.png").string();
+  ThreadPool pool(threads);
+
+  printf("%ux%u frame, %.2f MB of rgb, median of %zu runs\n", frame.width, frame.height,
+         frame.width * frame.height * 3 / 1e6, runs);
+  run("p3 (ascii)", frame, runs,
+      [&] { return write_image(ppm, ImageFormat::AsciiPpm, frame.rgba.data(), frame.width, frame.height); }, ppm);
+  run("p6", frame, runs,
+      [&] { return write_image(ppm, ImageFormat::Ppm, frame.rgba.data(), frame.width, frame.height); }, ppm);
+  run("png", frame, runs,
+      [&] { return write_image(png, ImageFormat::Png, frame.rgba.data(), frame.width, frame.height); }, png);
+  const std::string label = "png x" + std::to_string(threads);
+  run(label.c_str(), frame, runs,
+      [&] { return write_image(png, ImageFormat::Png, frame.rgba.data(), frame.width, frame.height, &pool); }, png);
+
+  std::filesystem::remove(ppm);
+  std::filesystem::remove(png);
+  return 0;
+}
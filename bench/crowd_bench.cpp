@@ -0,0 +1,291 @@
+// Draws growing crowds of Timmys in their buckets two ways, instanced with one
+// glDrawElementsInstanced call per mesh, and with one glDrawElements call and
+// model matrix upload per instance and mesh as the renderer used to:
+//
+//   crowd_bench [--headless] [--frames N] [--width W] [--height H]
+//               [--counts 1,10,...] [--obj path.obj] [--orbit]
+//
+// The crowd is laid out by make_crowd and viewed from above so every member
+// is on screen. For each count and mode it reports the draw calls issued, the
+// CPU time spent issuing them and the GPU time of the frame measured with a
+// GL_TIME_ELAPSED query, as medians over the frames. --obj replaces Timmy and
+// the bucket with another mesh, e.g. a small one to sweep to large counts on
+// a software rasterizer. Lighting is the three original spot lights without
+// clusters and textures are plain white. Run from the build directory so
+// shaders/ and asset/ are found.
+//
+// --orbit instead moves the camera round a lap through the middle of the
+// crowd over the frames and compares drawing every member instanced with
+// frustum culling them first (frustum_culling.h) and uploading only the
+// visible ones, and with also drawing each visible member at the level of
+// detail its size on screen calls for (lod_selector.h), one instanced draw
+// per mesh and level; the submit time then includes the culling, picking
+// the levels and the upload. The triangles column is the average per frame.
+
+#include "bench_common.h"
+
+#include <disco_lights.h>
+#include <frustum_culling.h>
+#include <gl_state.h>
+#include <instancing.h>
+#include <light_block.h>
+#include <lod_selector.h>
+#include <mesh_cache.h>
+#include <shader.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// largest horizontal extent of the meshes, to space the crowd
+static float footprint(const std::vector<Mesh> &meshes)
+{
+  float extent = 1.0f;
+  for (const Mesh &mesh : meshes)
+  {
+    for (size_t i = 0; i < mesh.getVertexCount(); i++)
+    {
+      const float *p = mesh.getVertices()[i].position;
+      extent = std::max(extent, 2.0f * std::max(std::abs(p[0]), std::abs(p[2])));
+    }
+  }
+  return extent;
+}
+
+int main(int argc, char **argv)
+{
+  size_t frames = 5;
+  int width = 640, height = 360;
+  bool headless_mode = false, orbit = false;
+  std::vector<size_t> counts = {1, 10, 100, 1000, 10000, 100000};
+  std::vector<std::string> obj_paths = {"asset/timmy.obj", "asset/bucket.obj"};
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "--headless")
+      headless_mode = true;
+    else if (arg == "--frames" && i + 1 < argc)
+      frames = std::max(1ul, std::stoul(argv[++i]));
+    else if (arg == "--width" && i + 1 < argc)
+      width = std::stoi(argv[++i]);
+    else if (arg == "--height" && i + 1 < argc)
+      height = std::stoi(argv[++i]);
+    else if (arg == "--orbit")
+      orbit = true;
+    else if (arg == "--obj" && i + 1 < argc)
+      obj_paths = {argv[++i]};
+    else if (arg == "--counts" && i + 1 < argc)
+    {
+      counts.clear();
+      std::stringstream list(argv[++i]);
+      std::string item;
+      while (std::getline(list, item, ','))
+        counts.push_back(std::max(1ul, std::stoul(item)));
+    }
+  }
+
+  BenchContext context;
+  if (!context.create("crowd_bench", headless_mode, width, height))
+    return 1;
+  gl_state().enable(GL_DEPTH_TEST);
+  gl_state().enable(GL_CULL_FACE);
+
+  std::vector<Mesh> meshes;
+  std::vector<DrawMesh> draw_meshes;
+  InstanceBuffer instances;
+  size_t triangles = 0;
+  Bounds member_bounds;
+  for (const std::string &path : obj_paths)
+  {
+    meshes.push_back(load_mesh(path));
+    draw_meshes.push_back(upload_draw_mesh(meshes.back()));
+    instances.attach(draw_meshes.back().vao);
+    triangles += meshes.back().getIndexCount() / 3;
+    member_bounds = merge_bounds(member_bounds, compute_bounds(meshes.back().getVertices()[0].position,
+                                                               sizeof(Vertex) / sizeof(float),
+                                                               meshes.back().getVertexCount()));
+  }
+  const float spacing = footprint(meshes) * 1.4f;
+
+  white_texture();
+
+  Shader instanced_shader("shaders/shader_instanced.vs", "shaders/shader.fs");
+  Shader single_shader("shaders/shader.vs", "shaders/shader.fs");
+  for (Shader *shader : {&instanced_shader, &single_shader})
+  {
+    shader->use();
+    shader->bindUniformBlock("Lights", LIGHTS_BINDING);
+    shader->set(shader->uniform<int>("lightData"), 1);
+    shader->set(shader->uniform<bool>("bruteForce"), true);
+  }
+  const Uniform<glm::mat4> u_model = single_shader.uniform<glm::mat4>("model");
+
+  LightBlock lights;
+  lights.create();
+  lights.bindTextures(1);
+  std::vector<DiscoLight> disco = make_disco_lights(3);
+  std::vector<SpotLight> frame_lights;
+  animate_disco_lights(disco, frame_lights);
+  lights.updateLights(frame_lights.data(), frame_lights.size());
+  lights.updateParams(total_ambient(disco), disco.size(), LightClusters(), glm::vec2(width, height));
+
+  GLuint query;
+  glGenQueries(1, &query);
+
+  printf("%dx%d, %zu frames per run, %zu triangles per member (", width, height, frames, triangles);
+  for (size_t i = 0; i < obj_paths.size(); i++)
+    printf("%s%s", i ? " + " : "", obj_paths[i].c_str());
+  // a member's levels are as coarse as the coarsest of its meshes allows
+  float member_errors[MESH_LOD_COUNT] = {};
+  for (const DrawMesh &m : draw_meshes)
+  {
+    for (int level = 0; level < MESH_LOD_COUNT; level++)
+      member_errors[level] = std::max(member_errors[level], m.lods[std::min<size_t>(level, m.lods.size() - 1)].error);
+  }
+  LodSelector lod_selector;
+
+  printf(")%s\n%8s  %-9s  %8s  %8s  %10s  %10s  %10s\n", orbit ? ", orbiting" : "", "members", "mode", "draws",
+         "drawn", "triangles", "submit ms", "gpu ms");
+
+  for (size_t count : counts)
+  {
+    const std::vector<InstanceData> crowd = make_crowd(count, spacing);
+    instances.upload(crowd.data(), crowd.size());
+    InstanceCuller culler;
+    culler.setInstances(&crowd[0].model, sizeof(InstanceData), crowd.size(), member_bounds);
+    std::vector<uint32_t> visible(count);
+    std::vector<InstanceData> visible_crowd(count);
+    std::vector<uint8_t> levels(count, 0);
+
+    // look down on the whole crowd, or orbit through it
+    const float radius = spacing / 1.8f * std::sqrt((float)count + 1.0f) + spacing;
+    const glm::mat4 overview = glm::lookAt(glm::vec3(0.0f, 1.2f * radius, 1.2f * radius), glm::vec3(0.0f),
+                                           glm::vec3(0, 1, 0));
+    const glm::mat4 proj = glm::perspective(glm::radians(60.0f), (float)width / height, 1.0f, 4.0f * radius);
+    lod_selector.setProjection(proj, (float)height);
+    for (Shader *shader : {&instanced_shader, &single_shader})
+    {
+      shader->use();
+      shader->set(shader->uniform<glm::mat4>("view"), overview);
+      shader->set(shader->uniform<glm::mat4>("projection"), proj);
+    }
+
+    // culled runs are instanced too, so they draw with the instanced shader
+    enum Mode
+    {
+      Instanced,
+      PerDraw,
+      Culled,
+      Lod
+    };
+    double instanced_submit = 0.0;
+    for (Mode mode : orbit ? std::vector<Mode>{Instanced, Culled, Lod} : std::vector<Mode>{Instanced, PerDraw})
+    {
+      const bool instanced = mode != PerDraw;
+      const Shader &shader = instanced ? instanced_shader : single_shader;
+      shader.use();
+      const Uniform<glm::mat4> u_view = shader.uniform<glm::mat4>("view");
+
+      std::vector<double> submit_ms, gpu_ms;
+      size_t drawn = 0, draws = 0, triangles_drawn = 0;
+      std::fill(levels.begin(), levels.end(), 0);
+      for (size_t f = 0; f < frames; f++)
+      {
+        const glm::mat4 view = orbit ? orbit_view(radius, (float)f / frames) : overview;
+        if (orbit)
+          shader.set(u_view, view);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glBeginQuery(GL_TIME_ELAPSED, query);
+
+        const double t0 = now_ms();
+        // instances of each level, all at the full mesh unless picked
+        size_t level_first[MESH_LOD_COUNT] = {}, level_count[MESH_LOD_COUNT] = {count};
+        if (mode == Culled || mode == Lod)
+        {
+          const size_t members = culler.cull(Frustum::fromMatrix(proj * view), visible.data());
+          if (mode == Lod)
+          {
+            lod_selector.sortInstances(crowd.data(), visible.data(), members, member_bounds.center, member_errors,
+                                       MESH_LOD_COUNT, view, levels.data(), visible_crowd, level_first,
+                                       level_count);
+          }
+          else
+          {
+            for (size_t m = 0; m < members; m++)
+              visible_crowd[m] = crowd[visible[m]];
+            level_count[0] = members;
+          }
+          instances.upload(visible_crowd.data(), members);
+        }
+        if (instanced)
+        {
+          for (const DrawMesh &m : draw_meshes)
+          {
+            for (int level = 0; level < MESH_LOD_COUNT; level++)
+            {
+              if (level_count[level] == 0)
+                continue;
+              const MeshLod &lod = m.lods[std::min<size_t>(level, m.lods.size() - 1)];
+              if (mode == Lod)
+                instances.attach(m.vao, level_first[level]);
+              gl_state().bindVertexArray(m.vao);
+              glDrawElementsInstanced(GL_TRIANGLES, lod.index_count, GL_UNSIGNED_INT,
+                                      (void *)(lod.index_offset * sizeof(uint32_t)), (GLsizei)level_count[level]);
+              draws++;
+              drawn += level_count[level];
+              triangles_drawn += lod.index_count / 3 * level_count[level];
+            }
+          }
+        }
+        else
+        {
+          for (const InstanceData &member : crowd)
+          {
+            shader.set(u_model, member.model);
+            for (const DrawMesh &m : draw_meshes)
+            {
+              gl_state().bindVertexArray(m.vao);
+              glDrawElements(GL_TRIANGLES, m.index_count, GL_UNSIGNED_INT, (void *)0);
+              draws++;
+              triangles_drawn += m.index_count / 3;
+            }
+          }
+          drawn += count * draw_meshes.size();
+        }
+        const double t1 = now_ms();
+
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+        context.swap();
+
+        submit_ms.push_back(t1 - t0);
+        gpu_ms.push_back(ns / 1e6);
+      }
+      // the next mode starts from the whole crowd again
+      if (mode == Culled || mode == Lod)
+      {
+        instances.upload(crowd.data(), crowd.size());
+        for (const DrawMesh &m : draw_meshes)
+          instances.attach(m.vao);
+      }
+
+      const char *names[] = {"instanced", "per draw", "culled", "lod"};
+      const double submit = median(submit_ms);
+      if (mode == Instanced)
+        instanced_submit = submit;
+      printf("%8zu  %-9s  %8zu  %8zu  %10zu  %10.3f  %10.3f", count, names[mode], draws / frames,
+             drawn / draw_meshes.size() / frames, triangles_drawn / frames, submit, median(gpu_ms));
+      if (mode == PerDraw && instanced_submit > 0.0)
+        printf("  (%.0fx the instanced submit time)", submit / instanced_submit);
+      printf("\n");
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,97 @@
+// Throughput of the instance frustum culling in frustum_culling.h over a
+// crowd laid out by make_crowd, seen by a camera orbiting through it:
+//
+//   cull_bench [--frames N] [--counts 1000,10000,...]
+//
+// Every frame moves the camera a step round the crowd and culls all members
+// once with the scalar loop and once with the SIMD one (SSE2, or AVX when
+// built with -mavx). Reported are the median ms per frame, the members tested
+// per ms and the share that stayed visible. The crowd's bounds are Timmy and
+// the bucket's, so run from the build directory so asset/ is found.
+
+#include "bench_common.h"
+
+#include <frustum_culling.h>
+#include <instancing.h>
+#include <mesh_cache.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv)
+{
+  size_t frames = 60;
+  std::vector<size_t> counts = {1000, 10000, 100000, 1000000};
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "--frames" && i + 1 < argc)
+      frames = std::max(1ul, std::stoul(argv[++i]));
+    else if (arg == "--counts" && i + 1 < argc)
+    {
+      counts.clear();
+      std::stringstream list(argv[++i]);
+      std::string item;
+      while (std::getline(list, item, ','))
+        counts.push_back(std::max(1ul, std::stoul(item)));
+    }
+  }
+
+  Bounds member;
+  for (const char *path : {"asset/timmy.obj", "asset/bucket.obj"})
+  {
+    const Mesh mesh = load_mesh(path);
+    member = merge_bounds(member, compute_bounds(mesh.getVertices()[0].position, sizeof(Vertex) / sizeof(float),
+                                                 mesh.getVertexCount()));
+  }
+  const float spacing = 220.0f;
+
+#ifdef FRUSTUM_CULLING_AVX
+  const char *simd = "avx";
+#elif defined(FRUSTUM_CULLING_SSE2)
+  const char *simd = "sse2";
+#else
+  const char *simd = "scalar";
+#endif
+  printf("%zu frames per run, member bounds %.0f x %.0f x %.0f, simd path %s\n", frames, member.max.x - member.min.x,
+         member.max.y - member.min.y, member.max.z - member.min.z, simd);
+  printf("%8s  %-6s  %10s  %14s  %8s\n", "members", "mode", "ms/frame", "members/ms", "visible");
+
+  for (size_t count : counts)
+  {
+    const std::vector<InstanceData> crowd = make_crowd(count, spacing);
+    InstanceCuller culler;
+    const double setup_begin = now_ms();
+    culler.setInstances(&crowd[0].model, sizeof(InstanceData), crowd.size(), member);
+    const double setup_ms = now_ms() - setup_begin;
+
+    const float radius = spacing / 1.8f * std::sqrt((float)count + 1.0f) + spacing;
+    const glm::mat4 proj = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 4.0f * radius);
+
+    std::vector<uint32_t> visible(count);
+    for (bool simd_path : {false, true})
+    {
+      std::vector<double> frame_ms;
+      size_t visible_sum = 0;
+      for (size_t f = 0; f < frames; f++)
+      {
+        const Frustum frustum = Frustum::fromMatrix(proj * orbit_view(radius, (float)f / frames));
+
+        const double t0 = now_ms();
+        visible_sum += simd_path ? culler.cull(frustum, visible.data()) : culler.cullScalar(frustum, visible.data());
+        frame_ms.push_back(now_ms() - t0);
+      }
+
+      const double ms = median(frame_ms);
+      printf("%8zu  %-6s  %10.4f  %14.0f  %7.1f%%\n", count, simd_path ? "simd" : "scalar", ms, count / ms,
+             100.0 * visible_sum / (frames * count));
+    }
+    printf("%8s  setup %.3f ms (world boxes from the model matrices)\n", "", setup_ms);
+  }
+  return 0;
+}
@@ -0,0 +1,140 @@
+// Sweeps the number of spot lights and compares clustered shading with the
+// brute-force loop over every light, rendering the scene's meshes (untextured)
+// into a hidden window:
+//
+//   lights_bench [--frames N] [--width W] [--height H] [--counts 3,8,...]
+//
+// For each light count and mode it reports the CPU time spent binning the
+// lights and uploading the buffers, and the GPU time of the draws measured
+// with GL_TIME_ELAPSED queries. Run from the build directory so shaders/
+// and asset/ are found.
+
+#include "bench_common.h"
+
+#include <disco_lights.h>
+#include <gl_state.h>
+#include <light_block.h>
+#include <mesh_cache.h>
+#include <shader.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv)
+{
+  size_t frames = 20;
+  int width = 1024, height = 768;
+  std::vector<size_t> counts = {3, 8, 16, 32, 64, 128, 256, 512, 1024};
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "--frames" && i + 1 < argc)
+      frames = std::max(1ul, std::stoul(argv[++i]));
+    else if (arg == "--width" && i + 1 < argc)
+      width = std::stoi(argv[++i]);
+    else if (arg == "--height" && i + 1 < argc)
+      height = std::stoi(argv[++i]);
+    else if (arg == "--counts" && i + 1 < argc)
+    {
+      counts.clear();
+      std::stringstream list(argv[++i]);
+      std::string item;
+      while (std::getline(list, item, ','))
+        counts.push_back(std::min<size_t>(MAX_LIGHTS, std::stoul(item)));
+    }
+  }
+
+  BenchContext context;
+  if (!context.create("lights_bench", false, width, height))
+    return 1;
+  gl_state().enable(GL_DEPTH_TEST);
+  gl_state().enable(GL_CULL_FACE);
+
+  std::vector<DrawMesh> meshes;
+  for (const char *path : {"asset/timmy.obj", "asset/bucket.obj", "asset/floor.obj"})
+    meshes.push_back(upload_draw_mesh(load_mesh(path)));
+
+  white_texture();
+
+  Shader shader("shaders/shader.vs", "shaders/shader.fs");
+  shader.use();
+  shader.bindUniformBlock("Lights", LIGHTS_BINDING);
+  shader.set(shader.uniform<int>("lightData"), 1);
+  shader.set(shader.uniform<int>("clusterCells"), 2);
+  shader.set(shader.uniform<int>("clusterLights"), 3);
+  const Uniform<bool> u_brute_force = shader.uniform<bool>("bruteForce");
+
+  const glm::mat4 view = glm::lookAt(glm::vec3(50, 100, 200), glm::vec3(0, 80, 0), glm::vec3(0, 1, 0));
+  const glm::mat4 proj = glm::perspective(glm::radians(60.0f), 4.0f / 3.0f, 0.1f, 1000.0f);
+  shader.set(shader.uniform<glm::mat4>("model"), glm::mat4(1.0f));
+  shader.set(shader.uniform<glm::mat4>("view"), view);
+  shader.set(shader.uniform<glm::mat4>("projection"), proj);
+
+  LightBlock lights;
+  lights.create();
+  lights.bindTextures(1);
+  LightClusters clusters;
+  clusters.setProjection(glm::radians(60.0f), 4.0f / 3.0f, 0.1f, 1000.0f);
+
+  GLuint query;
+  glGenQueries(1, &query);
+
+  printf("%dx%d, %zu frames per run, %d clusters\n", width, height, frames, CLUSTER_COUNT);
+  printf("%6s  %-9s  %9s  %9s  %9s  %12s\n", "lights", "mode", "bin ms", "upload ms", "gpu ms", "lists (max)");
+
+  for (size_t count : counts)
+  {
+    for (bool brute_force : {true, false})
+    {
+      std::vector<DiscoLight> disco = make_disco_lights(count);
+      std::vector<SpotLight> frame_lights;
+      lights.updateParams(total_ambient(disco), disco.size(), clusters, glm::vec2(width, height));
+      shader.set(u_brute_force, brute_force);
+
+      std::vector<double> bin_ms, upload_ms, gpu_ms;
+      for (size_t f = 0; f < frames; f++)
+      {
+        animate_disco_lights(disco, frame_lights);
+
+        double t0 = now_ms();
+        if (!brute_force)
+          clusters.assign(frame_lights.data(), frame_lights.size(), view);
+        double t1 = now_ms();
+        lights.updateLights(frame_lights.data(), frame_lights.size());
+        if (!brute_force)
+          lights.updateClusters(clusters);
+        double t2 = now_ms();
+
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        for (const DrawMesh &m : meshes)
+        {
+          gl_state().bindVertexArray(m.vao);
+          glDrawElements(GL_TRIANGLES, m.index_count, GL_UNSIGNED_INT, (void *)0);
+        }
+        glEndQuery(GL_TIME_ELAPSED);
+
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+        context.swap();
+
+        bin_ms.push_back(t1 - t0);
+        upload_ms.push_back(t2 - t1);
+        gpu_ms.push_back(ns / 1e6);
+      }
+
+      char lists[32] = "-";
+      if (!brute_force)
+        snprintf(lists, sizeof(lists), "%zu (%zu)", clusters.getIndices().size(), clusters.getMaxLightsPerCluster());
+      printf("%6zu  %-9s  %9.3f  %9.3f  %9.3f  %12s\n", count, brute_force ? "forward" : "clustered",
+             median(bin_ms), median(upload_ms), median(gpu_ms), lists);
+    }
+  }
+
+  return 0;
+}
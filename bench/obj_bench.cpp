@@ -0,0 +1,176 @@
+// Compares the chunked parser in obj_parser.h with tinyobj::LoadObj.
+//
+//   obj_bench [--threads N] [--iterations N] [--synthetic TRIANGLES] [file.obj ...]
+//
+// --synthetic writes a grid mesh with the given number of triangles to
+// synthetic.obj first and benchmarks it along with the listed files.
+
+#include "bench_common.h"
+
+#include <obj.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// grid of quads, written as two triangles each, with shared positions,
+// normals and texture coordinates like an exported scan
+static void write_synthetic_obj(const std::string &path, size_t triangles)
+{
+  const size_t side = std::max<size_t>(1, (size_t)std::sqrt((double)triangles / 2.0));
+  const size_t rows = std::max<size_t>(1, triangles / 2 / side);
+
+  std::ofstream fout(path);
+  fout << "# synthetic grid, " << side * rows * 2 << " triangles\n";
+  char line[256];
+  for (size_t y = 0; y <= rows; y++)
+  {
+    for (size_t x = 0; x <= side; x++)
+    {
+      float fx = (float)x / side, fy = (float)y / rows;
+      float h = 0.1f * std::sin(fx * 40.0f) * std::cos(fy * 40.0f);
+      snprintf(line, sizeof(line), "v %.6f %.6f %.6f\nvn %.6f %.6f %.6f\nvt %.6f %.6f\n",
+               fx * 100.0f, h, fy * 100.0f, 0.0f, 1.0f, 0.0f, fx, fy);
+      fout << line;
+    }
+  }
+  for (size_t y = 0; y < rows; y++)
+  {
+    for (size_t x = 0; x < side; x++)
+    {
+      size_t a = y * (side + 1) + x + 1, b = a + 1, c = a + side + 1, d = c + 1;
+      snprintf(line, sizeof(line), "f %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\nf %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\n",
+               a, a, a, c, c, c, b, b, b, b, b, b, c, c, c, d, d, d);
+      fout << line;
+    }
+  }
+}
+
+static double max_abs_diff(const std::vector<tinyobj::real_t> &a, const std::vector<tinyobj::real_t> &b)
+{
+  if (a.size() != b.size())
+    return INFINITY;
+  double diff = 0.0;
+  for (size_t i = 0; i < a.size(); i++)
+    diff = std::max(diff, (double)std::fabs(a[i] - b[i]));
+  return diff;
+}
+
+// number of triangles whose corners differ; tinyobj's float parsing is not
+// correctly rounded, so quads with (nearly) equal diagonals may be split the
+// other way by obj_parser
+static size_t differing_triangles(const std::vector<tinyobj::shape_t> &a,
+                                  const std::vector<tinyobj::shape_t> &b)
+{
+  if (a.size() != b.size())
+    return SIZE_MAX;
+  size_t differ = 0;
+  for (size_t s = 0; s < a.size(); s++)
+  {
+    const tinyobj::mesh_t &ma = a[s].mesh, &mb = b[s].mesh;
+    if (a[s].name != b[s].name || ma.indices.size() != mb.indices.size() ||
+        ma.smoothing_group_ids != mb.smoothing_group_ids)
+      return SIZE_MAX;
+    for (size_t i = 0; i < ma.indices.size(); i += 3)
+    {
+      for (size_t k = i; k < i + 3; k++)
+      {
+        if (ma.indices[k].vertex_index != mb.indices[k].vertex_index ||
+            ma.indices[k].normal_index != mb.indices[k].normal_index ||
+            ma.indices[k].texcoord_index != mb.indices[k].texcoord_index)
+        {
+          differ++;
+          break;
+        }
+      }
+    }
+  }
+  return differ;
+}
+
+int main(int argc, char **argv)
+{
+  size_t threads = 0, iterations = 5, synthetic = 0;
+  std::vector<std::string> paths;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "--threads" && i + 1 < argc)
+      threads = std::stoul(argv[++i]);
+    else if (arg == "--iterations" && i + 1 < argc)
+      iterations = std::max(1ul, std::stoul(argv[++i]));
+    else if (arg == "--synthetic" && i + 1 < argc)
+      synthetic = std::stoul(argv[++i]);
+    else
+      paths.push_back(arg);
+  }
+
+  if (synthetic > 0)
+  {
+    double t0 = now_ms();
+    write_synthetic_obj("synthetic.obj", synthetic);
+    std::cout << "Wrote synthetic.obj in " << now_ms() - t0 << " ms" << std::endl;
+    paths.push_back("synthetic.obj");
+  }
+  if (paths.empty())
+    paths.push_back("asset/timmy.obj");
+
+  for (const auto &path : paths)
+  {
+    MappedFile file;
+    if (!file.open(path))
+    {
+      std::cout << "Cannot open " << path << std::endl;
+      return 1;
+    }
+    const double mb = file.size() / (1024.0 * 1024.0);
+
+    std::vector<double> tiny_ms, chunked_ms;
+    tinyobj::attrib_t tiny_attrib, attrib;
+    std::vector<tinyobj::shape_t> tiny_shapes, shapes;
+
+    for (size_t it = 0; it < iterations; it++)
+    {
+      std::vector<tinyobj::material_t> materials;
+      std::string warn, err;
+      double t0 = now_ms();
+      if (!tinyobj::LoadObj(&tiny_attrib, &tiny_shapes, &materials, &warn, &err, path.c_str(), nullptr, true))
+      {
+        std::cout << "tinyobj failed on " << path << ": " << err << std::endl;
+        return 1;
+      }
+      tiny_ms.push_back(now_ms() - t0);
+
+      t0 = now_ms();
+      if (!obj_parser::parse_file(path, attrib, shapes, err, threads))
+      {
+        std::cout << "obj_parser failed on " << path << ": " << err << std::endl;
+        return 1;
+      }
+      chunked_ms.push_back(now_ms() - t0);
+    }
+
+    const double tiny = median(tiny_ms), chunked = median(chunked_ms);
+    printf("%s: %.1f MB, %zu triangles\n", path.c_str(), mb,
+           shapes.empty() ? (size_t)0 : shapes[0].mesh.num_face_vertices.size());
+    printf("  tinyobj::LoadObj   %9.2f ms  %8.1f MB/s\n", tiny, mb / tiny * 1000.0);
+    printf("  obj_parser::parse  %9.2f ms  %8.1f MB/s  (%.2fx)\n", chunked, mb / chunked * 1000.0,
+           tiny / chunked);
+    printf("  max |diff| v %.3g vn %.3g vt %.3g\n", max_abs_diff(tiny_attrib.vertices, attrib.vertices),
+           max_abs_diff(tiny_attrib.normals, attrib.normals), max_abs_diff(tiny_attrib.texcoords, attrib.texcoords));
+
+    const size_t differ = differing_triangles(tiny_shapes, shapes);
+    if (differ == SIZE_MAX)
+      printf("  shapes DIFFER\n");
+    else
+      printf("  %zu triangles split differently\n", differ);
+  }
+
+  return 0;
+}
@@ -0,0 +1,107 @@
+// Program creation time of the app's shader programs with and without the
+// program binary cache (program_cache.h):
+//
+//   shader_bench [--headless] [--runs N]
+//
+// Every program is built --runs times three ways: from source with no cache,
+// cold (the cache emptied first, so it compiles from source and stores the
+// binary) and warm (loaded from the binary the cold build stored). Reported
+// is the median ms per program up to the end of a first one-point draw with
+// it, since drivers may put off part of the compile until a program is first
+// used. Drivers may keep their own shader cache (Mesa's is on by default),
+// which makes even the uncached builds faster after the first; Mesa also
+// hands out program binaries only while that cache is on. Run from the build
+// directory so shaders/ is found; the binaries go to shaders/cache.
+
+#include "bench_common.h"
+
+#include <gl_state.h>
+#include <program_cache.h>
+#include <shader.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// time building one program and drawing a point with it; the program is
+// deleted again with the Shader
+static double build_ms(const char *vertex, const char *fragment, ProgramCache *cache, bool *from_cache = nullptr)
+{
+  const double t0 = now_ms();
+  Shader shader(vertex, fragment, cache);
+  shader.use();
+  glDrawArrays(GL_POINTS, 0, 1);
+  glFinish();
+  const double ms = now_ms() - t0;
+  if (from_cache)
+    *from_cache = shader.isFromCache();
+  return ms;
+}
+
+int main(int argc, char **argv)
+{
+  size_t runs = 10;
+  int width = 64, height = 64;
+  bool headless_mode = false;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "--headless")
+      headless_mode = true;
+    else if (arg == "--runs" && i + 1 < argc)
+      runs = std::max(1ul, std::stoul(argv[++i]));
+    else
+    {
+      printf("Unknown option %s\n", arg.c_str());
+      return 1;
+    }
+  }
+
+  BenchContext context;
+  if (!context.create("shader_bench", headless_mode, width, height))
+    return 1;
+
+  // the points are drawn from the current attribute values
+  GLuint vao;
+  glGenVertexArrays(1, &vao);
+  gl_state().bindVertexArray(vao);
+
+  ProgramCache cache;
+  if (!cache.init(context.loader()))
+  {
+    printf("%s cannot hand out program binaries, nothing to compare\n", glGetString(GL_RENDERER));
+    return 1;
+  }
+  printf("%s, OpenGL %s, %zu runs per program\n", glGetString(GL_RENDERER), glGetString(GL_VERSION), runs);
+  printf("%-28s  %9s  %9s  %9s  %8s\n", "program", "source", "cold", "warm", "speedup");
+
+  const char *vertex_shaders[] = {"shaders/shader.vs", "shaders/shader_compact.vs", "shaders/shader_instanced.vs"};
+  double total_source = 0.0, total_warm = 0.0;
+  for (const char *vertex : vertex_shaders)
+  {
+    std::vector<double> source_ms, cold_ms, warm_ms;
+    for (size_t r = 0; r < runs; r++)
+    {
+      source_ms.push_back(build_ms(vertex, "shaders/shader.fs", nullptr));
+      cache.clear();
+      cold_ms.push_back(build_ms(vertex, "shaders/shader.fs", &cache));
+      bool hit = false;
+      warm_ms.push_back(build_ms(vertex, "shaders/shader.fs", &cache, &hit));
+      if (!hit)
+      {
+        printf("%s was not loaded from the cache (%zu rejected)\n", vertex, cache.getRejects());
+        return 1;
+      }
+    }
+
+    const double source = median(source_ms), warm = median(warm_ms);
+    printf("%-28s  %9.3f  %9.3f  %9.3f  %7.1fx\n", vertex + 8, source, median(cold_ms), warm, source / warm);
+    total_source += source;
+    total_warm += warm;
+  }
+  printf("all programs: %.3f ms from source, %.3f ms from the cache\n", total_source, total_warm);
+
+  return 0;
+}
@@ -0,0 +1,326 @@
+// Repeatable frame time benchmark of the full scene: renders a fixed number of
+// frames along a scripted timeline, so that two runs draw exactly the same
+// frames, and reports CPU and GPU frame times:
+//
+//   tbd_bench [--headless] [--frames N] [--warmup N] [--width W] [--height H]
+//             [--lights N] [--forward] [--texture-filter linear|trilinear|anisotropic]
+//             [--texture-compression bc|none] [--json out.json]
+//
+// The camera orbits the bucket and dollies in and out once over the measured
+// frames while the spot lights turn by their fixed step per frame. Warm-up
+// frames are rendered first and left out of the results. CPU time is the wall
+// time of a frame from its first GL call to the swap (or flush when
+// headless); GPU time is measured with GL_TIME_ELAPSED queries read a few
+// frames late so the CPU never waits for them. Mean, p50, p95, p99 and max
+// are printed and, with --json, written with every frame's times. The floor
+// seen at a grazing angle makes up most of the texture sampling, so running
+// once per --texture-filter compares the cost of sampling the textures'
+// mip chains against level 0 alone, and once per --texture-compression the
+// BC1/BC3 textures against 8-bit ones. Run from the build directory so
+// shaders/ and asset/ are found.
+
+#define STB_IMAGE_IMPLEMENTATION
+
+#include "bench_common.h"
+
+#include <disco_lights.h>
+#include <gl_state.h>
+#include <light_block.h>
+#include <mesh_cache.h>
+#include <shader.h>
+#include <texture.h>
+#include <texture_cache.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// queries in flight; results are read this many frames after they were issued
+#define GPU_QUERY_LATENCY 4
+
+struct TexturedMesh
+{
+  DrawMesh draw;
+  GLuint texture;
+};
+
+static TexturedMesh upload(const Mesh &mesh, const MipChain &chain, TextureFilter filter, const TextureCaps &caps,
+                           size_t &texture_bytes)
+{
+  TexturedMesh m;
+  m.draw = upload_draw_mesh(mesh);
+  // same sampling as the app's upload_texture
+  glGenTextures(1, &m.texture);
+  texture_bytes += upload_mip_chain(m.texture, chain, filter, caps);
+  return m;
+}
+
+// camera of frame f out of count along the scripted orbit; t = 0 is the app's
+// fixed camera
+static glm::mat4 timeline_view(size_t f, size_t count)
+{
+  const float t = (float)f / (float)std::max<size_t>(1, count);
+  const float angle = std::atan2(50.0f, 200.0f) + glm::radians(360.0f) * t;
+  const float distance =
+      std::sqrt(50.0f * 50.0f + 200.0f * 200.0f) * (1.0f - 0.4f * std::sin(glm::radians(180.0f) * t));
+  const glm::vec3 eye(distance * std::sin(angle), 100.0f, distance * std::cos(angle));
+  return glm::lookAt(eye, glm::vec3(0, 80, 0), glm::vec3(0, 1, 0));
+}
+
+struct Summary
+{
+  double mean, p50, p95, p99, max;
+};
+
+// nearest-rank percentiles
+static Summary summarize(std::vector<double> samples)
+{
+  Summary s = {0.0, 0.0, 0.0, 0.0, 0.0};
+  if (samples.empty())
+    return s;
+  std::sort(samples.begin(), samples.end());
+  for (double v : samples)
+    s.mean += v;
+  s.mean /= samples.size();
+  auto rank = [&](double p) {
+    return samples[std::min(samples.size() - 1, (size_t)std::ceil(p * samples.size()) - 1)];
+  };
+  s.p50 = rank(0.50);
+  s.p95 = rank(0.95);
+  s.p99 = rank(0.99);
+  s.max = samples.back();
+  return s;
+}
+
+static void print_summary(const char *label, const Summary &s)
+{
+  printf("%-8s  %8.3f  %8.3f  %8.3f  %8.3f  %8.3f\n", label, s.mean, s.p50, s.p95, s.p99, s.max);
+}
+
+static void write_summary(FILE *out, const char *name, const Summary &s, const std::vector<double> &frames)
+{
+  fprintf(out, "  \"%s\": {\"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f, ", name,
+          s.mean, s.p50, s.p95, s.p99, s.max);
+  fprintf(out, "\"frames\": [");
+  for (size_t i = 0; i < frames.size(); i++)
+    fprintf(out, "%s%.4f", i ? ", " : "", frames[i]);
+  fprintf(out, "]}");
+}
+
+// renderer strings can contain quotes and backslashes in theory
+static std::string json_escape(const char *text)
+{
+  std::string out;
+  for (const char *c = text; c && *c; c++)
+  {
+    if (*c == '"' || *c == '\\')
+      out += '\\';
+    out += *c;
+  }
+  return out;
+}
+
+int main(int argc, char **argv)
+{
+  size_t frames = 300, warmup = 30, light_count = 3;
+  int width = 1024, height = 768;
+  bool headless_mode = false, forward = false;
+  TextureFilter filter = TextureFilter::Anisotropic;
+  bool compressed = true;
+  std::string json;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "--headless")
+      headless_mode = true;
+    else if (arg == "--forward")
+      forward = true;
+    else if (arg == "--frames" && i + 1 < argc)
+      frames = std::max(1ul, std::stoul(argv[++i]));
+    else if (arg == "--warmup" && i + 1 < argc)
+      warmup = std::stoul(argv[++i]);
+    else if (arg == "--width" && i + 1 < argc)
+      width = std::stoi(argv[++i]);
+    else if (arg == "--height" && i + 1 < argc)
+      height = std::stoi(argv[++i]);
+    else if (arg == "--lights" && i + 1 < argc)
+      light_count = std::min<size_t>(MAX_LIGHTS, std::stoul(argv[++i]));
+    else if (arg == "--texture-filter" && i + 1 < argc)
+    {
+      const std::string name = argv[++i];
+      if (name == "linear")
+        filter = TextureFilter::Linear;
+      else if (name == "trilinear")
+        filter = TextureFilter::Trilinear;
+      else if (name == "anisotropic")
+        filter = TextureFilter::Anisotropic;
+      else
+      {
+        printf("Unknown texture filter %s\n", name.c_str());
+        return 1;
+      }
+    }
+    else if (arg == "--texture-compression" && i + 1 < argc)
+    {
+      const std::string name = argv[++i];
+      if (name != "bc" && name != "none")
+      {
+        printf("Unknown texture compression %s\n", name.c_str());
+        return 1;
+      }
+      compressed = name == "bc";
+    }
+    else if (arg == "--json" && i + 1 < argc)
+      json = argv[++i];
+    else
+    {
+      printf("Unknown option %s\n", arg.c_str());
+      return 1;
+    }
+  }
+
+  BenchContext context;
+  if (!context.create("tbd_bench", headless_mode, width, height, true))
+    return 1;
+  const TextureCaps caps = TextureCaps::query(context.loader());
+
+  gl_state().enable(GL_DEPTH_TEST);
+  gl_state().enable(GL_CULL_FACE);
+  glCullFace(GL_BACK);
+
+  std::vector<TexturedMesh> meshes;
+  size_t texture_bytes = 0;
+  const char *obj_paths[] = {"asset/timmy.obj", "asset/bucket.obj", "asset/floor.obj"};
+  const char *img_paths[] = {"asset/timmy.png", "asset/bucket.jpg", "asset/floor.jpeg"};
+  for (size_t i = 0; i < 3; i++)
+  {
+    const MipChain chain = load_texture(img_paths[i], compressed);
+    if (chain.isValid())
+    {
+      meshes.push_back(upload(load_mesh(obj_paths[i]), chain, filter, caps, texture_bytes));
+      continue;
+    }
+    // a missing texture is not fatal: the mesh is drawn white, so the frame
+    // keeps all of its geometry
+    printf("Failed to load %s, drawing %s untextured\n", img_paths[i], obj_paths[i]);
+    meshes.push_back({upload_draw_mesh(load_mesh(obj_paths[i])), white_texture()});
+  }
+
+  Shader shader("shaders/shader.vs", "shaders/shader.fs");
+  shader.use();
+  shader.bindUniformBlock("Lights", LIGHTS_BINDING);
+  shader.set(shader.uniform<int>("lightData"), 1);
+  shader.set(shader.uniform<int>("clusterCells"), 2);
+  shader.set(shader.uniform<int>("clusterLights"), 3);
+  shader.set(shader.uniform<bool>("bruteForce"), forward);
+  const Uniform<glm::mat4> u_view = shader.uniform<glm::mat4>("view");
+
+  const float aspect = (float)width / (float)height;
+  shader.set(shader.uniform<glm::mat4>("model"), glm::mat4(1.0f));
+  shader.set(shader.uniform<glm::mat4>("projection"),
+             glm::perspective(glm::radians(60.0f), aspect, 0.1f, 1000.0f));
+
+  LightBlock lights;
+  lights.create();
+  lights.bindTextures(1);
+  LightClusters clusters;
+  clusters.setProjection(glm::radians(60.0f), aspect, 0.1f, 1000.0f);
+  std::vector<DiscoLight> disco = make_disco_lights(light_count);
+  std::vector<SpotLight> frame_lights;
+  lights.updateParams(total_ambient(disco), disco.size(), clusters, glm::vec2(width, height));
+
+  GLuint queries[GPU_QUERY_LATENCY];
+  glGenQueries(GPU_QUERY_LATENCY, queries);
+
+  const std::string renderer = (const char *)glGetString(GL_RENDERER);
+  const bool expanded = compressed && !caps.s3tc;
+  printf("%s, %s %dx%d, %zu lights %s, %zu frames after %zu warm-up\n", renderer.c_str(),
+         headless_mode ? "headless" : "windowed", width, height, light_count, forward ? "forward" : "clustered",
+         frames, warmup);
+  printf("textures %s%s, %s filtering, %zu KB of texture memory\n", compressed ? "BC1/BC3" : "uncompressed",
+         expanded ? " (expanded, no S3TC)" : "", texture_filter_name(filter), texture_bytes / 1024);
+
+  std::vector<double> cpu_ms, gpu_ms;
+  const size_t total = warmup + frames;
+  for (size_t f = 0; f < total + GPU_QUERY_LATENCY; f++)
+  {
+    // the result issued GPU_QUERY_LATENCY frames ago has had time to arrive
+    GLuint &query = queries[f % GPU_QUERY_LATENCY];
+    if (f >= GPU_QUERY_LATENCY && f - GPU_QUERY_LATENCY >= warmup)
+    {
+      GLuint64 ns = 0;
+      glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+      gpu_ms.push_back(ns / 1e6);
+    }
+    if (f >= total)
+      continue;
+
+    const double t0 = now_ms();
+    glBeginQuery(GL_TIME_ELAPSED, query);
+
+    // the timeline restarts after the warm-up so the measured frames are
+    // the same whatever the warm-up length
+    if (f == warmup)
+      disco = make_disco_lights(light_count);
+    const glm::mat4 view = timeline_view(f < warmup ? 0 : f - warmup, frames);
+    animate_disco_lights(disco, frame_lights);
+    lights.updateLights(frame_lights.data(), frame_lights.size());
+    if (!forward)
+    {
+      clusters.assign(frame_lights.data(), frame_lights.size(), view);
+      lights.updateClusters(clusters);
+    }
+
+    glClearColor(0.3f, 0.4f, 0.5f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    shader.use();
+    shader.set(u_view, view);
+    for (const TexturedMesh &m : meshes)
+    {
+      gl_state().bindTexture(GL_TEXTURE_2D, m.texture);
+      gl_state().bindVertexArray(m.draw.vao);
+      glDrawElements(GL_TRIANGLES, m.draw.index_count, GL_UNSIGNED_INT, (void *)0);
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+
+    context.swap();
+    if (f >= warmup)
+      cpu_ms.push_back(now_ms() - t0);
+  }
+
+  const Summary cpu = summarize(cpu_ms), gpu = summarize(gpu_ms);
+  printf("%-8s  %8s  %8s  %8s  %8s  %8s\n", "ms", "mean", "p50", "p95", "p99", "max");
+  print_summary("cpu", cpu);
+  print_summary("gpu", gpu);
+
+  if (!json.empty())
+  {
+    FILE *out = fopen(json.c_str(), "w");
+    if (!out)
+    {
+      printf("Failed to open %s\n", json.c_str());
+      return 1;
+    }
+    fprintf(out, "{\n  \"renderer\": \"%s\",\n  \"context\": \"%s\",\n", json_escape(renderer.c_str()).c_str(),
+            headless_mode ? "headless" : "windowed");
+    fprintf(out, "  \"width\": %d,\n  \"height\": %d,\n  \"lights\": %zu,\n  \"lighting\": \"%s\",\n", width, height,
+            light_count, forward ? "forward" : "clustered");
+    fprintf(out, "  \"texture_filter\": \"%s\",\n", texture_filter_name(filter));
+    fprintf(out, "  \"texture_compression\": \"%s\",\n  \"texture_bytes\": %zu,\n",
+            compressed && !expanded ? "bc" : "none", texture_bytes);
+    fprintf(out, "  \"frames\": %zu,\n  \"warmup\": %zu,\n", frames, warmup);
+    write_summary(out, "cpu_ms", cpu, cpu_ms);
+    fprintf(out, ",\n");
+    write_summary(out, "gpu_ms", gpu, gpu_ms);
+    fprintf(out, "\n}\n");
+    fclose(out);
+    printf("Wrote %s\n", json.c_str());
+  }
+
+  glDeleteQueries(GPU_QUERY_LATENCY, queries);
+  return 0;
+}
@@ -0,0 +1,174 @@
+// Startup cost of the textures: decoding each image, filtering its mip
+// chain (mip_chain.h) with the scalar and the SIMD loops, and mapping the
+// texture cache (texture_cache.h) that replaces both on later runs; then
+// the cost and quality of block compressing the chains
+// (block_compression.h):
+//
+//   texture_bench [--runs N] [--threads N] [image ...]
+//
+// Without images the scene's textures in asset/ are used, so run from the
+// build directory. Each step is timed over the runs and the median reported
+// in ms; the cache read includes touching every texel, as the upload does,
+// so the pages are faulted in. The caches next to each image are
+// rewritten. Compression is timed on one thread and on --threads (the
+// hardware concurrency by default) and reported with the texture memory of
+// the whole chain, bits per texel and the PSNR of all levels against the
+// uncompressed chain. The frame time side is measured with tbd_bench
+// --texture-filter and --texture-compression.
+
+#define STB_IMAGE_IMPLEMENTATION
+
+#include "bench_common.h"
+
+#include <texture_cache.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+// sum of every texel of the chain, so reading it cannot be skipped
+static uint64_t touch(const MipChain &chain)
+{
+  uint64_t sum = 0;
+  for (size_t i = 0; i < chain.getPixelBytes(); i += 64)
+    sum += chain.getPixels()[i];
+  return sum;
+}
+
+// peak signal to noise ratio of every level of b against a, over the color
+// channels and alpha if there is one
+static double psnr(const MipChain &a, const MipChain &b)
+{
+  double squared = 0.0;
+  for (size_t i = 0; i < a.getPixelBytes(); i++)
+  {
+    const double d = (double)a.getPixels()[i] - b.getPixels()[i];
+    squared += d * d;
+  }
+  const double mse = squared / a.getPixelBytes();
+  return mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : INFINITY;
+}
+
+int main(int argc, char **argv)
+{
+  size_t runs = 10, threads = 0;
+  std::vector<std::string> paths;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "--runs" && i + 1 < argc)
+      runs = std::max(1ul, std::stoul(argv[++i]));
+    else if (arg == "--threads" && i + 1 < argc)
+      threads = std::stoul(argv[++i]);
+    else
+      paths.push_back(arg);
+  }
+  if (paths.empty())
+    paths = {"asset/bucket.jpg", "asset/floor.jpeg"};
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+
+#ifdef MIP_CHAIN_SSE2
+  const char *simd = "sse2";
+#else
+  const char *simd = "scalar";
+#endif
+  printf("%zu runs per step, simd path %s\n", runs, simd);
+  printf("%-20s  %11s  %6s  %9s  %9s  %9s  %9s  %9s\n", "image", "size", "levels", "decode", "scalar", "simd",
+         "write", "cache hit");
+
+  double total_decode = 0.0, total_hit = 0.0;
+  uint64_t checksum = 0;
+  for (const std::string &path : paths)
+  {
+    const Image image = Image::load(path);
+    if (!image.isValid())
+    {
+      printf("%-20s  failed to decode\n", path.c_str());
+      continue;
+    }
+    const uint32_t width = (uint32_t)image.getWidth(), height = (uint32_t)image.getHeight();
+    const int channels = image.getChannels();
+
+    std::vector<double> decode_ms, scalar_ms, simd_ms, write_ms, hit_ms;
+    for (size_t r = 0; r < runs; r++)
+    {
+      double t0 = now_ms();
+      const Image decoded = Image::load(path);
+      decode_ms.push_back(now_ms() - t0);
+
+      t0 = now_ms();
+      const MipChain scalar = MipChain::buildScalar(decoded.getData(), width, height, channels);
+      scalar_ms.push_back(now_ms() - t0);
+
+      t0 = now_ms();
+      const MipChain chain = MipChain::build(decoded.getData(), width, height, channels);
+      simd_ms.push_back(now_ms() - t0);
+
+      t0 = now_ms();
+      write_texture_cache(path, chain);
+      write_ms.push_back(now_ms() - t0);
+
+      MipChain cached;
+      t0 = now_ms();
+      if (!read_texture_cache(path, false, cached))
+      {
+        printf("%-20s  failed to read the texture cache\n", path.c_str());
+        return 1;
+      }
+      checksum += touch(cached);
+      hit_ms.push_back(now_ms() - t0);
+      checksum += touch(scalar);
+    }
+
+    const MipChain chain = MipChain::build(image.getData(), width, height, channels);
+    char size[32];
+    snprintf(size, sizeof(size), "%ux%ux%d", width, height, channels);
+    printf("%-20s  %11s  %6zu  %9.3f  %9.3f  %9.3f  %9.3f  %9.3f\n", path.c_str(), size, chain.getLevelCount(),
+           median(decode_ms), median(scalar_ms), median(simd_ms), median(write_ms), median(hit_ms));
+    total_decode += median(decode_ms) + median(simd_ms);
+    total_hit += median(hit_ms);
+  }
+
+  printf("startup on one thread: %.3f ms decoding and filtering, %.3f ms from the cache (checksum %llu)\n",
+         total_decode, total_hit, (unsigned long long)checksum);
+
+  printf("\n%-20s  %6s  %9s  %9s  %10s  %9s  %9s  %8s\n", "image", "format", "raw KB", "block KB", "bits/texel",
+         "1 thread", "threads", "psnr dB");
+  for (const std::string &path : paths)
+  {
+    const MipChain chain = load_texture(path);
+    const BlockFormat format = block_format_for(chain.getChannels());
+    if (!chain.isValid() || format == BlockFormat::None)
+      continue;
+
+    std::vector<double> single_ms, threaded_ms;
+    MipChain compressed;
+    for (size_t r = 0; r < runs; r++)
+    {
+      double t0 = now_ms();
+      compressed = MipChain::compress(chain, format, 1);
+      single_ms.push_back(now_ms() - t0);
+
+      t0 = now_ms();
+      compressed = MipChain::compress(chain, format, threads);
+      threaded_ms.push_back(now_ms() - t0);
+    }
+    write_texture_cache(path, compressed);
+
+    size_t texels = 0;
+    for (size_t i = 0; i < chain.getLevelCount(); i++)
+      texels += (size_t)chain.getLevel(i).width * chain.getLevel(i).height;
+    printf("%-20s  %6s  %9zu  %9zu  %10.2f  %9.3f  %9.3f  %8.2f\n", path.c_str(), block_format_name(format),
+           chain.getPixelBytes() / 1024, compressed.getPixelBytes() / 1024,
+           8.0 * compressed.getPixelBytes() / texels, median(single_ms), median(threaded_ms),
+           psnr(chain, MipChain::decompress(compressed)));
+  }
+  printf("(compressed on %zu threads)\n", threads);
+  return 0;
+}
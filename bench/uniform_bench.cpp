@@ -0,0 +1,247 @@
+// Per-frame CPU cost of the scene's uniform updates. The first three modes
+// set the lights field by field on bench/shaders/lights_uniforms.fs, the
+// fragment shader from before the Lights uniform block:
+//
+//   raw     std::string + glGetUniformLocation + glUniform* per call, like
+//           Shader did before uniforms were reflected
+//   names   Shader::setVec3("lights[0].position", ...) through the reflected
+//           location table, skipping unchanged values
+//   handles pre-resolved Uniform<T> handles, skipping unchanged values
+//   ubo     shaders/shader.fs: the matrices through handles and the three
+//           spot lights in one glBufferSubData of the LightBlock
+//
+//   uniform_bench [--frames N]
+//
+// Run from the build directory so shaders/ is found.
+
+#include "bench_common.h"
+
+#include <disco_lights.h>
+#include <light_block.h>
+#include <shader.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifndef BENCH_SHADER_DIR
+#define BENCH_SHADER_DIR "bench/shaders/"
+#endif
+
+// the light array size of lights_uniforms.fs
+#define NR_LIGHTS 3
+
+static double now_ns()
+{
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// the values main.cpp sets each frame; only the spot directions change
+struct FrameUniforms
+{
+  glm::mat4 model, view, projection;
+  glm::vec3 light_pos;
+  glm::vec3 directions[NR_LIGHTS];
+  glm::vec3 colors[NR_LIGHTS];
+};
+
+static FrameUniforms frame_uniforms(size_t frame)
+{
+  FrameUniforms f;
+  f.model = glm::mat4(1.0f);
+  f.view = glm::lookAt(glm::vec3(50, 100, 200), glm::vec3(0, 80, 0), glm::vec3(0, 1, 0));
+  f.projection = glm::perspective(glm::radians(60.0f), 4.0f / 3.0f, 0.1f, 1000.0f);
+  f.light_pos = glm::vec3(0, 200, 0);
+  for (int i = 0; i < NR_LIGHTS; i++)
+  {
+    const float theta = 0.05f * frame + i * 2.0f;
+    f.directions[i] = glm::vec3(70.7f * std::cos(theta), -200.0f, -70.7f * std::sin(theta));
+    f.colors[i] = glm::vec3(i == 0, i == 1, i == 2);
+  }
+  return f;
+}
+
+static void set_raw(unsigned int id, const std::string &name, const glm::vec3 &v)
+{
+  glUniform3fv(glGetUniformLocation(id, name.c_str()), 1, &v[0]);
+}
+
+static void set_raw(unsigned int id, const std::string &name, float v)
+{
+  glUniform1f(glGetUniformLocation(id, name.c_str()), v);
+}
+
+static void set_raw(unsigned int id, const std::string &name, const glm::mat4 &m)
+{
+  glUniformMatrix4fv(glGetUniformLocation(id, name.c_str()), 1, GL_FALSE, &m[0][0]);
+}
+
+static void frame_raw(const Shader &shader, const FrameUniforms &f)
+{
+  const unsigned int id = shader.getID();
+  set_raw(id, "model", f.model);
+  set_raw(id, "view", f.view);
+  set_raw(id, "projection", f.projection);
+
+  const char *prefixes[NR_LIGHTS] = {"lights[0].", "lights[1].", "lights[2]."};
+  for (int i = 0; i < NR_LIGHTS; i++)
+  {
+    const std::string p = prefixes[i];
+    set_raw(id, p + "position", f.light_pos);
+    set_raw(id, p + "direction", f.directions[i]);
+    set_raw(id, p + "cutOff", (float)glm::cos(M_PI / 6.0f));
+    set_raw(id, p + "ambient", glm::vec3(0.2f));
+    set_raw(id, p + "diffuse", f.colors[i]);
+    set_raw(id, p + "constant", 1.0f);
+    set_raw(id, p + "linear", 0.35e-4f);
+    set_raw(id, p + "quadratic", 0.44e-4f);
+  }
+}
+
+static void frame_names(const Shader &shader, const FrameUniforms &f)
+{
+  shader.setMat4("model", f.model);
+  shader.setMat4("view", f.view);
+  shader.setMat4("projection", f.projection);
+
+  const char *prefixes[NR_LIGHTS] = {"lights[0].", "lights[1].", "lights[2]."};
+  for (int i = 0; i < NR_LIGHTS; i++)
+  {
+    const std::string p = prefixes[i];
+    shader.setVec3(p + "position", f.light_pos);
+    shader.setVec3(p + "direction", f.directions[i]);
+    shader.setFloat(p + "cutOff", (float)glm::cos(M_PI / 6.0f));
+    shader.setVec3(p + "ambient", glm::vec3(0.2f));
+    shader.setVec3(p + "diffuse", f.colors[i]);
+    shader.setFloat(p + "constant", 1.0f);
+    shader.setFloat(p + "linear", 0.35e-4f);
+    shader.setFloat(p + "quadratic", 0.44e-4f);
+  }
+}
+
+struct Handles
+{
+  Uniform<glm::mat4> model, view, projection;
+  Uniform<glm::vec3> position[NR_LIGHTS], direction[NR_LIGHTS], ambient[NR_LIGHTS], diffuse[NR_LIGHTS];
+  Uniform<float> cutOff[NR_LIGHTS], constant[NR_LIGHTS], linear[NR_LIGHTS], quadratic[NR_LIGHTS];
+};
+
+static Handles resolve(const Shader &shader)
+{
+  Handles h;
+  h.model = shader.uniform<glm::mat4>("model");
+  h.view = shader.uniform<glm::mat4>("view");
+  h.projection = shader.uniform<glm::mat4>("projection");
+  for (int i = 0; i < NR_LIGHTS; i++)
+  {
+    const std::string p = "lights[" + std::to_string(i) + "].";
+    h.position[i] = shader.uniform<glm::vec3>(p + "position");
+    h.direction[i] = shader.uniform<glm::vec3>(p + "direction");
+    h.cutOff[i] = shader.uniform<float>(p + "cutOff");
+    h.ambient[i] = shader.uniform<glm::vec3>(p + "ambient");
+    h.diffuse[i] = shader.uniform<glm::vec3>(p + "diffuse");
+    h.constant[i] = shader.uniform<float>(p + "constant");
+    h.linear[i] = shader.uniform<float>(p + "linear");
+    h.quadratic[i] = shader.uniform<float>(p + "quadratic");
+  }
+  return h;
+}
+
+static void frame_handles(const Shader &shader, const Handles &h, const FrameUniforms &f)
+{
+  shader.set(h.model, f.model);
+  shader.set(h.view, f.view);
+  shader.set(h.projection, f.projection);
+  for (int i = 0; i < NR_LIGHTS; i++)
+  {
+    shader.set(h.position[i], f.light_pos);
+    shader.set(h.direction[i], f.directions[i]);
+    shader.set(h.cutOff[i], (float)glm::cos(M_PI / 6.0f));
+    shader.set(h.ambient[i], glm::vec3(0.2f));
+    shader.set(h.diffuse[i], f.colors[i]);
+    shader.set(h.constant[i], 1.0f);
+    shader.set(h.linear[i], 0.35e-4f);
+    shader.set(h.quadratic[i], 0.44e-4f);
+  }
+}
+
+static void frame_ubo(const Shader &shader, const Handles &h, LightBlock &lights, std::vector<SpotLight> &spots,
+                      const FrameUniforms &f)
+{
+  shader.set(h.model, f.model);
+  shader.set(h.view, f.view);
+  shader.set(h.projection, f.projection);
+  for (int i = 0; i < NR_LIGHTS; i++)
+    spots[i].direction = glm::normalize(f.directions[i]);
+  lights.updateLights(spots.data(), spots.size());
+}
+
+// median and 99th percentile of the per frame times in ns; the raw path
+// bypasses Shader, so each of its calls is an upload
+template <typename F>
+static void run(const char *label, const Shader &shader, size_t frames, size_t raw_uploads, F frame)
+{
+  std::vector<FrameUniforms> values;
+  for (size_t i = 0; i < frames; i++)
+    values.push_back(frame_uniforms(i));
+
+  const size_t uploads = shader.getUniformUploads(), skips = shader.getUniformSkips();
+  std::vector<double> samples(frames);
+  for (size_t i = 0; i < frames; i++)
+  {
+    const double t0 = now_ns();
+    frame(values[i]);
+    samples[i] = now_ns() - t0;
+  }
+  glFinish();
+
+  std::sort(samples.begin(), samples.end());
+  const double per_frame_uploads = raw_uploads + (double)(shader.getUniformUploads() - uploads) / frames;
+  printf("%-8s  median %8.0f ns/frame  p99 %8.0f ns/frame  %5.1f uploads + %5.1f skipped per frame\n", label,
+         samples[frames / 2], samples[frames * 99 / 100], per_frame_uploads,
+         (double)(shader.getUniformSkips() - skips) / frames);
+}
+
+int main(int argc, char **argv)
+{
+  size_t frames = 10000;
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "--frames" && i + 1 < argc)
+      frames = std::max(1ul, std::stoul(argv[++i]));
+  }
+
+  int width = 64, height = 64;
+  BenchContext context;
+  if (!context.create("uniform_bench", false, width, height))
+    return 1;
+
+  Shader shader("shaders/shader.vs", BENCH_SHADER_DIR "lights_uniforms.fs");
+  shader.use();
+  const Handles handles = resolve(shader);
+
+  printf("%zu frames, %d values set per frame\n", frames, 3 + 8 * NR_LIGHTS);
+  run("raw", shader, frames, 3 + 8 * NR_LIGHTS, [&](const FrameUniforms &f) { frame_raw(shader, f); });
+  run("names", shader, frames, 0, [&](const FrameUniforms &f) { frame_names(shader, f); });
+  run("handles", shader, frames, 0, [&](const FrameUniforms &f) { frame_handles(shader, handles, f); });
+
+  Shader block_shader("shaders/shader.vs", "shaders/shader.fs");
+  block_shader.use();
+  block_shader.bindUniformBlock("Lights", LIGHTS_BINDING);
+  const Handles block_handles = resolve(block_shader);
+  block_shader.set(block_shader.uniform<bool>("bruteForce"), true);
+  std::vector<DiscoLight> disco = make_disco_lights(NR_LIGHTS);
+  std::vector<SpotLight> spots;
+  animate_disco_lights(disco, spots);
+  LightBlock lights;
+  lights.create();
+  lights.updateParams(total_ambient(disco), spots.size(), LightClusters(), glm::vec2(64, 64));
+  run("ubo", block_shader, frames, 1,
+      [&](const FrameUniforms &f) { frame_ubo(block_shader, block_handles, lights, spots, f); });
+
+  return 0;
+}
@@ -0,0 +1,182 @@
+// Fragment cost of the generic scene program against its specialized
+// variants (shader_variants.h), drawing the scene's meshes lit by the disco
+// lights:
+//
+//   variant_bench [--headless] [--frames N] [--width W] [--height H] [--counts 3,64,...]
+//
+// For each light count and lighting path the meshes are drawn with four
+// programs: the generic one, choosing the path by uniform and looping up to
+// the count in the Lights block; "baked", with the path and, for forward
+// lighting, the count compiled in; "smooth", which also applies the cones
+// without a branch; and "untextured", which also skips the texture fetch.
+// Reported is the median time of the draws, from the clear until glFinish
+// returns so that software rasterizers, which defer the work past the end of
+// GL_TIME_ELAPSED queries, are measured too; then the speedup of the last variant over the generic program and how
+// far the smooth cones move the image: the largest channel difference from
+// the generic program's frame and the share of pixels differing by more than
+// 2. The meshes are textured white so that every variant draws the same
+// frame. Run from the build directory so shaders/ and asset/ are found.
+
+#include "bench_common.h"
+
+#include <disco_lights.h>
+#include <gl_state.h>
+#include <light_block.h>
+#include <mesh_cache.h>
+#include <shader_variants.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv)
+{
+  size_t frames = 10;
+  int width = 1024, height = 768;
+  bool headless_mode = false;
+  std::vector<size_t> counts = {3, 16, 64, 256};
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "--headless")
+      headless_mode = true;
+    else if (arg == "--frames" && i + 1 < argc)
+      frames = std::max(1ul, std::stoul(argv[++i]));
+    else if (arg == "--width" && i + 1 < argc)
+      width = std::stoi(argv[++i]);
+    else if (arg == "--height" && i + 1 < argc)
+      height = std::stoi(argv[++i]);
+    else if (arg == "--counts" && i + 1 < argc)
+    {
+      counts.clear();
+      std::stringstream list(argv[++i]);
+      std::string item;
+      while (std::getline(list, item, ','))
+        counts.push_back(std::min<size_t>(MAX_LIGHTS, std::stoul(item)));
+    }
+    else
+    {
+      printf("Unknown option %s\n", arg.c_str());
+      return 1;
+    }
+  }
+
+  BenchContext context;
+  if (!context.create("variant_bench", headless_mode, width, height))
+    return 1;
+  gl_state().enable(GL_DEPTH_TEST);
+  gl_state().enable(GL_CULL_FACE);
+
+  std::vector<DrawMesh> meshes;
+  for (const char *path : {"asset/timmy.obj", "asset/bucket.obj", "asset/floor.obj"})
+    meshes.push_back(upload_draw_mesh(load_mesh(path)));
+
+  white_texture();
+
+  const glm::mat4 view = glm::lookAt(glm::vec3(50, 100, 200), glm::vec3(0, 80, 0), glm::vec3(0, 1, 0));
+  const glm::mat4 proj = glm::perspective(glm::radians(60.0f), (float)width / height, 0.1f, 1000.0f);
+
+  // the lighting path of the generic program is set per run
+  ShaderVariants variants;
+  variants.init("shaders/shader.vs", "shaders/shader.fs", nullptr, [&](Shader &shader) {
+    shader.bindUniformBlock("Lights", LIGHTS_BINDING);
+    shader.set(shader.uniform<int>("lightData"), 1);
+    shader.set(shader.uniform<int>("clusterCells"), 2);
+    shader.set(shader.uniform<int>("clusterLights"), 3);
+    shader.set(shader.uniform<glm::mat4>("model"), glm::mat4(1.0f));
+    shader.set(shader.uniform<glm::mat4>("view"), view);
+    shader.set(shader.uniform<glm::mat4>("projection"), proj);
+  });
+
+  LightBlock lights;
+  lights.create();
+  lights.bindTextures(1);
+  LightClusters clusters;
+  clusters.setProjection(glm::radians(60.0f), (float)width / height, 0.1f, 1000.0f);
+
+  printf("%s, %dx%d, %zu frames per run\n", glGetString(GL_RENDERER), width, height, frames);
+  printf("%6s  %-9s  %9s  %9s  %9s  %10s  %7s  %8s  %9s\n", "lights", "path", "generic", "baked", "smooth",
+         "untextured", "speedup", "max diff", "differing");
+
+  std::vector<unsigned char> generic_frame(width * height * 4), frame(width * height * 4);
+  for (size_t count : counts)
+  {
+    for (bool forward : {true, false})
+    {
+      ShaderPermutation permutations[4];
+      permutations[1].lighting = forward ? LightingPath::Forward : LightingPath::Clustered;
+      permutations[1].light_count = forward ? (uint32_t)count : 0;
+      permutations[2] = permutations[1];
+      permutations[2].cone = ConeShape::Smooth;
+      permutations[3] = permutations[2];
+      permutations[3].textured = false;
+
+      std::vector<DiscoLight> disco = make_disco_lights(count);
+      std::vector<SpotLight> frame_lights;
+      lights.updateParams(total_ambient(disco), disco.size(), clusters, glm::vec2(width, height));
+
+      double gpu_ms[4];
+      int max_diff = 0;
+      size_t differing = 0;
+      for (int v = 0; v < 4; v++)
+      {
+        Shader &shader = variants.get(permutations[v]);
+        shader.use();
+        shader.set(shader.uniform<bool>("bruteForce"), forward);
+
+        // every variant sees the lights in the same positions
+        std::vector<DiscoLight> animated = disco;
+        std::vector<double> samples;
+        for (size_t f = 0; f < frames; f++)
+        {
+          animate_disco_lights(animated, frame_lights);
+          lights.updateLights(frame_lights.data(), frame_lights.size());
+          if (!forward)
+          {
+            clusters.assign(frame_lights.data(), frame_lights.size(), view);
+            lights.updateClusters(clusters);
+          }
+
+          glFinish();
+          const double t0 = now_ms();
+          glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+          for (const DrawMesh &m : meshes)
+          {
+            gl_state().bindVertexArray(m.vao);
+            glDrawElements(GL_TRIANGLES, m.index_count, GL_UNSIGNED_INT, (void *)0);
+          }
+          glFinish();
+          samples.push_back(now_ms() - t0);
+          // the last frame, to hold against the generic program's
+          if (f + 1 == frames)
+            glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, v == 0 ? generic_frame.data() : frame.data());
+          context.swap();
+        }
+        gpu_ms[v] = median(samples);
+
+        if (v != 2)
+          continue;
+        for (size_t p = 0; p < frame.size(); p += 4)
+        {
+          int pixel_diff = 0;
+          for (size_t c = 0; c < 3; c++)
+            pixel_diff = std::max(pixel_diff, std::abs((int)frame[p + c] - (int)generic_frame[p + c]));
+          max_diff = std::max(max_diff, pixel_diff);
+          differing += pixel_diff > 2;
+        }
+      }
+
+      printf("%6zu  %-9s  %9.3f  %9.3f  %9.3f  %10.3f  %6.2fx  %8d  %8.2f%%\n", count,
+             forward ? "forward" : "clustered", gpu_ms[0], gpu_ms[1], gpu_ms[2], gpu_ms[3], gpu_ms[0] / gpu_ms[3],
+             max_diff, 100.0 * differing / ((size_t)width * height));
+    }
+  }
+  printf("%zu variants built in %.1f ms\n", variants.getVariantCount(), variants.getIssueMs() + variants.getWaitMs());
+
+  return 0;
+}
@@ -0,0 +1,89 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <cpu_profiler.h>
+#include <mesh_cache.h>
+#include <texture_cache.h>
+#include <thread_pool.h>
+
+#include <chrono>
+#include <future>
+#include <string>
+#include <vector>
+
+// Loads every mesh and every texture's mip chain concurrently on a thread
+// pool.
+// Only CPU work runs on the workers; the GL thread polls the jobs and uploads
+// each result as soon as it is ready.
+
+typedef std::chrono::steady_clock::time_point TimePoint;
+
+inline double ms_between(TimePoint from, TimePoint to)
+{
+  return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+struct MeshJob
+{
+  Mesh mesh;
+  bool cache_hit = false;
+  TimePoint begin;
+  TimePoint end;
+};
+
+struct TextureJob
+{
+  MipChain chain;
+  bool cache_hit = false;
+  TimePoint begin;
+  TimePoint end;
+};
+
+struct AssetJobs
+{
+  TimePoint begin;
+  std::vector<std::future<MeshJob>> meshes;
+  std::vector<std::future<TextureJob>> textures;
+};
+
+// block_compressed loads the textures' BC1/BC3 chains, see texture_cache.h
+inline AssetJobs start_asset_jobs(ThreadPool &pool, const std::vector<std::string> &obj_paths,
+                                  const std::vector<std::string> &img_paths, bool block_compressed = false)
+{
+  AssetJobs jobs;
+  jobs.begin = std::chrono::steady_clock::now();
+
+  for (const auto &path : obj_paths)
+  {
+    jobs.meshes.push_back(pool.submit([path] {
+      PROFILE_ZONE("load mesh");
+      MeshJob job;
+      job.begin = std::chrono::steady_clock::now();
+      job.mesh = load_mesh(path, &job.cache_hit);
+      job.end = std::chrono::steady_clock::now();
+      return job;
+    }));
+  }
+
+  for (const auto &path : img_paths)
+  {
+    jobs.textures.push_back(pool.submit([path, block_compressed] {
+      PROFILE_ZONE("load texture");
+      TextureJob job;
+      job.begin = std::chrono::steady_clock::now();
+      job.chain = load_texture(path, block_compressed, &job.cache_hit);
+      job.end = std::chrono::steady_clock::now();
+      return job;
+    }));
+  }
+
+  return jobs;
+}
+
+template <typename T>
+bool is_ready(const std::future<T> &future)
+{
+  return future.valid() && future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+#endif // !ASSET_LOADER_H
@@ -0,0 +1,413 @@
+#ifndef BLOCK_COMPRESSION_H
+#define BLOCK_COMPRESSION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// BC1 and BC3 (DXT1 and DXT5) encoding of 8-bit texels in 4x4 blocks, and
+// decoding back for measuring the error. Colors are fitted along the
+// block's principal axis and the two endpoints refined by least squares
+// against the indices they produce; BC1 is always written in its
+// four-color mode so that the same color block serves BC3. BC3 adds an
+// eight-step alpha ramp between the block's smallest and largest alpha.
+// Opaque textures are stored as BC1 (8 bytes per block, 4 bits per texel)
+// and ones with alpha as BC3 (16 bytes per block).
+
+enum class BlockFormat
+{
+  // tightly packed 8-bit rows
+  None,
+  Bc1,
+  Bc3
+};
+
+inline const char *block_format_name(BlockFormat format)
+{
+  switch (format)
+  {
+  case BlockFormat::None:
+    return "uncompressed";
+  case BlockFormat::Bc1:
+    return "BC1";
+  case BlockFormat::Bc3:
+    return "BC3";
+  }
+  return "";
+}
+
+// bytes of one 4x4 block
+inline size_t block_bytes(BlockFormat format)
+{
+  return format == BlockFormat::Bc3 ? 16 : 8;
+}
+
+// bytes of a width x height level in the format, channels per texel when
+// uncompressed
+inline size_t level_bytes(BlockFormat format, uint32_t width, uint32_t height, int channels)
+{
+  if (format == BlockFormat::None)
+    return (size_t)width * height * channels;
+  return (size_t)((width + 3) / 4) * ((height + 3) / 4) * block_bytes(format);
+}
+
+namespace bc
+{
+
+inline uint16_t pack565(const float color[3])
+{
+  const int r = std::min(31, std::max(0, (int)std::lround(color[0] * (31.0f / 255.0f))));
+  const int g = std::min(63, std::max(0, (int)std::lround(color[1] * (63.0f / 255.0f))));
+  const int b = std::min(31, std::max(0, (int)std::lround(color[2] * (31.0f / 255.0f))));
+  return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+// as the hardware expands it, replicating the top bits
+inline void unpack565(uint16_t packed, float color[3])
+{
+  const int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+  color[0] = (float)((r << 3) | (r >> 2));
+  color[1] = (float)((g << 2) | (g >> 4));
+  color[2] = (float)((b << 3) | (b >> 2));
+}
+
+// the four colors of a four-color block
+inline void palette(uint16_t c0, uint16_t c1, float colors[4][3])
+{
+  unpack565(c0, colors[0]);
+  unpack565(c1, colors[1]);
+  for (int c = 0; c < 3; c++)
+  {
+    colors[2][c] = (2.0f * colors[0][c] + colors[1][c]) / 3.0f;
+    colors[3][c] = (colors[0][c] + 2.0f * colors[1][c]) / 3.0f;
+  }
+}
+
+// nearest palette entry of every texel; returns the squared error
+inline float assign_indices(const uint8_t rgba[64], uint16_t c0, uint16_t c1, uint8_t indices[16])
+{
+  float colors[4][3];
+  palette(c0, c1, colors);
+  float total = 0.0f;
+  for (int i = 0; i < 16; i++)
+  {
+    float best = 1e30f;
+    for (int k = 0; k < 4; k++)
+    {
+      const float dr = rgba[4 * i] - colors[k][0], dg = rgba[4 * i + 1] - colors[k][1],
+                  db = rgba[4 * i + 2] - colors[k][2];
+      const float d = dr * dr + dg * dg + db * db;
+      if (d < best)
+      {
+        best = d;
+        indices[i] = (uint8_t)k;
+      }
+    }
+    total += best;
+  }
+  return total;
+}
+
+// quantize a pair of endpoints to a four-color block: c0 must be the larger
+// of the two, and equal ones leave every texel on c0
+inline void order_endpoints(const float a[3], const float b[3], uint16_t &c0, uint16_t &c1)
+{
+  c0 = pack565(a);
+  c1 = pack565(b);
+  if (c0 < c1)
+    std::swap(c0, c1);
+}
+
+// endpoints minimizing the squared error of the texels at the given
+// indices; false if the indices do not constrain both endpoints
+inline bool least_squares(const uint8_t rgba[64], const uint8_t indices[16], float a[3], float b[3])
+{
+  static const float weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+  float aa = 0.0f, bb = 0.0f, ab = 0.0f, ax[3] = {}, bx[3] = {};
+  for (int i = 0; i < 16; i++)
+  {
+    const float wa = weights[indices[i]], wb = 1.0f - wa;
+    aa += wa * wa;
+    bb += wb * wb;
+    ab += wa * wb;
+    for (int c = 0; c < 3; c++)
+    {
+      ax[c] += wa * rgba[4 * i + c];
+      bx[c] += wb * rgba[4 * i + c];
+    }
+  }
+  const float det = aa * bb - ab * ab;
+  if (std::fabs(det) < 1e-6f)
+    return false;
+  for (int c = 0; c < 3; c++)
+  {
+    a[c] = std::min(255.0f, std::max(0.0f, (ax[c] * bb - bx[c] * ab) / det));
+    b[c] = std::min(255.0f, std::max(0.0f, (bx[c] * aa - ax[c] * ab) / det));
+  }
+  return true;
+}
+
+// color half of a block: two 565 endpoints and sixteen 2-bit indices
+inline void encode_color(const uint8_t rgba[64], uint8_t out[8])
+{
+  float mean[3] = {};
+  for (int i = 0; i < 16; i++)
+  {
+    for (int c = 0; c < 3; c++)
+      mean[c] += rgba[4 * i + c] / 16.0f;
+  }
+  float cov[6] = {};
+  for (int i = 0; i < 16; i++)
+  {
+    const float r = rgba[4 * i] - mean[0], g = rgba[4 * i + 1] - mean[1], b = rgba[4 * i + 2] - mean[2];
+    cov[0] += r * r;
+    cov[1] += r * g;
+    cov[2] += r * b;
+    cov[3] += g * g;
+    cov[4] += g * b;
+    cov[5] += b * b;
+  }
+
+  // principal axis by power iteration
+  float axis[3] = {1.0f, 1.0f, 1.0f};
+  for (int iteration = 0; iteration < 8; iteration++)
+  {
+    const float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+    const float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+    const float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+    const float length = std::max(std::fabs(x), std::max(std::fabs(y), std::fabs(z)));
+    if (length < 1e-6f)
+      break;
+    axis[0] = x / length;
+    axis[1] = y / length;
+    axis[2] = z / length;
+  }
+
+  float low = 1e30f, high = -1e30f;
+  for (int i = 0; i < 16; i++)
+  {
+    const float t = (rgba[4 * i] - mean[0]) * axis[0] + (rgba[4 * i + 1] - mean[1]) * axis[1] +
+                    (rgba[4 * i + 2] - mean[2]) * axis[2];
+    low = std::min(low, t);
+    high = std::max(high, t);
+  }
+  const float norm = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+  float a[3], b[3];
+  for (int c = 0; c < 3; c++)
+  {
+    a[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * high / std::max(norm, 1e-6f)));
+    b[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * low / std::max(norm, 1e-6f)));
+  }
+
+  uint16_t c0, c1;
+  uint8_t indices[16];
+  order_endpoints(a, b, c0, c1);
+  float error = assign_indices(rgba, c0, c1, indices);
+
+  // refine the endpoints against the indices they produced while that helps
+  for (int iteration = 0; iteration < 2 && error > 0.0f; iteration++)
+  {
+    if (!least_squares(rgba, indices, a, b))
+      break;
+    uint16_t r0, r1;
+    uint8_t refined[16];
+    order_endpoints(a, b, r0, r1);
+    const float refined_error = assign_indices(rgba, r0, r1, refined);
+    if (refined_error >= error)
+      break;
+    c0 = r0;
+    c1 = r1;
+    error = refined_error;
+    std::memcpy(indices, refined, sizeof(indices));
+  }
+
+  if (c0 == c1)
+    std::fill(indices, indices + 16, 0);
+
+  uint32_t bits = 0;
+  for (int i = 0; i < 16; i++)
+    bits |= (uint32_t)indices[i] << (2 * i);
+  out[0] = (uint8_t)c0;
+  out[1] = (uint8_t)(c0 >> 8);
+  out[2] = (uint8_t)c1;
+  out[3] = (uint8_t)(c1 >> 8);
+  std::memcpy(out + 4, &bits, 4);
+}
+
+// alpha half of a BC3 block: the largest and smallest alpha and sixteen
+// 3-bit indices into the eight steps between them
+inline void encode_alpha(const uint8_t rgba[64], uint8_t out[8])
+{
+  int low = 255, high = 0;
+  for (int i = 0; i < 16; i++)
+  {
+    low = std::min(low, (int)rgba[4 * i + 3]);
+    high = std::max(high, (int)rgba[4 * i + 3]);
+  }
+
+  uint64_t bits = 0;
+  if (high > low)
+  {
+    for (int i = 0; i < 16; i++)
+    {
+      // step 7 is high and 0 low; indices 0 and 1 are the endpoints and
+      // 2 to 7 run from high to low
+      const int step = (int)std::lround((rgba[4 * i + 3] - low) * 7.0f / (high - low));
+      const uint64_t index = step == 7 ? 0 : step == 0 ? 1 : 8 - step;
+      bits |= index << (3 * i);
+    }
+  }
+  out[0] = (uint8_t)high;
+  out[1] = (uint8_t)low;
+  for (int k = 0; k < 6; k++)
+    out[2 + k] = (uint8_t)(bits >> (8 * k));
+}
+
+inline void decode_color(const uint8_t in[8], uint8_t rgba[64])
+{
+  const uint16_t c0 = (uint16_t)(in[0] | in[1] << 8), c1 = (uint16_t)(in[2] | in[3] << 8);
+  uint32_t bits;
+  std::memcpy(&bits, in + 4, 4);
+  float colors[4][3];
+  palette(c0, c1, colors);
+  for (int i = 0; i < 16; i++)
+  {
+    const float *color = colors[(bits >> (2 * i)) & 3];
+    for (int c = 0; c < 3; c++)
+      rgba[4 * i + c] = (uint8_t)std::lround(color[c]);
+  }
+}
+
+inline void decode_alpha(const uint8_t in[8], uint8_t rgba[64])
+{
+  const int high = in[0], low = in[1];
+  uint64_t bits = 0;
+  for (int k = 0; k < 6; k++)
+    bits |= (uint64_t)in[2 + k] << (8 * k);
+  int steps[8] = {high, low};
+  for (int k = 2; k < 8; k++)
+  {
+    // a block written by encode_alpha never uses the six-step mode
+    steps[k] = high > low ? ((8 - k) * high + (k - 1) * low) / 7 : high;
+  }
+  for (int i = 0; i < 16; i++)
+    rgba[4 * i + 3] = (uint8_t)steps[(bits >> (3 * i)) & 7];
+}
+
+// the 4x4 block at block column bx and row by of a level as RGBA, repeating
+// the last row and column past the level's edge
+inline void fetch_block(const uint8_t *pixels, uint32_t width, uint32_t height, int channels, uint32_t bx,
+                        uint32_t by, uint8_t rgba[64])
+{
+  for (uint32_t y = 0; y < 4; y++)
+  {
+    const uint8_t *row = pixels + (size_t)std::min(by * 4 + y, height - 1) * width * channels;
+    for (uint32_t x = 0; x < 4; x++)
+    {
+      const uint8_t *texel = row + (size_t)std::min(bx * 4 + x, width - 1) * channels;
+      uint8_t *out = rgba + 4 * (4 * y + x);
+      out[0] = texel[0];
+      out[1] = channels >= 3 ? texel[1] : texel[0];
+      out[2] = channels >= 3 ? texel[2] : texel[0];
+      out[3] = channels == 4 ? texel[3] : channels == 2 ? texel[1] : 255;
+    }
+  }
+}
+
+// compress the block rows [first, last) of a level
+inline void encode_rows(const uint8_t *pixels, uint32_t width, uint32_t height, int channels, BlockFormat format,
+                        uint32_t first, uint32_t last, uint8_t *out)
+{
+  const uint32_t blocks_x = (width + 3) / 4;
+  const size_t bytes = block_bytes(format);
+  uint8_t rgba[64];
+  for (uint32_t by = first; by < last; by++)
+  {
+    for (uint32_t bx = 0; bx < blocks_x; bx++)
+    {
+      uint8_t *block = out + ((size_t)by * blocks_x + bx) * bytes;
+      fetch_block(pixels, width, height, channels, bx, by, rgba);
+      if (format == BlockFormat::Bc3)
+      {
+        encode_alpha(rgba, block);
+        encode_color(rgba, block + 8);
+      }
+      else
+      {
+        encode_color(rgba, block);
+      }
+    }
+  }
+}
+
+} // namespace bc
+
+// block rows below which a level is not worth another thread
+#define BC_MIN_ROWS_PER_THREAD 16
+
+// compress a width x height level of channels 8-bit channels into out,
+// level_bytes() long, splitting the block rows over num_threads threads (0
+// picks the hardware concurrency)
+inline void compress_level(const uint8_t *pixels, uint32_t width, uint32_t height, int channels,
+                           BlockFormat format, uint8_t *out, size_t num_threads = 0)
+{
+  if (num_threads == 0)
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  const uint32_t rows = (height + 3) / 4;
+  const size_t bands = std::max<size_t>(1, std::min<size_t>(num_threads, rows / BC_MIN_ROWS_PER_THREAD));
+
+  std::vector<std::thread> threads;
+  for (size_t b = 1; b < bands; b++)
+  {
+    const uint32_t first = (uint32_t)(rows * b / bands), last = (uint32_t)(rows * (b + 1) / bands);
+    threads.emplace_back(bc::encode_rows, pixels, width, height, channels, format, first, last, out);
+  }
+  bc::encode_rows(pixels, width, height, channels, format, 0, (uint32_t)(rows / bands), out);
+  for (auto &thread : threads)
+    thread.join();
+}
+
+// expand a compressed level back to 8-bit texels of channels channels
+inline void decompress_level(const uint8_t *blocks, uint32_t width, uint32_t height, BlockFormat format,
+                             int channels, uint8_t *out)
+{
+  const uint32_t blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+  const size_t bytes = block_bytes(format);
+  uint8_t rgba[64];
+  for (uint32_t by = 0; by < blocks_y; by++)
+  {
+    for (uint32_t bx = 0; bx < blocks_x; bx++)
+    {
+      const uint8_t *block = blocks + ((size_t)by * blocks_x + bx) * bytes;
+      std::fill(rgba, rgba + 64, 255);
+      if (format == BlockFormat::Bc3)
+      {
+        bc::decode_alpha(block, rgba);
+        bc::decode_color(block + 8, rgba);
+      }
+      else
+      {
+        bc::decode_color(block, rgba);
+      }
+
+      for (uint32_t y = 0; y < 4 && by * 4 + y < height; y++)
+      {
+        for (uint32_t x = 0; x < 4 && bx * 4 + x < width; x++)
+        {
+          const uint8_t *texel = rgba + 4 * (4 * y + x);
+          uint8_t *dst = out + ((size_t)(by * 4 + y) * width + bx * 4 + x) * channels;
+          for (int c = 0; c < std::min(channels, 3); c++)
+            dst[c] = texel[c];
+          if (channels == 4)
+            dst[3] = texel[3];
+        }
+      }
+    }
+  }
+}
+
+#endif // !BLOCK_COMPRESSION_H
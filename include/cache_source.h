@@ -0,0 +1,67 @@
+#ifndef CACHE_SOURCE_H
+#define CACHE_SOURCE_H
+
+#include <hash.h>
+#include <mapped_file.h>
+
+#include <sys/stat.h>
+
+#include <cstdint>
+#include <string>
+
+// The on-disk caches record the size, modification time and content hash
+// of the file they were built from, and only trust themselves while those
+// still match.
+
+// modification time in nanoseconds and size of a file, false if it is missing
+inline bool stat_source(const std::string &path, int64_t &mtime, uint64_t &size)
+{
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0)
+  {
+    return false;
+  }
+#ifdef __APPLE__
+  mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+  mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+  size = (uint64_t)st.st_size;
+  return true;
+}
+
+inline bool hash_source(const std::string &path, uint64_t &hash)
+{
+  MappedFile source;
+  if (!source.open(path))
+  {
+    return false;
+  }
+  hash = fnv1a64(source.data(), source.size());
+  return true;
+}
+
+// whether a cache built from a source of this size, mtime and hash is still
+// current; a touched but otherwise unchanged source still hits on its hash
+inline bool source_unchanged(const std::string &path, int64_t cached_mtime, uint64_t cached_size,
+                             uint64_t cached_hash)
+{
+  int64_t mtime;
+  uint64_t size;
+  if (!stat_source(path, mtime, size) || size != cached_size)
+  {
+    return false;
+  }
+
+  if (mtime != cached_mtime)
+  {
+    uint64_t hash;
+    if (!hash_source(path, hash) || hash != cached_hash)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+#endif // !CACHE_SOURCE_H
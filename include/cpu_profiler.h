@@ -0,0 +1,189 @@
+#ifndef CPU_PROFILER_H
+#define CPU_PROFILER_H
+
+// Scoped CPU zones exported as a Chrome trace, which chrome://tracing and
+// ui.perfetto.dev open. Build with TBD_PROFILE defined to record them;
+// otherwise every PROFILE_ macro expands to nothing.
+//
+//   PROFILE_ZONE("draws");              // until the end of the block
+//   PROFILE_BEGIN(swap, "swap");        // until PROFILE_END(swap)
+//   PROFILE_THREAD("main");             // name the calling thread
+//
+// Zone names must be string literals or otherwise outlive the program, as
+// only the pointer is stored. Each thread records finished zones into a ring
+// buffer of its own, so recording takes no lock; when a ring is full the
+// oldest zones are overwritten. Write the trace once the other threads are
+// idle, e.g. at exit.
+
+#ifdef TBD_PROFILE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// zones kept per thread, a power of two
+#define PROFILE_RING_SIZE (1 << 16)
+
+namespace cpu_profiler
+{
+
+struct Event
+{
+  const char *name;
+  uint64_t begin_ns, end_ns;
+};
+
+struct ThreadBuffer
+{
+  std::vector<Event> events = std::vector<Event>(PROFILE_RING_SIZE);
+  // zones recorded so far; only the owning thread writes it
+  std::atomic<uint64_t> head{0};
+  uint32_t id = 0;
+  const char *name = nullptr;
+};
+
+struct Registry
+{
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ThreadBuffer>> threads;
+  const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+};
+
+inline Registry &registry()
+{
+  static Registry instance;
+  return instance;
+}
+
+inline uint64_t now_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - registry().epoch)
+      .count();
+}
+
+// the calling thread's buffer, registered on first use; the registry owns it
+// so zones of threads that have exited are still exported
+inline ThreadBuffer &thread_buffer()
+{
+  thread_local ThreadBuffer *buffer = nullptr;
+  if (!buffer)
+  {
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.threads.emplace_back(new ThreadBuffer());
+    buffer = r.threads.back().get();
+    buffer->id = (uint32_t)r.threads.size();
+  }
+  return *buffer;
+}
+
+inline void record(const char *name, uint64_t begin_ns, uint64_t end_ns)
+{
+  ThreadBuffer &buffer = thread_buffer();
+  const uint64_t head = buffer.head.load(std::memory_order_relaxed);
+  buffer.events[head & (PROFILE_RING_SIZE - 1)] = Event{name, begin_ns, end_ns};
+  buffer.head.store(head + 1, std::memory_order_release);
+}
+
+inline void set_thread_name(const char *name)
+{
+  thread_buffer().name = name;
+}
+
+class Zone
+{
+public:
+  explicit Zone(const char *name) : name(name), begin_ns(now_ns())
+  {
+  }
+
+  Zone(const Zone &) = delete;
+  Zone &operator=(const Zone &) = delete;
+
+  ~Zone()
+  {
+    end();
+  }
+
+  void end()
+  {
+    if (name)
+      record(name, begin_ns, now_ns());
+    name = nullptr;
+  }
+
+private:
+  const char *name;
+  uint64_t begin_ns;
+};
+
+// every recorded zone as complete ("X") events, in microseconds
+inline bool write_chrome_trace(const std::string &path)
+{
+  FILE *out = fopen(path.c_str(), "w");
+  if (!out)
+  {
+    std::cout << "Failed to open " << path << std::endl;
+    return false;
+  }
+
+  Registry &r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  size_t written = 0, overwritten = 0;
+  fprintf(out, "{\"traceEvents\": [\n");
+  for (const std::unique_ptr<ThreadBuffer> &thread : r.threads)
+  {
+    fprintf(out, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"",
+            written ? ",\n" : "", thread->id);
+    if (thread->name)
+      fprintf(out, "%s\"}}", thread->name);
+    else
+      fprintf(out, "thread %u\"}}", thread->id);
+    written++;
+
+    const uint64_t head = thread->head.load(std::memory_order_acquire);
+    const uint64_t first = head > PROFILE_RING_SIZE ? head - PROFILE_RING_SIZE : 0;
+    overwritten += first;
+    for (uint64_t i = first; i < head; i++)
+    {
+      const Event &e = thread->events[i & (PROFILE_RING_SIZE - 1)];
+      fprintf(out, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}", e.name,
+              thread->id, e.begin_ns / 1e3, (e.end_ns - e.begin_ns) / 1e3);
+      written++;
+    }
+  }
+  fprintf(out, "\n]}\n");
+  fclose(out);
+
+  std::cout << "Wrote " << written - r.threads.size() << " zones of " << r.threads.size() << " threads to " << path;
+  if (overwritten)
+    std::cout << " (" << overwritten << " older zones overwritten)";
+  std::cout << std::endl;
+  return true;
+}
+
+} // namespace cpu_profiler
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) cpu_profiler::Zone PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#define PROFILE_BEGIN(id, name) cpu_profiler::Zone profile_zone_##id(name)
+#define PROFILE_END(id) profile_zone_##id.end()
+#define PROFILE_THREAD(name) cpu_profiler::set_thread_name(name)
+
+#else
+
+#define PROFILE_ZONE(name)
+#define PROFILE_BEGIN(id, name)
+#define PROFILE_END(id)
+#define PROFILE_THREAD(name)
+
+#endif // TBD_PROFILE
+
+#endif // !CPU_PROFILER_H
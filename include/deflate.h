@@ -0,0 +1,510 @@
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <queue>
+#include <vector>
+
+// Minimal deflate (RFC 1951) compressor for the screenshot writer: greedy
+// LZ77 over hash chains and dynamic Huffman blocks. Independent pieces of a
+// stream can be compressed in parallel with deflate_piece and concatenated,
+// since every piece but the last ends on a byte boundary with an empty
+// stored block, the same way pigz splits its input.
+
+namespace deflate
+{
+
+const int WINDOW_SIZE = 32768;
+const int MIN_MATCH = 3;
+const int MAX_MATCH = 258;
+const int HASH_BITS = 15;
+// candidates followed per position, and a match long enough to stop early
+const int MAX_CHAIN = 4;
+const int NICE_MATCH = 128;
+const int MAX_INSERT = 16;
+const size_t BLOCK_SYMBOLS = 32768;
+
+const int LITLEN_CODES = 286;
+const int DIST_CODES = 30;
+
+const uint16_t LENGTH_BASE[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                  31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const uint16_t DIST_BASE[30] = {1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,    97,    129,
+                                193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+const uint8_t DIST_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// order the code length code lengths are stored in
+const uint8_t CODE_LENGTH_ORDER[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+inline int length_code(int length)
+{
+  int code = 0;
+  while (code < 28 && LENGTH_BASE[code + 1] <= length)
+    code++;
+  return code;
+}
+
+inline int dist_code(int dist)
+{
+  int code = 0;
+  while (code < 29 && DIST_BASE[code + 1] <= dist)
+    code++;
+  return code;
+}
+
+// literal/length code and distance code for every length and small distance,
+// so the block writer does not search the base tables
+struct CodeTables
+{
+  uint8_t length[MAX_MATCH + 1];
+  uint8_t dist_small[512]; // dist - 1 < 512
+  uint8_t dist_large[256]; // (dist - 1) >> 7
+
+  CodeTables()
+  {
+    for (int l = MIN_MATCH; l <= MAX_MATCH; l++)
+      length[l] = (uint8_t)length_code(l);
+    for (int d = 1; d <= 512; d++)
+      dist_small[d - 1] = (uint8_t)dist_code(d);
+    for (int i = 0; i < 256; i++)
+      dist_large[i] = (uint8_t)dist_code((i << 7) + 1);
+  }
+
+  int dist(int d) const
+  {
+    return d <= 512 ? dist_small[d - 1] : dist_large[(d - 1) >> 7];
+  }
+};
+
+inline const CodeTables &code_tables()
+{
+  static const CodeTables tables;
+  return tables;
+}
+
+class BitWriter
+{
+public:
+  explicit BitWriter(std::vector<uint8_t> &out) : out(out)
+  {
+  }
+
+  // least significant bit first, as deflate packs everything but Huffman codes
+  void put(uint32_t value, int count)
+  {
+    bits |= (uint64_t)value << filled;
+    filled += count;
+    while (filled >= 8)
+    {
+      out.push_back((uint8_t)bits);
+      bits >>= 8;
+      filled -= 8;
+    }
+  }
+
+  void alignToByte()
+  {
+    if (filled > 0)
+      put(0, 8 - filled);
+  }
+
+private:
+  std::vector<uint8_t> &out;
+  uint64_t bits = 0;
+  int filled = 0;
+};
+
+// Huffman code lengths of at most limit bits for the given frequencies; when
+// the optimal tree is too deep the frequencies are flattened and it is rebuilt
+inline void huffman_lengths(const uint32_t *freq, int count, int limit, uint8_t *lengths)
+{
+  std::vector<uint32_t> f(freq, freq + count);
+  for (;;)
+  {
+    std::fill(lengths, lengths + count, 0);
+
+    // nodes 0..count-1 are the symbols, the rest are internal
+    std::vector<int> parent(2 * count, -1);
+    typedef std::pair<uint64_t, int> Node;
+    std::priority_queue<Node, std::vector<Node>, std::greater<Node>> heap;
+    for (int i = 0; i < count; i++)
+    {
+      if (f[i])
+        heap.push(Node(f[i], i));
+    }
+    if (heap.empty())
+      return;
+    if (heap.size() == 1)
+    {
+      lengths[heap.top().second] = 1;
+      return;
+    }
+
+    int next = count;
+    while (heap.size() > 1)
+    {
+      const Node a = heap.top();
+      heap.pop();
+      const Node b = heap.top();
+      heap.pop();
+      parent[a.second] = next;
+      parent[b.second] = next;
+      heap.push(Node(a.first + b.first, next++));
+    }
+
+    int deepest = 0;
+    for (int i = 0; i < count; i++)
+    {
+      if (!f[i])
+        continue;
+      int depth = 0;
+      for (int n = i; parent[n] != -1; n = parent[n])
+        depth++;
+      lengths[i] = (uint8_t)depth;
+      deepest = std::max(deepest, depth);
+    }
+    if (deepest <= limit)
+      return;
+
+    for (uint32_t &v : f)
+    {
+      if (v)
+        v = (v >> 1) | 1;
+    }
+  }
+}
+
+// canonical codes for the lengths, bit reversed for the LSB first writer
+inline void huffman_codes(const uint8_t *lengths, int count, uint16_t *codes)
+{
+  uint16_t length_count[16] = {0};
+  for (int i = 0; i < count; i++)
+    length_count[lengths[i]]++;
+  length_count[0] = 0;
+
+  uint16_t next_code[16] = {0};
+  uint16_t code = 0;
+  for (int bits = 1; bits < 16; bits++)
+  {
+    code = (uint16_t)((code + length_count[bits - 1]) << 1);
+    next_code[bits] = code;
+  }
+
+  for (int i = 0; i < count; i++)
+  {
+    const int len = lengths[i];
+    if (!len)
+      continue;
+    uint16_t c = next_code[len]++, reversed = 0;
+    for (int b = 0; b < len; b++)
+    {
+      reversed = (uint16_t)((reversed << 1) | (c & 1));
+      c >>= 1;
+    }
+    codes[i] = reversed;
+  }
+}
+
+// a literal when dist is 0, otherwise a match
+struct Symbol
+{
+  uint16_t litlen;
+  uint16_t dist;
+};
+
+inline void write_block(BitWriter &writer, const std::vector<Symbol> &symbols, bool final)
+{
+  const CodeTables &tables = code_tables();
+
+  uint32_t litlen_freq[LITLEN_CODES] = {0}, dist_freq[DIST_CODES] = {0};
+  for (const Symbol &s : symbols)
+  {
+    if (s.dist == 0)
+    {
+      litlen_freq[s.litlen]++;
+    }
+    else
+    {
+      litlen_freq[257 + tables.length[s.litlen]]++;
+      dist_freq[tables.dist(s.dist)]++;
+    }
+  }
+  litlen_freq[256] = 1;
+  // decoders want at least two codes in each tree
+  litlen_freq[0] += litlen_freq[0] ? 0 : 1;
+  dist_freq[0] += dist_freq[0] ? 0 : 1;
+  dist_freq[1] += dist_freq[1] ? 0 : 1;
+
+  uint8_t litlen_len[LITLEN_CODES], dist_len[DIST_CODES];
+  uint16_t litlen_code[LITLEN_CODES] = {0}, dist_code_bits[DIST_CODES] = {0};
+  huffman_lengths(litlen_freq, LITLEN_CODES, 15, litlen_len);
+  huffman_lengths(dist_freq, DIST_CODES, 15, dist_len);
+  huffman_codes(litlen_len, LITLEN_CODES, litlen_code);
+  huffman_codes(dist_len, DIST_CODES, dist_code_bits);
+
+  int hlit = LITLEN_CODES, hdist = DIST_CODES;
+  while (hlit > 257 && !litlen_len[hlit - 1])
+    hlit--;
+  while (hdist > 1 && !dist_len[hdist - 1])
+    hdist--;
+
+  // run length encode both length tables with codes 16 (repeat previous),
+  // 17 and 18 (runs of zeros)
+  std::vector<uint8_t> all(litlen_len, litlen_len + hlit);
+  all.insert(all.end(), dist_len, dist_len + hdist);
+  std::vector<std::pair<uint8_t, uint8_t>> runs; // code, extra bits value
+  for (size_t i = 0; i < all.size();)
+  {
+    size_t run = 1;
+    while (i + run < all.size() && all[i + run] == all[i])
+      run++;
+
+    if (all[i] == 0 && run >= 3)
+    {
+      run = std::min<size_t>(run, 138);
+      if (run >= 11)
+        runs.push_back(std::make_pair(18, (uint8_t)(run - 11)));
+      else
+        runs.push_back(std::make_pair(17, (uint8_t)(run - 3)));
+      i += run;
+    }
+    else if (all[i] != 0 && run >= 4)
+    {
+      runs.push_back(std::make_pair(all[i], 0));
+      const size_t repeat = std::min<size_t>(run - 1, 6);
+      runs.push_back(std::make_pair(16, (uint8_t)(repeat - 3)));
+      i += 1 + repeat;
+    }
+    else
+    {
+      runs.push_back(std::make_pair(all[i], 0));
+      i++;
+    }
+  }
+
+  uint32_t cl_freq[19] = {0};
+  for (const auto &r : runs)
+    cl_freq[r.first]++;
+  uint8_t cl_len[19];
+  uint16_t cl_code[19] = {0};
+  huffman_lengths(cl_freq, 19, 7, cl_len);
+  huffman_codes(cl_len, 19, cl_code);
+
+  int hclen = 19;
+  while (hclen > 4 && !cl_len[CODE_LENGTH_ORDER[hclen - 1]])
+    hclen--;
+
+  writer.put(final ? 1 : 0, 1);
+  writer.put(2, 2);
+  writer.put(hlit - 257, 5);
+  writer.put(hdist - 1, 5);
+  writer.put(hclen - 4, 4);
+  for (int i = 0; i < hclen; i++)
+    writer.put(cl_len[CODE_LENGTH_ORDER[i]], 3);
+  for (const auto &r : runs)
+  {
+    writer.put(cl_code[r.first], cl_len[r.first]);
+    if (r.first == 16)
+      writer.put(r.second, 2);
+    else if (r.first == 17)
+      writer.put(r.second, 3);
+    else if (r.first == 18)
+      writer.put(r.second, 7);
+  }
+
+  for (const Symbol &s : symbols)
+  {
+    if (s.dist == 0)
+    {
+      writer.put(litlen_code[s.litlen], litlen_len[s.litlen]);
+      continue;
+    }
+    const int lc = tables.length[s.litlen];
+    writer.put(litlen_code[257 + lc], litlen_len[257 + lc]);
+    writer.put(s.litlen - LENGTH_BASE[lc], LENGTH_EXTRA[lc]);
+    const int dc = tables.dist(s.dist);
+    writer.put(dist_code_bits[dc], dist_len[dc]);
+    writer.put(s.dist - DIST_BASE[dc], DIST_EXTRA[dc]);
+  }
+  writer.put(litlen_code[256], litlen_len[256]);
+}
+
+// number of equal leading bytes, eight at a time
+inline int match_length(const uint8_t *a, const uint8_t *b, int max_len)
+{
+  int len = 0;
+  while (len + 8 <= max_len)
+  {
+    uint64_t x, y;
+    std::memcpy(&x, a + len, 8);
+    std::memcpy(&y, b + len, 8);
+    if (x != y)
+    {
+      // first differing byte, assuming little endian
+      uint64_t diff = x ^ y;
+      while (!(diff & 0xff))
+      {
+        diff >>= 8;
+        len++;
+      }
+      return len;
+    }
+    len += 8;
+  }
+  while (len < max_len && a[len] == b[len])
+    len++;
+  return len;
+}
+
+// compress data as a self-contained piece of a deflate stream and append it
+// to out; only the last piece of a stream is final
+inline void deflate_piece(const uint8_t *data, size_t size, bool final, std::vector<uint8_t> &out)
+{
+  out.reserve(out.size() + size / 2);
+  BitWriter writer(out);
+  std::vector<Symbol> symbols;
+  symbols.reserve(BLOCK_SYMBOLS);
+
+  std::vector<int32_t> head(1 << HASH_BITS, -1);
+  std::vector<int32_t> prev(WINDOW_SIZE, -1);
+  auto hash = [data](size_t i) {
+    const uint32_t v = data[i] | (data[i + 1] << 8) | (data[i + 2] << 16);
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+  };
+  auto insert = [&](size_t i) {
+    const uint32_t h = hash(i);
+    prev[i & (WINDOW_SIZE - 1)] = head[h];
+    head[h] = (int32_t)i;
+  };
+
+  size_t i = 0;
+  while (i < size)
+  {
+    int best_len = 0, best_dist = 0;
+    if (i + MIN_MATCH <= size)
+    {
+      const int max_len = (int)std::min<size_t>(MAX_MATCH, size - i);
+      int32_t candidate = head[hash(i)];
+      for (int chain = 0; chain < MAX_CHAIN && candidate >= 0 && i - candidate <= WINDOW_SIZE; chain++)
+      {
+        const uint8_t *a = data + i, *b = data + candidate;
+        if (b[best_len] == a[best_len] && b[0] == a[0])
+        {
+          const int len = match_length(a, b, max_len);
+          if (len > best_len)
+          {
+            best_len = len;
+            best_dist = (int)(i - candidate);
+            if (len >= NICE_MATCH || len == max_len)
+              break;
+          }
+        }
+        const int32_t next = prev[candidate & (WINDOW_SIZE - 1)];
+        if (next >= candidate)
+          break;
+        candidate = next;
+      }
+      insert(i);
+    }
+
+    if (best_len >= MIN_MATCH)
+    {
+      symbols.push_back(Symbol{(uint16_t)best_len, (uint16_t)best_dist});
+      // like zlib's fast levels, long matches are not indexed inside
+      if (best_len <= MAX_INSERT)
+      {
+        for (size_t j = i + 1; j < i + best_len && j + MIN_MATCH <= size; j++)
+          insert(j);
+      }
+      i += best_len;
+    }
+    else
+    {
+      symbols.push_back(Symbol{data[i], 0});
+      i++;
+    }
+
+    if (symbols.size() == BLOCK_SYMBOLS && i < size)
+    {
+      write_block(writer, symbols, false);
+      symbols.clear();
+    }
+  }
+  write_block(writer, symbols, final);
+
+  if (!final)
+  {
+    // empty stored block, which leaves the piece byte aligned
+    writer.put(0, 3);
+    writer.alignToByte();
+    writer.put(0x0000, 16);
+    writer.put(0xffff, 16);
+  }
+  writer.alignToByte();
+}
+
+inline uint32_t adler32(const uint8_t *data, size_t size, uint32_t adler = 1)
+{
+  uint32_t a = adler & 0xffff, b = adler >> 16;
+  while (size > 0)
+  {
+    // the sums cannot overflow within 5552 bytes
+    const size_t n = std::min<size_t>(size, 5552);
+    for (size_t i = 0; i < n; i++)
+    {
+      a += data[i];
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+    data += n;
+    size -= n;
+  }
+  return (b << 16) | a;
+}
+
+// adler32 of two concatenated pieces from the checksums of each
+inline uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, size_t size2)
+{
+  const uint32_t base = 65521;
+  const uint32_t rem = (uint32_t)(size2 % base);
+  uint32_t sum1 = adler1 & 0xffff;
+  uint32_t sum2 = (uint32_t)(((uint64_t)rem * sum1) % base);
+  sum1 += (adler2 & 0xffff) + base - 1;
+  sum2 += (adler1 >> 16) + (adler2 >> 16) + base - rem;
+  sum1 %= base;
+  sum2 %= base;
+  return (sum2 << 16) | sum1;
+}
+
+inline uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc = 0)
+{
+  struct Table
+  {
+    uint32_t entries[256];
+    Table()
+    {
+      for (uint32_t n = 0; n < 256; n++)
+      {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++)
+          c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        entries[n] = c;
+      }
+    }
+  };
+  static const Table table;
+
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++)
+    crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+} // namespace deflate
+
+#endif // !DEFLATE_H
@@ -0,0 +1,121 @@
+#ifndef DISCO_LIGHTS_H
+#define DISCO_LIGHTS_H
+
+#include <light_clusters.h>
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+// The scene's rotating spot lights. The first three are the original red,
+// green and blue lights hanging above the bucket; any further ones are
+// smaller, shorter ranged spots scattered over the floor.
+
+struct DiscoLight
+{
+  SpotLight light;
+  glm::vec3 ambient;
+
+  // the direction sweeps a circle of the given radius below the light
+  float dir_x, dir_y, dir_z;
+  float theta, radius, speed;
+};
+
+inline std::vector<DiscoLight> make_disco_lights(size_t count)
+{
+  std::vector<DiscoLight> lights(count);
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+  const glm::vec3 colors[3] = {glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+                               glm::vec3(0.0f, 0.0f, 1.0f)};
+  const float dirs[3][2] = {{50.0f, -50.0f}, {-50.0f, -50.0f}, {0.0f, 50.0f}};
+
+  for (size_t i = 0; i < count; i++)
+  {
+    DiscoLight &d = lights[i];
+    SpotLight &l = d.light;
+    l = SpotLight();
+
+    if (i < 3)
+    {
+      l.position = glm::vec3(0.0f, 200.0f, 0.0f);
+      l.cutOff = std::cos(glm::radians(30.0f));
+      l.diffuse = colors[i];
+      l.constant = 1.0f;
+      l.linear = 0.35e-4f;
+      l.quadratic = 0.44e-4f;
+      d.ambient = glm::vec3(0.2f);
+      d.dir_x = dirs[i][0];
+      d.dir_y = -200.0f;
+      d.dir_z = dirs[i][1];
+      d.speed = 0.05f;
+    }
+    else
+    {
+      l.position = glm::vec3(unit(rng) * 500.0f - 250.0f, 60.0f + unit(rng) * 60.0f, unit(rng) * 500.0f - 250.0f);
+      l.cutOff = std::cos(glm::radians(12.0f + unit(rng) * 18.0f));
+
+      // saturated color of a random hue
+      const float h = unit(rng) * 6.0f;
+      const float f = h - std::floor(h);
+      const glm::vec3 hues[6] = {glm::vec3(1, f, 0), glm::vec3(1 - f, 1, 0), glm::vec3(0, 1, f),
+                                 glm::vec3(0, 1 - f, 1), glm::vec3(f, 0, 1), glm::vec3(1, 0, 1 - f)};
+      l.diffuse = hues[(int)h % 6] * 4.0f;
+      l.constant = 1.0f;
+      l.linear = 0.022f;
+      l.quadratic = 0.0019f;
+      d.ambient = glm::vec3(0.0f);
+
+      const float angle = unit(rng) * 6.2831853f;
+      const float sweep = 10.0f + unit(rng) * 40.0f;
+      d.dir_x = sweep * std::cos(angle);
+      d.dir_y = -100.0f;
+      d.dir_z = sweep * std::sin(angle);
+      d.speed = 0.01f + unit(rng) * 0.06f;
+
+      // an explicit radius the shader fades the light out towards, rather
+      // than the far reach of its inverse square falloff
+      l.range = 200.0f + unit(rng) * 100.0f;
+    }
+
+    d.theta = std::atan2(d.dir_z, d.dir_x);
+    d.radius = std::sqrt(d.dir_x * d.dir_x + d.dir_z * d.dir_z);
+    l.direction = glm::normalize(glm::vec3(d.dir_x, d.dir_y, d.dir_z));
+    if (i < 3) // the original lights reach as far as they are visible
+      l.range = light_range(l.diffuse, l.constant, l.linear, l.quadratic);
+  }
+
+  return lights;
+}
+
+// write this frame's lights to out and advance the sweep
+inline void animate_disco_lights(std::vector<DiscoLight> &lights, std::vector<SpotLight> &out)
+{
+  out.resize(lights.size());
+  for (size_t i = 0; i < lights.size(); i++)
+  {
+    DiscoLight &d = lights[i];
+    d.light.direction = glm::normalize(glm::vec3(d.dir_x, d.dir_y, d.dir_z));
+    out[i] = d.light;
+
+    d.theta += d.speed;
+    d.dir_x = d.radius * std::cos(d.theta);
+    d.dir_z = -d.radius * std::sin(d.theta);
+  }
+}
+
+// ambient does not depend on the light's cone, so it is summed once instead
+// of being added by every light in the shader
+inline glm::vec3 total_ambient(const std::vector<DiscoLight> &lights)
+{
+  glm::vec3 ambient(0.0f);
+  for (const DiscoLight &d : lights)
+    ambient += d.ambient;
+  return ambient;
+}
+
+#endif // !DISCO_LIGHTS_H
@@ -0,0 +1,172 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <image_writer.h>
+#include <readback.h>
+#include <thread_pool.h>
+#include <video_recorder.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Screen captures and recordings that never stall the render loop. Frames
+// are read back through a ReadbackRing; once a read has finished, usually
+// one or two frames later, the pixels are copied out of the mapped buffer
+// and everything else happens on background threads. When every buffer is
+// still in flight, or the background work has fallen behind, the frame is
+// dropped instead of waited for.
+
+#define CAPTURE_RING_SIZE 3
+#define RECORD_RING_SIZE 4
+
+// single screenshots, encoded in the selected ImageFormat and written by a
+// background thread
+class FrameCapture
+{
+public:
+  explicit FrameCapture(ImageFormat format = ImageFormat::Ppm, std::string prefix = "tmp")
+      : format(format), prefix(std::move(prefix))
+  {
+    // png bands are deflated in parallel, on threads of their own so the
+    // writer can wait for them
+    if (format == ImageFormat::Png)
+      encoders.reset(new ThreadPool());
+  }
+
+  // start reading back the current read framebuffer; call after the frame's
+  // draws and before swapping. Returns false if the capture was dropped.
+  bool request(uint32_t width, uint32_t height)
+  {
+    if (!ring.request(width, height, next_id))
+    {
+      dropped++;
+      std::cout << "Capture dropped, " << CAPTURE_RING_SIZE << " captures still in flight" << std::endl;
+      return false;
+    }
+    next_id++;
+    return true;
+  }
+
+  // hand every finished read back to the writer; call once per frame
+  void poll()
+  {
+    ring.poll([this](uint64_t id, uint32_t width, uint32_t height, const uint8_t *rgba) {
+      write(id, width, height, rgba);
+    });
+  }
+
+  // wait for the reads still in flight, e.g. before shutting down; the writes
+  // are finished when the FrameCapture is destroyed
+  void flush()
+  {
+    ring.flush([this](uint64_t id, uint32_t width, uint32_t height, const uint8_t *rgba) {
+      write(id, width, height, rgba);
+    });
+  }
+
+  size_t getDropped() const
+  {
+    return dropped;
+  }
+
+  size_t getWritten() const
+  {
+    return written;
+  }
+
+private:
+  ImageFormat format;
+  std::string prefix;
+  ReadbackRing ring{CAPTURE_RING_SIZE};
+  uint64_t next_id = 0;
+  size_t dropped = 0;
+  std::atomic<size_t> written{0};
+
+  // declared last so it finishes the queued writes before anything else is
+  // destroyed
+  std::unique_ptr<ThreadPool> encoders;
+  ThreadPool writer{1};
+
+  void write(uint64_t id, uint32_t width, uint32_t height, const uint8_t *rgba)
+  {
+    // rgba, bottom row first
+    auto frame = std::make_shared<std::vector<uint8_t>>(rgba, rgba + (size_t)width * height * 4);
+    const std::string name = prefix + std::to_string(id) + image_format_extension(format);
+    const std::string path = (std::filesystem::current_path() / name).string();
+    writer.submit([this, frame, path, width, height] {
+      if (write_image(path, format, frame->data(), width, height, encoders.get()))
+        written++;
+      else
+        std::cout << "Failed to write " << path << std::endl;
+    });
+  }
+};
+
+// every frame, streamed through a VideoRecorder
+class FrameRecorder
+{
+public:
+  // see VideoRecorder::open
+  bool open(const std::string &target, bool pipe, uint32_t width, uint32_t height, int fps)
+  {
+    return video.open(target, pipe, width, height, fps);
+  }
+
+  bool isOpen() const
+  {
+    return video.isOpen();
+  }
+
+  // start reading back the current frame unless the recorder or the ring is
+  // still busy; call after the frame's draws and before swapping
+  void request(uint32_t width, uint32_t height)
+  {
+    if (!video.canAccept())
+      video.drop();
+    else if (!ring.request(width, height, next_id++))
+      dropped_readback++;
+  }
+
+  // queue every finished read back for conversion; call once per frame
+  void poll()
+  {
+    ring.poll([this](uint64_t, uint32_t width, uint32_t height, const uint8_t *rgba) {
+      video.submit(rgba, width, height);
+    });
+  }
+
+  // queue the reads still in flight and finish writing the recording
+  void finish()
+  {
+    ring.flush([this](uint64_t, uint32_t width, uint32_t height, const uint8_t *rgba) {
+      video.submit(rgba, width, height);
+    });
+    video.close();
+  }
+
+  const VideoRecorder &getVideo() const
+  {
+    return video;
+  }
+
+  // frames skipped because every read back buffer was still in flight
+  size_t getDroppedReadback() const
+  {
+    return dropped_readback;
+  }
+
+private:
+  ReadbackRing ring{RECORD_RING_SIZE};
+  VideoRecorder video;
+  uint64_t next_id = 0;
+  size_t dropped_readback = 0;
+};
+
+#endif // !FRAME_CAPTURE_H
@@ -0,0 +1,288 @@
+#ifndef FRUSTUM_CULLING_H
+#define FRUSTUM_CULLING_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// define FRUSTUM_CULLING_NO_SIMD to build the scalar box tests instead
+#if (defined(__SSE2__) || defined(_M_X64)) && !defined(FRUSTUM_CULLING_NO_SIMD)
+#include <emmintrin.h>
+#define FRUSTUM_CULLING_SSE2 1
+#ifdef __AVX__
+#include <immintrin.h>
+#define FRUSTUM_CULLING_AVX 1
+#endif
+#endif
+
+// View frustum culling on the CPU. Meshes get an AABB and a bounding sphere
+// at load time; the spheres cull single objects and an InstanceCuller keeps
+// the world space AABBs of a crowd's instances as structure of arrays and
+// tests four of them at a time against the six frustum planes with SSE2, or
+// eight with AVX when the compiler targets it (-mavx). The result is the
+// compacted list of visible instances for the instanced draw.
+
+// local space bounds of a mesh
+struct Bounds
+{
+  glm::vec3 min = glm::vec3(INFINITY), max = glm::vec3(-INFINITY);
+  // sphere around the box center, not the smallest one
+  glm::vec3 center = glm::vec3(0.0f);
+  float radius = 0.0f;
+};
+
+// bounds of count positions, stride floats apart, e.g. Obj::getVertices()
+// with a stride of 3 or Mesh::getVertices() with sizeof(Vertex) / 4
+inline Bounds compute_bounds(const float *positions, size_t stride, size_t count)
+{
+  Bounds b;
+  for (size_t i = 0; i < count; i++)
+  {
+    const glm::vec3 p(positions[i * stride], positions[i * stride + 1], positions[i * stride + 2]);
+    b.min = glm::min(b.min, p);
+    b.max = glm::max(b.max, p);
+  }
+  if (count == 0)
+    b.min = b.max = glm::vec3(0.0f);
+
+  b.center = (b.min + b.max) * 0.5f;
+  float radius_sq = 0.0f;
+  for (size_t i = 0; i < count; i++)
+  {
+    const glm::vec3 p(positions[i * stride], positions[i * stride + 1], positions[i * stride + 2]);
+    const glm::vec3 d = p - b.center;
+    radius_sq = std::max(radius_sq, glm::dot(d, d));
+  }
+  b.radius = std::sqrt(radius_sq);
+  return b;
+}
+
+// bounds enclosing both, for meshes that share their instances
+inline Bounds merge_bounds(const Bounds &a, const Bounds &b)
+{
+  Bounds m;
+  m.min = glm::min(a.min, b.min);
+  m.max = glm::max(a.max, b.max);
+  m.center = (m.min + m.max) * 0.5f;
+  m.radius = std::max(glm::length(a.center - m.center) + a.radius, glm::length(b.center - m.center) + b.radius);
+  return m;
+}
+
+// the six clip planes of proj * view in world space, normals pointing inward
+// and scaled to unit length so plane distances are in world units
+struct Frustum
+{
+  glm::vec4 planes[6];
+
+  static Frustum fromMatrix(const glm::mat4 &view_proj)
+  {
+    // rows of the matrix; glm stores columns
+    glm::vec4 row[4];
+    for (int r = 0; r < 4; r++)
+      row[r] = glm::vec4(view_proj[0][r], view_proj[1][r], view_proj[2][r], view_proj[3][r]);
+
+    Frustum f;
+    f.planes[0] = row[3] + row[0]; // left
+    f.planes[1] = row[3] - row[0]; // right
+    f.planes[2] = row[3] + row[1]; // bottom
+    f.planes[3] = row[3] - row[1]; // top
+    f.planes[4] = row[3] + row[2]; // near
+    f.planes[5] = row[3] - row[2]; // far
+    for (glm::vec4 &p : f.planes)
+      p /= glm::length(glm::vec3(p));
+    return f;
+  }
+
+  // sphere of bounds moved by model; the radius grows with the largest scale
+  bool intersects(const Bounds &bounds, const glm::mat4 &model = glm::mat4(1.0f)) const
+  {
+    const glm::vec3 center = glm::vec3(model * glm::vec4(bounds.center, 1.0f));
+    const float scale = std::sqrt(std::max(glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+                                           std::max(glm::dot(glm::vec3(model[1]), glm::vec3(model[1])),
+                                                    glm::dot(glm::vec3(model[2]), glm::vec3(model[2])))));
+    for (const glm::vec4 &p : planes)
+    {
+      if (glm::dot(glm::vec3(p), center) + p.w < -bounds.radius * scale)
+        return false;
+    }
+    return true;
+  }
+};
+
+class InstanceCuller
+{
+public:
+  // world space boxes of count instances with the given model matrices,
+  // all sharing the local bounds
+  void setInstances(const glm::mat4 *models, size_t model_stride, size_t count, const Bounds &local)
+  {
+    for (auto *v : {&center_x, &center_y, &center_z, &extent_x, &extent_y, &extent_z})
+      v->resize(count);
+
+    const glm::vec3 local_center = (local.min + local.max) * 0.5f;
+    const glm::vec3 local_extent = (local.max - local.min) * 0.5f;
+    const char *base = reinterpret_cast<const char *>(models);
+    for (size_t i = 0; i < count; i++)
+    {
+      const glm::mat4 &m = *reinterpret_cast<const glm::mat4 *>(base + i * model_stride);
+      const glm::vec3 c = glm::vec3(m * glm::vec4(local_center, 1.0f));
+      // the box around the transformed box: each axis gathers the absolute
+      // contributions of the three local extents
+      const glm::vec3 e = glm::abs(glm::vec3(m[0])) * local_extent.x + glm::abs(glm::vec3(m[1])) * local_extent.y +
+                          glm::abs(glm::vec3(m[2])) * local_extent.z;
+      center_x[i] = c.x;
+      center_y[i] = c.y;
+      center_z[i] = c.z;
+      extent_x[i] = e.x;
+      extent_y[i] = e.y;
+      extent_z[i] = e.z;
+    }
+  }
+
+  size_t getCount() const
+  {
+    return center_x.size();
+  }
+
+  // write the indices of the instances whose box touches the frustum to
+  // visible, in order; visible must have room for getCount() of them.
+  // Returns how many were written.
+  size_t cull(const Frustum &frustum, uint32_t *visible) const
+  {
+    const size_t count = getCount();
+    const Planes planes(frustum);
+    uint32_t *out = visible;
+    size_t i = 0;
+
+#ifdef FRUSTUM_CULLING_AVX
+    __m256 pn[6][4], pa[6][3];
+    for (int p = 0; p < 6; p++)
+    {
+      pn[p][0] = _mm256_set1_ps(planes.nx[p]), pn[p][1] = _mm256_set1_ps(planes.ny[p]);
+      pn[p][2] = _mm256_set1_ps(planes.nz[p]), pn[p][3] = _mm256_set1_ps(planes.nw[p]);
+      pa[p][0] = _mm256_set1_ps(planes.ax[p]), pa[p][1] = _mm256_set1_ps(planes.ay[p]);
+      pa[p][2] = _mm256_set1_ps(planes.az[p]);
+    }
+    for (; i + 8 <= count; i += 8)
+    {
+      const __m256 cx = _mm256_loadu_ps(&center_x[i]), cy = _mm256_loadu_ps(&center_y[i]);
+      const __m256 cz = _mm256_loadu_ps(&center_z[i]), ex = _mm256_loadu_ps(&extent_x[i]);
+      const __m256 ey = _mm256_loadu_ps(&extent_y[i]), ez = _mm256_loadu_ps(&extent_z[i]);
+      __m256 outside = _mm256_setzero_ps();
+      for (int p = 0; p < 6; p++)
+      {
+        const __m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, pn[p][0]), _mm256_mul_ps(cy, pn[p][1])),
+                                          _mm256_add_ps(_mm256_mul_ps(cz, pn[p][2]), pn[p][3]));
+        const __m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ex, pa[p][0]), _mm256_mul_ps(ey, pa[p][1])),
+                                            _mm256_mul_ps(ez, pa[p][2]));
+        outside =
+            _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(dist, radius), _mm256_setzero_ps(), _CMP_LT_OQ));
+      }
+      out = compact<8>(~_mm256_movemask_ps(outside) & 0xff, i, out);
+    }
+#endif
+#ifdef FRUSTUM_CULLING_SSE2
+    __m128 qn[6][4], qa[6][3];
+    for (int p = 0; p < 6; p++)
+    {
+      qn[p][0] = _mm_set1_ps(planes.nx[p]), qn[p][1] = _mm_set1_ps(planes.ny[p]);
+      qn[p][2] = _mm_set1_ps(planes.nz[p]), qn[p][3] = _mm_set1_ps(planes.nw[p]);
+      qa[p][0] = _mm_set1_ps(planes.ax[p]), qa[p][1] = _mm_set1_ps(planes.ay[p]);
+      qa[p][2] = _mm_set1_ps(planes.az[p]);
+    }
+    for (; i + 4 <= count; i += 4)
+    {
+      const __m128 cx = _mm_loadu_ps(&center_x[i]), cy = _mm_loadu_ps(&center_y[i]);
+      const __m128 cz = _mm_loadu_ps(&center_z[i]), ex = _mm_loadu_ps(&extent_x[i]);
+      const __m128 ey = _mm_loadu_ps(&extent_y[i]), ez = _mm_loadu_ps(&extent_z[i]);
+      __m128 outside = _mm_setzero_ps();
+      for (int p = 0; p < 6; p++)
+      {
+        const __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, qn[p][0]), _mm_mul_ps(cy, qn[p][1])),
+                                       _mm_add_ps(_mm_mul_ps(cz, qn[p][2]), qn[p][3]));
+        const __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, qa[p][0]), _mm_mul_ps(ey, qa[p][1])),
+                                         _mm_mul_ps(ez, qa[p][2]));
+        outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(dist, radius), _mm_setzero_ps()));
+      }
+      out = compact<4>(~_mm_movemask_ps(outside) & 0xf, i, out);
+    }
+#endif
+    for (; i < count; i++)
+    {
+      if (boxVisible(i, planes))
+        *out++ = (uint32_t)i;
+    }
+    return out - visible;
+  }
+
+  // one box at a time, for comparison with cull
+  size_t cullScalar(const Frustum &frustum, uint32_t *visible) const
+  {
+    const Planes planes(frustum);
+    uint32_t *out = visible;
+    for (size_t i = 0; i < getCount(); i++)
+    {
+      if (boxVisible(i, planes))
+        *out++ = (uint32_t)i;
+    }
+    return out - visible;
+  }
+
+private:
+  // world space boxes, structure of arrays
+  std::vector<float> center_x, center_y, center_z, extent_x, extent_y, extent_z;
+
+  // append first + k for every set bit k of mask without branching on the
+  // bits: every candidate is stored and the cursor only moves past the
+  // visible ones
+  template <int Width>
+  static uint32_t *compact(int mask, size_t first, uint32_t *out)
+  {
+    for (int k = 0; k < Width; k++)
+    {
+      *out = (uint32_t)(first + k);
+      out += (mask >> k) & 1;
+    }
+    return out;
+  }
+
+  // plane normals with their absolute values, for the box's projected radius
+  struct Planes
+  {
+    float nx[6], ny[6], nz[6], nw[6], ax[6], ay[6], az[6];
+
+    explicit Planes(const Frustum &frustum)
+    {
+      for (int p = 0; p < 6; p++)
+      {
+        nx[p] = frustum.planes[p].x;
+        ny[p] = frustum.planes[p].y;
+        nz[p] = frustum.planes[p].z;
+        nw[p] = frustum.planes[p].w;
+        ax[p] = std::abs(nx[p]);
+        ay[p] = std::abs(ny[p]);
+        az[p] = std::abs(nz[p]);
+      }
+    }
+  };
+
+  // the box is outside when it lies entirely behind one of the planes
+  bool boxVisible(size_t i, const Planes &planes) const
+  {
+    for (int p = 0; p < 6; p++)
+    {
+      const float dist =
+          center_x[i] * planes.nx[p] + center_y[i] * planes.ny[p] + center_z[i] * planes.nz[p] + planes.nw[p];
+      const float radius = extent_x[i] * planes.ax[p] + extent_y[i] * planes.ay[p] + extent_z[i] * planes.az[p];
+      if (dist + radius < 0.0f)
+        return false;
+    }
+    return true;
+  }
+};
+
+#endif // !FRUSTUM_CULLING_H
@@ -0,0 +1,281 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstring>
+#include <unordered_map>
+
+// Filter for redundant GL binds. GlState remembers the program, vertex array,
+// generic buffer bindings, textures per unit and enabled capabilities it has
+// set, and drops calls that would set them to what they already are. It only
+// knows what went through it: code that changes the same state with plain GL
+// calls has to invalidate() it afterwards. Every call is counted as issued or
+// elided, so the render loop can report how many it saved per frame.
+//
+// The element array buffer is vertex array state and indexed bindings are not
+// tracked, so those calls always go through; they do update the cached
+// generic binding where GL does.
+
+// texture units whose bindings are tracked; binds on units past them always
+// go through
+#define GL_STATE_TEXTURE_UNITS 16
+
+class GlState
+{
+public:
+  GlState()
+  {
+    invalidate();
+  }
+
+  GlState(const GlState &) = delete;
+  GlState &operator=(const GlState &) = delete;
+
+  void useProgram(GLuint program)
+  {
+    if (!changes(current_program, program))
+      return;
+    glUseProgram(program);
+  }
+
+  void bindVertexArray(GLuint vao)
+  {
+    if (!changes(current_vao, vao))
+      return;
+    glBindVertexArray(vao);
+  }
+
+  void bindBuffer(GLenum target, GLuint buffer)
+  {
+    GLuint *binding = bufferBinding(target);
+    if (binding && !changes(*binding, buffer))
+      return;
+    if (!binding)
+      issued++;
+    glBindBuffer(target, buffer);
+  }
+
+  // also sets the generic binding of target
+  void bindBufferBase(GLenum target, GLuint index, GLuint buffer)
+  {
+    if (GLuint *binding = bufferBinding(target))
+      *binding = buffer;
+    issued++;
+    glBindBufferBase(target, index, buffer);
+  }
+
+  // unit is GL_TEXTURE0 + n, as for glActiveTexture
+  void activeTexture(GLenum unit)
+  {
+    if (!changes(active_unit, unit))
+      return;
+    glActiveTexture(unit);
+  }
+
+  // bind texture to target of the active unit
+  void bindTexture(GLenum target, GLuint texture)
+  {
+    GLuint *binding = textureBinding(target);
+    if (binding && !changes(*binding, texture))
+      return;
+    if (!binding)
+      issued++;
+    glBindTexture(target, texture);
+  }
+
+  void enable(GLenum cap)
+  {
+    setCapability(cap, true);
+  }
+
+  void disable(GLenum cap)
+  {
+    setCapability(cap, false);
+  }
+
+  // deleting an object unbinds it wherever the cache has it bound; a deleted
+  // program stays in use until another is, so that binding is forgotten
+  void deleteProgram(GLuint program)
+  {
+    if (program == current_program)
+      current_program = unknown;
+    glDeleteProgram(program);
+  }
+
+  void deleteVertexArrays(GLsizei n, const GLuint *vaos)
+  {
+    for (GLsizei i = 0; i < n; i++)
+    {
+      if (vaos[i] != 0 && vaos[i] == current_vao)
+        current_vao = 0;
+    }
+    glDeleteVertexArrays(n, vaos);
+  }
+
+  void deleteBuffers(GLsizei n, const GLuint *buffers)
+  {
+    for (GLsizei i = 0; i < n; i++)
+    {
+      for (GLuint &binding : buffer_bindings)
+      {
+        if (buffers[i] != 0 && binding == buffers[i])
+          binding = 0;
+      }
+    }
+    glDeleteBuffers(n, buffers);
+  }
+
+  void deleteTextures(GLsizei n, const GLuint *textures)
+  {
+    for (GLsizei i = 0; i < n; i++)
+    {
+      for (TextureUnit &unit : texture_units)
+      {
+        if (textures[i] != 0 && unit.texture_2d == textures[i])
+          unit.texture_2d = 0;
+        if (textures[i] != 0 && unit.texture_buffer == textures[i])
+          unit.texture_buffer = 0;
+      }
+    }
+    glDeleteTextures(n, textures);
+  }
+
+  // forget everything, so that the next call of each kind goes through; due
+  // after state was changed behind the cache's back
+  void invalidate()
+  {
+    current_program = unknown;
+    current_vao = unknown;
+    active_unit = unknown;
+    for (GLuint &binding : buffer_bindings)
+      binding = unknown;
+    for (TextureUnit &unit : texture_units)
+      unit.texture_2d = unit.texture_buffer = unknown;
+    capabilities.clear();
+  }
+
+  // calls passed on to GL and dropped since the last resetCounters()
+  size_t getIssued() const
+  {
+    return issued;
+  }
+
+  size_t getElided() const
+  {
+    return elided;
+  }
+
+  void resetCounters()
+  {
+    issued = 0;
+    elided = 0;
+  }
+
+private:
+  // no name GL hands out, so the first call after invalidate() goes through
+  static const GLuint unknown = ~0u;
+
+  struct TextureUnit
+  {
+    GLuint texture_2d;
+    GLuint texture_buffer;
+  };
+
+  GLuint current_program;
+  GLuint current_vao;
+  GLenum active_unit;
+  // array, uniform, texture, pixel pack and pixel unpack buffers
+  GLuint buffer_bindings[5];
+  TextureUnit texture_units[GL_STATE_TEXTURE_UNITS];
+  std::unordered_map<GLenum, bool> capabilities;
+  size_t issued = 0;
+  size_t elided = 0;
+
+  // count the call and store value; false when it is already set
+  bool changes(GLuint &cached, GLuint value)
+  {
+    if (cached == value)
+    {
+      elided++;
+      return false;
+    }
+    cached = value;
+    issued++;
+    return true;
+  }
+
+  GLuint *bufferBinding(GLenum target)
+  {
+    switch (target)
+    {
+    case GL_ARRAY_BUFFER:
+      return &buffer_bindings[0];
+    case GL_UNIFORM_BUFFER:
+      return &buffer_bindings[1];
+    case GL_TEXTURE_BUFFER:
+      return &buffer_bindings[2];
+    case GL_PIXEL_PACK_BUFFER:
+      return &buffer_bindings[3];
+    case GL_PIXEL_UNPACK_BUFFER:
+      return &buffer_bindings[4];
+    }
+    return nullptr;
+  }
+
+  GLuint *textureBinding(GLenum target)
+  {
+    if (active_unit == unknown || active_unit - GL_TEXTURE0 >= GL_STATE_TEXTURE_UNITS)
+      return nullptr;
+    TextureUnit &unit = texture_units[active_unit - GL_TEXTURE0];
+    switch (target)
+    {
+    case GL_TEXTURE_2D:
+      return &unit.texture_2d;
+    case GL_TEXTURE_BUFFER:
+      return &unit.texture_buffer;
+    }
+    return nullptr;
+  }
+
+  void setCapability(GLenum cap, bool on)
+  {
+    auto it = capabilities.find(cap);
+    if (it != capabilities.end() && it->second == on)
+    {
+      elided++;
+      return;
+    }
+    capabilities[cap] = on;
+    issued++;
+    if (on)
+      glEnable(cap);
+    else
+      glDisable(cap);
+  }
+};
+
+// the state of the context current on the calling thread; each thread that
+// draws has a context of its own
+inline GlState &gl_state()
+{
+  thread_local GlState state;
+  return state;
+}
+
+// whether the current context lists extension name
+inline bool gl_has_extension(const char *name)
+{
+  GLint count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  for (GLint i = 0; i < count; i++)
+  {
+    const char *extension = reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, (GLuint)i));
+    if (extension && std::strcmp(extension, name) == 0)
+      return true;
+  }
+  return false;
+}
+
+#endif // !GL_STATE_H
@@ -0,0 +1,285 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// GPU time of named sections of a frame, measured with GL_TIMESTAMP queries
+// at their begin and end, which unlike GL_TIME_ELAPSED may nest and overlap.
+// Every frame gets its own set of query objects from a ring; a frame's
+// results are read when its ring slot comes round again, GPU_PROFILER_LATENCY
+// frames later, and only if the GPU has already finished it, so the CPU never
+// waits on a query. A frame that is still not finished by then is dropped.
+// Results are kept as rolling averages over the last GPU_PROFILER_WINDOW
+// frames and can be streamed per frame as CSV or JSON lines. A disabled
+// profiler issues no queries, so the calls can stay in the render loop.
+
+#define GPU_PROFILER_LATENCY 4
+#define GPU_PROFILER_WINDOW 60
+
+class GpuProfiler
+{
+public:
+  explicit GpuProfiler(bool enabled = true) : enabled(enabled)
+  {
+  }
+
+  GpuProfiler(const GpuProfiler &) = delete;
+  GpuProfiler &operator=(const GpuProfiler &) = delete;
+
+  ~GpuProfiler()
+  {
+    for (Slot &slot : slots)
+    {
+      if (!slot.queries.empty())
+        glDeleteQueries((GLsizei)slot.queries.size(), slot.queries.data());
+    }
+    if (stream)
+      fclose(stream);
+  }
+
+  // register a section before the first frame; returns its id
+  size_t addSection(const std::string &name)
+  {
+    sections.push_back(Section{name, Window{}});
+    return sections.size() - 1;
+  }
+
+  // write every collected frame to path, as JSON lines if it ends in .json or
+  // .jsonl and as CSV otherwise
+  bool openStream(const std::string &path)
+  {
+    stream = fopen(path.c_str(), "w");
+    if (!stream)
+    {
+      std::cout << "Failed to open " << path << std::endl;
+      return false;
+    }
+    const size_t dot = path.rfind('.');
+    json = dot != std::string::npos && (path.substr(dot) == ".json" || path.substr(dot) == ".jsonl");
+    if (!json)
+    {
+      fprintf(stream, "frame,frame_ms");
+      for (const Section &section : sections)
+        fprintf(stream, ",%s_ms", section.name.c_str());
+      fprintf(stream, "\n");
+    }
+    return true;
+  }
+
+  // collect the frame that last used this frame's slot and start timing
+  void beginFrame()
+  {
+    if (!enabled)
+      return;
+    if (slots.empty())
+    {
+      // two timestamps per section plus the frame's own pair
+      slots.resize(GPU_PROFILER_LATENCY);
+      for (Slot &slot : slots)
+      {
+        slot.queries.resize(2 * sections.size() + 2);
+        glGenQueries((GLsizei)slot.queries.size(), slot.queries.data());
+        slot.issued.resize(sections.size());
+      }
+    }
+
+    Slot &slot = slots[frame % slots.size()];
+    if (slot.pending)
+      collect(slot, false);
+
+    slot.frame = frame;
+    slot.pending = true;
+    std::fill(slot.issued.begin(), slot.issued.end(), false);
+    glQueryCounter(slot.queries[0], GL_TIMESTAMP);
+  }
+
+  void begin(size_t section)
+  {
+    if (!enabled)
+      return;
+    Slot &slot = current();
+    slot.issued[section] = true;
+    glQueryCounter(slot.queries[2 + 2 * section], GL_TIMESTAMP);
+  }
+
+  void end(size_t section)
+  {
+    if (!enabled)
+      return;
+    glQueryCounter(current().queries[3 + 2 * section], GL_TIMESTAMP);
+  }
+
+  void endFrame()
+  {
+    if (!enabled)
+      return;
+    glQueryCounter(current().queries[1], GL_TIMESTAMP);
+    frame++;
+  }
+
+  // wait for the frames still in flight and collect them, e.g. before
+  // shutting down so the stream ends with the last frame
+  void finish()
+  {
+    for (size_t i = 0; i < slots.size(); i++)
+    {
+      Slot &slot = slots[(frame + i) % slots.size()];
+      if (slot.pending)
+        collect(slot, true);
+    }
+    if (stream)
+      fflush(stream);
+  }
+
+  bool isEnabled() const
+  {
+    return enabled;
+  }
+
+  // rolling averages in ms; sections that were skipped in a frame, e.g. a
+  // capture, are averaged over the frames they ran in
+  double getAverageMs(size_t section) const
+  {
+    return sections[section].window.average();
+  }
+
+  double getFrameAverageMs() const
+  {
+    return frame_window.average();
+  }
+
+  const std::string &getName(size_t section) const
+  {
+    return sections[section].name;
+  }
+
+  size_t getSectionCount() const
+  {
+    return sections.size();
+  }
+
+  // frames whose queries had not finished GPU_PROFILER_LATENCY frames later
+  size_t getDropped() const
+  {
+    return dropped;
+  }
+
+  // one line of the rolling averages
+  void print() const
+  {
+    printf("gpu %.3f ms:", getFrameAverageMs());
+    for (const Section &section : sections)
+      printf(" %s %.3f", section.name.c_str(), section.window.average());
+    printf(" (%zu frames dropped)\n", dropped);
+    fflush(stdout);
+  }
+
+private:
+  // the last GPU_PROFILER_WINDOW samples and their sum
+  struct Window
+  {
+    double samples[GPU_PROFILER_WINDOW] = {};
+    double sum = 0.0;
+    size_t count = 0, next = 0;
+
+    void add(double value)
+    {
+      sum += value - samples[next];
+      samples[next] = value;
+      next = (next + 1) % GPU_PROFILER_WINDOW;
+      count += count < GPU_PROFILER_WINDOW ? 1 : 0;
+    }
+
+    double average() const
+    {
+      return count ? sum / count : 0.0;
+    }
+  };
+
+  struct Section
+  {
+    std::string name;
+    Window window;
+  };
+
+  struct Slot
+  {
+    // frame begin and end, then begin and end of every section
+    std::vector<GLuint> queries;
+    std::vector<bool> issued;
+    uint64_t frame = 0;
+    bool pending = false;
+  };
+
+  bool enabled;
+  std::vector<Section> sections;
+  std::vector<Slot> slots;
+  Window frame_window;
+  uint64_t frame = 0;
+  size_t dropped = 0;
+  FILE *stream = nullptr;
+  bool json = false;
+
+  Slot &current()
+  {
+    return slots[frame % slots.size()];
+  }
+
+  double elapsedMs(const Slot &slot, size_t begin_query)
+  {
+    GLuint64 begin = 0, end = 0;
+    glGetQueryObjectui64v(slot.queries[begin_query], GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(slot.queries[begin_query + 1], GL_QUERY_RESULT, &end);
+    return end > begin ? (end - begin) / 1e6 : 0.0;
+  }
+
+  void collect(Slot &slot, bool wait)
+  {
+    slot.pending = false;
+
+    // the frame's end timestamp is the last one written, so once it is
+    // available every other result of the frame is too
+    GLint available = wait;
+    if (!wait)
+      glGetQueryObjectiv(slot.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+    {
+      dropped++;
+      return;
+    }
+
+    const double frame_ms = elapsedMs(slot, 0);
+    frame_window.add(frame_ms);
+    if (stream)
+      fprintf(stream, json ? "{\"frame\": %llu, \"frame_ms\": %.4f" : "%llu,%.4f", (unsigned long long)slot.frame,
+              frame_ms);
+
+    for (size_t i = 0; i < sections.size(); i++)
+    {
+      if (!slot.issued[i])
+      {
+        if (stream && !json)
+          fprintf(stream, ",");
+        continue;
+      }
+      const double ms = elapsedMs(slot, 2 + 2 * i);
+      sections[i].window.add(ms);
+      if (stream && json)
+        fprintf(stream, ", \"%s_ms\": %.4f", sections[i].name.c_str(), ms);
+      else if (stream)
+        fprintf(stream, ",%.4f", ms);
+    }
+    if (stream)
+      fprintf(stream, json ? "}\n" : "\n");
+  }
+};
+
+#endif // !GPU_PROFILER_H
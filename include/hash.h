@@ -0,0 +1,26 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// 64-bit FNV-1a, used to key on-disk caches by the content they were built from
+inline uint64_t fnv1a64(const void *data, size_t size, uint64_t seed = 0xcbf29ce484222325ull)
+{
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  uint64_t hash = seed;
+  for (size_t i = 0; i < size; i++)
+  {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+inline uint64_t fnv1a64(const std::string &str, uint64_t seed = 0xcbf29ce484222325ull)
+{
+  return fnv1a64(str.data(), str.size(), seed);
+}
+
+#endif // !HASH_H
@@ -0,0 +1,223 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+// EGL is optional; CMake defines HAVE_EGL when it finds libEGL
+#ifdef HAVE_EGL
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+// An OpenGL 3.3 core context without a window or display, for --headless.
+// The context is created on EGL's surfaceless platform, which Mesa provides
+// with or without a GPU (llvmpipe otherwise), and every frame is drawn into
+// a framebuffer object of the requested size that stays bound for drawing
+// and reading, so captures and recordings work unchanged. A second context
+// sharing its objects can be made current on a worker thread, e.g. to build
+// shader programs there.
+
+class HeadlessContext
+{
+public:
+  HeadlessContext() = default;
+
+  HeadlessContext(const HeadlessContext &) = delete;
+  HeadlessContext &operator=(const HeadlessContext &) = delete;
+
+  ~HeadlessContext()
+  {
+    destroy();
+  }
+
+  // create and make current the context, load the GL functions and bind a
+  // width x height framebuffer
+  bool create(uint32_t width, uint32_t height)
+  {
+#ifdef HAVE_EGL
+    if (!createContext())
+      return false;
+
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+    {
+      std::cout << "Failed to initialize GLAD" << std::endl;
+      return false;
+    }
+    std::cout << "Headless " << glGetString(GL_RENDERER) << ", OpenGL " << glGetString(GL_VERSION) << std::endl;
+
+    return createFramebuffer(width, height);
+#else
+    (void)width;
+    (void)height;
+    std::cout << "Headless rendering needs EGL, which this build was configured without" << std::endl;
+    return false;
+#endif
+  }
+
+  // the loader GL functions were loaded with, for entry points beyond 3.3
+  static GLADloadproc loader()
+  {
+#ifdef HAVE_EGL
+    return (GLADloadproc)eglGetProcAddress;
+#else
+    return nullptr;
+#endif
+  }
+
+  // create a second context sharing objects with the first, to be made
+  // current on another thread with attachShared()
+  bool createShared()
+  {
+#ifdef HAVE_EGL
+    const EGLint context_attribs[] = {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+                                      EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                      EGL_NONE};
+    if (context == EGL_NO_CONTEXT ||
+        (shared_context = eglCreateContext(display, config, context, context_attribs)) == EGL_NO_CONTEXT)
+    {
+      std::cout << "Failed to create a shared EGL context" << std::endl;
+      return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  // make the shared context current on the calling thread, or release it
+  bool attachShared(bool attach)
+  {
+#ifdef HAVE_EGL
+    // the bound API is per thread
+    return eglBindAPI(EGL_OPENGL_API) &&
+           eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, attach ? shared_context : EGL_NO_CONTEXT);
+#else
+    (void)attach;
+    return false;
+#endif
+  }
+
+  void destroy()
+  {
+#ifdef HAVE_EGL
+    if (shared_context != EGL_NO_CONTEXT)
+    {
+      eglDestroyContext(display, shared_context);
+      shared_context = EGL_NO_CONTEXT;
+    }
+    if (context != EGL_NO_CONTEXT)
+    {
+      if (fbo)
+      {
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteRenderbuffers(2, renderbuffers);
+        fbo = 0;
+      }
+      eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+      eglDestroyContext(display, context);
+      context = EGL_NO_CONTEXT;
+    }
+    if (display != EGL_NO_DISPLAY)
+    {
+      eglTerminate(display);
+      display = EGL_NO_DISPLAY;
+    }
+#endif
+  }
+
+private:
+  GLuint fbo = 0;
+  // color and depth/stencil, the formats of a default glfw window
+  GLuint renderbuffers[2] = {0, 0};
+
+#ifdef HAVE_EGL
+  EGLDisplay display = EGL_NO_DISPLAY;
+  EGLContext context = EGL_NO_CONTEXT;
+  EGLContext shared_context = EGL_NO_CONTEXT;
+  EGLConfig config = nullptr;
+
+  bool createContext()
+  {
+    // the surfaceless platform needs no display server; without it fall back
+    // to the default display, e.g. a vendor driver's own headless device
+    const char *client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    auto get_platform_display =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (client_extensions && strstr(client_extensions, "EGL_MESA_platform_surfaceless") && get_platform_display)
+      display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if (display == EGL_NO_DISPLAY)
+      display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+    {
+      std::cout << "Failed to initialize EGL" << std::endl;
+      display = EGL_NO_DISPLAY;
+      return false;
+    }
+
+    const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+    if (!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context"))
+    {
+      std::cout << "EGL display does not support surfaceless contexts" << std::endl;
+      return false;
+    }
+
+    // any surface type, nothing is ever drawn to an EGL surface
+    const EGLint config_attribs[] = {EGL_SURFACE_TYPE, 0, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+    EGLint num_configs = 0;
+    if (!eglChooseConfig(display, config_attribs, &config, 1, &num_configs) || num_configs == 0)
+    {
+      std::cout << "No EGL config for desktop OpenGL" << std::endl;
+      return false;
+    }
+
+    const EGLint context_attribs[] = {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+                                      EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                      EGL_NONE};
+    if (!eglBindAPI(EGL_OPENGL_API) ||
+        (context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs)) == EGL_NO_CONTEXT)
+    {
+      std::cout << "Failed to create an OpenGL 3.3 core EGL context" << std::endl;
+      return false;
+    }
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+    {
+      std::cout << "Failed to make the EGL context current" << std::endl;
+      return false;
+    }
+    return true;
+  }
+#endif
+
+  bool createFramebuffer(uint32_t width, uint32_t height)
+  {
+    glGenRenderbuffers(2, renderbuffers);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+      std::cout << "Offscreen framebuffer of " << width << "x" << height << " is incomplete" << std::endl;
+      return false;
+    }
+
+    // a surfaceless context has no default framebuffer to size the viewport
+    glViewport(0, 0, width, height);
+    return true;
+  }
+};
+
+#endif // !HEADLESS_H
@@ -0,0 +1,64 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stb_image.h>
+
+#include <memory>
+#include <string>
+
+// decoded 8-bit image owning its stb_image pixel buffer
+class Image
+{
+public:
+  // decode a file, flipped so the first row is the bottom one as GL expects;
+  // safe to call from any thread. Check isValid() for decode failures.
+  static Image load(const std::string &path)
+  {
+    Image image;
+    stbi_set_flip_vertically_on_load_thread(true);
+    stbi_uc *data = stbi_load(path.c_str(), &image.width, &image.height, &image.channels, 0);
+    image.pixels.reset(data);
+    return image;
+  }
+
+  bool isValid() const
+  {
+    return pixels != nullptr;
+  }
+
+  int getWidth() const
+  {
+    return width;
+  }
+
+  int getHeight() const
+  {
+    return height;
+  }
+
+  int getChannels() const
+  {
+    return channels;
+  }
+
+  const unsigned char *getData() const
+  {
+    return pixels.get();
+  }
+
+private:
+  struct StbiDeleter
+  {
+    void operator()(stbi_uc *data) const
+    {
+      stbi_image_free(data);
+    }
+  };
+
+  std::unique_ptr<stbi_uc, StbiDeleter> pixels;
+  int width = 0;
+  int height = 0;
+  int channels = 0;
+};
+
+#endif // !IMAGE_H
@@ -0,0 +1,275 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <deflate.h>
+#include <thread_pool.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <future>
+#include <string>
+#include <vector>
+
+// define IMAGE_WRITER_NO_SIMD to build the scalar pixel packing instead
+#if (defined(__SSE2__) || defined(_M_X64)) && !defined(IMAGE_WRITER_NO_SIMD)
+#include <emmintrin.h>
+#define IMAGE_WRITER_SSE2 1
+#endif
+
+// Screenshot encoders for frames read back from GL: RGBA, bottom row first.
+// All of them write RGB, top row first.
+// - Ppm: binary P6, the rows packed and flipped into one buffer and written
+//   with a single call
+// - AsciiPpm: the original P3 text output, kept for comparison
+// - Png: in-tree encoder; the rows are split into bands that are filtered
+//   and deflated in parallel on a thread pool
+
+enum class ImageFormat
+{
+  Ppm,
+  AsciiPpm,
+  Png
+};
+
+inline const char *image_format_extension(ImageFormat format)
+{
+  return format == ImageFormat::Png ? ".png" : ".ppm";
+}
+
+// drop the alpha of one row; with SSE2 four pixels at a time
+inline void rgba_to_rgb(const uint8_t *rgba, size_t pixels, uint8_t *rgb)
+{
+  size_t i = 0;
+#ifdef IMAGE_WRITER_SSE2
+  // every 16 byte store writes 12 bytes of pixels and 4 of garbage that the
+  // next store overwrites, so stop while a whole store still fits
+  const __m128i first_rgb = _mm_set_epi32(0, 0x00ffffff, 0, 0x00ffffff);
+  const __m128i second_rgb = _mm_set_epi32(0x00ffffff, 0, 0x00ffffff, 0);
+  for (; i + 6 <= pixels; i += 4)
+  {
+    const __m128i p = _mm_loadu_si128((const __m128i *)(rgba + 4 * i));
+    // six bytes of rgb at the bottom of each 64-bit lane
+    const __m128i packed =
+        _mm_or_si128(_mm_and_si128(p, first_rgb), _mm_srli_epi64(_mm_and_si128(p, second_rgb), 8));
+    // then the upper lane's six bytes right after the lower lane's
+    const __m128i out = _mm_or_si128(_mm_move_epi64(packed), _mm_slli_si128(_mm_srli_si128(packed, 8), 6));
+    _mm_storeu_si128((__m128i *)(rgb + 3 * i), out);
+  }
+#endif
+  for (; i < pixels; i++)
+  {
+    rgb[3 * i] = rgba[4 * i];
+    rgb[3 * i + 1] = rgba[4 * i + 1];
+    rgb[3 * i + 2] = rgba[4 * i + 2];
+  }
+}
+
+inline bool write_ppm_ascii(const std::string &path, const uint8_t *rgba, uint32_t width, uint32_t height)
+{
+  std::ofstream fout(path);
+  if (!fout)
+    return false;
+
+  fout << "P3\n"
+       << width << " " << height << "\n"
+       << 255 << std::endl;
+  for (size_t i = 0; i < height; i++)
+  {
+    const uint8_t *row = rgba + (height - i - 1) * width * 4;
+    for (size_t j = 0; j < width; j++)
+    {
+      fout << (int)row[4 * j] << " " << (int)row[4 * j + 1] << " " << (int)row[4 * j + 2] << " ";
+    }
+    fout << std::endl;
+  }
+  return (bool)fout;
+}
+
+inline std::vector<uint8_t> encode_ppm(const uint8_t *rgba, uint32_t width, uint32_t height)
+{
+  char header[64];
+  const int header_size = snprintf(header, sizeof(header), "P6\n%u %u\n255\n", width, height);
+
+  std::vector<uint8_t> out(header_size + (size_t)width * height * 3);
+  std::copy(header, header + header_size, out.begin());
+  uint8_t *pixels = out.data() + header_size;
+  for (size_t i = 0; i < height; i++)
+    rgba_to_rgb(rgba + (height - i - 1) * width * 4, width, pixels + i * width * 3);
+  return out;
+}
+
+namespace png
+{
+
+inline uint8_t paeth(int a, int b, int c)
+{
+  const int p = a + b - c;
+  const int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+  if (pa <= pb && pa <= pc)
+    return (uint8_t)a;
+  return (uint8_t)(pb <= pc ? b : c);
+}
+
+// filter one row with each of the five filters and keep the one with the
+// smallest sum of absolute signed bytes, the usual heuristic; out receives
+// the filter type followed by the filtered row. The first row has no row
+// above it, which the filters treat as zeros.
+inline void filter_row(const uint8_t *row, const uint8_t *above, size_t bytes, uint8_t *out,
+                       std::vector<uint8_t> &scratch)
+{
+  const size_t bpp = 3;
+  scratch.assign(6 * bytes, 0);
+  const uint8_t *up = above ? above : scratch.data() + 5 * bytes;
+  uint8_t *none = scratch.data(), *sub = none + bytes, *upf = sub + bytes, *avg = upf + bytes, *pae = avg + bytes;
+
+  // one loop per filter so that the compiler can vectorize the simple ones
+  for (size_t x = 0; x < bytes; x++)
+    none[x] = row[x];
+  for (size_t x = 0; x < bytes; x++)
+    sub[x] = (uint8_t)(row[x] - (x >= bpp ? row[x - bpp] : 0));
+  for (size_t x = 0; x < bytes; x++)
+    upf[x] = (uint8_t)(row[x] - up[x]);
+  for (size_t x = 0; x < bytes; x++)
+    avg[x] = (uint8_t)(row[x] - (((x >= bpp ? row[x - bpp] : 0) + up[x]) >> 1));
+  for (size_t x = 0; x < bpp && x < bytes; x++)
+    pae[x] = (uint8_t)(row[x] - up[x]);
+  for (size_t x = bpp; x < bytes; x++)
+    pae[x] = (uint8_t)(row[x] - paeth(row[x - bpp], up[x], up[x - bpp]));
+
+  uint64_t best_sum = UINT64_MAX;
+  int best = 0;
+  for (int type = 0; type < 5; type++)
+  {
+    const int8_t *f = (const int8_t *)scratch.data() + type * bytes;
+    uint64_t sum = 0;
+    for (size_t x = 0; x < bytes; x++)
+      sum += (uint64_t)std::abs((int)f[x]);
+    if (sum < best_sum)
+    {
+      best_sum = sum;
+      best = type;
+    }
+  }
+  out[0] = (uint8_t)best;
+  std::copy(scratch.data() + best * bytes, scratch.data() + (best + 1) * bytes, out + 1);
+}
+
+// filtered and deflated rows [first, last) of the top-down image
+struct Band
+{
+  std::vector<uint8_t> deflated;
+  uint32_t adler = 1;
+  size_t filtered_size = 0;
+};
+
+inline Band encode_band(const uint8_t *rgba, uint32_t width, uint32_t height, uint32_t first, uint32_t last)
+{
+  const size_t row_bytes = (size_t)width * 3;
+  std::vector<uint8_t> filtered((last - first) * (row_bytes + 1));
+  std::vector<uint8_t> rows[2] = {std::vector<uint8_t>(row_bytes), std::vector<uint8_t>(row_bytes)};
+  std::vector<uint8_t> scratch;
+
+  // the row above the band is needed for the Up, Average and Paeth filters
+  if (first > 0)
+    rgba_to_rgb(rgba + (size_t)(height - first) * width * 4, width, rows[(first + 1) & 1].data());
+
+  for (uint32_t y = first; y < last; y++)
+  {
+    std::vector<uint8_t> &row = rows[y & 1];
+    const std::vector<uint8_t> &above = rows[(y + 1) & 1];
+    rgba_to_rgb(rgba + (size_t)(height - y - 1) * width * 4, width, row.data());
+    filter_row(row.data(), y > 0 ? above.data() : nullptr, row_bytes,
+               filtered.data() + (y - first) * (row_bytes + 1), scratch);
+  }
+
+  Band band;
+  band.filtered_size = filtered.size();
+  band.adler = deflate::adler32(filtered.data(), filtered.size());
+  deflate::deflate_piece(filtered.data(), filtered.size(), last == height, band.deflated);
+  return band;
+}
+
+inline void put_u32(std::vector<uint8_t> &out, uint32_t v)
+{
+  out.push_back((uint8_t)(v >> 24));
+  out.push_back((uint8_t)(v >> 16));
+  out.push_back((uint8_t)(v >> 8));
+  out.push_back((uint8_t)v);
+}
+
+inline void put_chunk(std::vector<uint8_t> &out, const char *type, const std::vector<uint8_t> &data)
+{
+  put_u32(out, (uint32_t)data.size());
+  const size_t start = out.size();
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), data.begin(), data.end());
+  put_u32(out, deflate::crc32(out.data() + start, out.size() - start));
+}
+
+} // namespace png
+
+// 8-bit RGB png; with a pool the bands are encoded concurrently
+inline std::vector<uint8_t> encode_png(const uint8_t *rgba, uint32_t width, uint32_t height, ThreadPool *pool = nullptr)
+{
+  // two bands per worker to even out their cost, but not so thin that
+  // restarting the LZ77 window at every band hurts compression
+  const uint32_t min_rows = 32;
+  const size_t workers = pool ? pool->size() : 1;
+  const uint32_t bands = (uint32_t)std::max<size_t>(1, std::min<size_t>(workers * 2, height / min_rows));
+
+  std::vector<png::Band> encoded(bands);
+  std::vector<std::future<png::Band>> pending;
+  for (uint32_t b = 0; b < bands; b++)
+  {
+    const uint32_t first = (uint32_t)((uint64_t)height * b / bands);
+    const uint32_t last = (uint32_t)((uint64_t)height * (b + 1) / bands);
+    if (pool && bands > 1)
+      pending.push_back(pool->submit([=] { return png::encode_band(rgba, width, height, first, last); }));
+    else
+      encoded[b] = png::encode_band(rgba, width, height, first, last);
+  }
+  for (size_t b = 0; b < pending.size(); b++)
+    encoded[b] = pending[b].get();
+
+  // zlib stream: header, the concatenated pieces, adler32 of all filtered rows
+  std::vector<uint8_t> idat = {0x78, 0x9c};
+  uint32_t adler = 1;
+  for (const png::Band &band : encoded)
+  {
+    idat.insert(idat.end(), band.deflated.begin(), band.deflated.end());
+    adler = deflate::adler32_combine(adler, band.adler, band.filtered_size);
+  }
+  png::put_u32(idat, adler);
+
+  std::vector<uint8_t> ihdr;
+  png::put_u32(ihdr, width);
+  png::put_u32(ihdr, height);
+  ihdr.insert(ihdr.end(), {8, 2, 0, 0, 0}); // 8 bits, rgb, deflate, adaptive filters, no interlace
+
+  std::vector<uint8_t> out = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  png::put_chunk(out, "IHDR", ihdr);
+  png::put_chunk(out, "IDAT", idat);
+  png::put_chunk(out, "IEND", std::vector<uint8_t>());
+  return out;
+}
+
+// encode in the given format and write the file with one call; the pool is
+// only used for png
+inline bool write_image(const std::string &path, ImageFormat format, const uint8_t *rgba, uint32_t width,
+                        uint32_t height, ThreadPool *pool = nullptr)
+{
+  if (format == ImageFormat::AsciiPpm)
+    return write_ppm_ascii(path, rgba, width, height);
+
+  const std::vector<uint8_t> data =
+      format == ImageFormat::Png ? encode_png(rgba, width, height, pool) : encode_ppm(rgba, width, height);
+  std::ofstream fout(path, std::ios::binary);
+  fout.write((const char *)data.data(), data.size());
+  return (bool)fout;
+}
+
+#endif // !IMAGE_WRITER_H
@@ -0,0 +1,134 @@
+#ifndef INSTANCING_H
+#define INSTANCING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <gl_state.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Per-instance transforms and tints for drawing many copies of a mesh with
+// one glDrawElementsInstanced call. An InstanceBuffer holds the instances and
+// adds them to a mesh's VAO as attributes 3 to 7 with a divisor of 1, read by
+// shaders/shader_instanced.vs. One buffer can feed several VAOs.
+
+// first attribute location of the per-instance data
+#define INSTANCE_ATTRIB_LOCATION 3
+
+struct InstanceData
+{
+  glm::mat4 model;
+  // rgb multiplies the texture color; a is unused
+  glm::vec4 tint;
+};
+
+class InstanceBuffer
+{
+public:
+  InstanceBuffer() = default;
+
+  InstanceBuffer(const InstanceBuffer &) = delete;
+  InstanceBuffer &operator=(const InstanceBuffer &) = delete;
+
+  ~InstanceBuffer()
+  {
+    if (vbo)
+      gl_state().deleteBuffers(1, &vbo);
+  }
+
+  // replace the instances; the buffer only grows, and the old storage is
+  // orphaned so draws still reading it do not stall the upload
+  void upload(const InstanceData *instances, size_t instance_count)
+  {
+    if (!vbo)
+      glGenBuffers(1, &vbo);
+    gl_state().bindBuffer(GL_ARRAY_BUFFER, vbo);
+    const size_t bytes = instance_count * sizeof(InstanceData);
+    capacity = std::max(capacity, bytes);
+    glBufferData(GL_ARRAY_BUFFER, capacity, NULL, GL_DYNAMIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, instances);
+    gl_state().bindBuffer(GL_ARRAY_BUFFER, 0);
+    count = instance_count;
+  }
+
+  // source the per-instance attributes of vao from this buffer, starting at
+  // first_instance; GL 3.3 has no base instance, so drawing a later range
+  // of the buffer means attaching it again
+  void attach(GLuint vao, size_t first_instance = 0)
+  {
+    const size_t base = first_instance * sizeof(InstanceData);
+    if (!vbo)
+      glGenBuffers(1, &vbo);
+    gl_state().bindVertexArray(vao);
+    gl_state().bindBuffer(GL_ARRAY_BUFFER, vbo);
+
+    // a mat4 attribute takes one location per column
+    for (GLuint column = 0; column < 4; column++)
+    {
+      const GLuint location = INSTANCE_ATTRIB_LOCATION + column;
+      glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                            (void *)(base + offsetof(InstanceData, model) + column * sizeof(glm::vec4)));
+      glEnableVertexAttribArray(location);
+      glVertexAttribDivisor(location, 1);
+    }
+    glVertexAttribPointer(INSTANCE_ATTRIB_LOCATION + 4, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                          (void *)(base + offsetof(InstanceData, tint)));
+    glEnableVertexAttribArray(INSTANCE_ATTRIB_LOCATION + 4);
+    glVertexAttribDivisor(INSTANCE_ATTRIB_LOCATION + 4, 1);
+
+    gl_state().bindVertexArray(0);
+    gl_state().bindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+  size_t getCount() const
+  {
+    return count;
+  }
+
+private:
+  GLuint vbo = 0;
+  size_t count = 0, capacity = 0;
+};
+
+// count instances on a sunflower spiral around the origin, about spacing
+// apart, each turned and tinted at random. Instance 0 is the untransformed,
+// untinted original, so a crowd of one draws the scene as before.
+inline std::vector<InstanceData> make_crowd(size_t count, float spacing, uint32_t seed = 1234)
+{
+  std::vector<InstanceData> instances(count);
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+  // successive points turn by the golden angle and the radius grows with the
+  // square root of the index, which packs them evenly at about 1.8 times the
+  // radius step apart
+  const float golden_angle = 2.39996323f;
+  const float step = spacing / 1.8f;
+  for (size_t i = 0; i < count; i++)
+  {
+    InstanceData &instance = instances[i];
+    if (i == 0)
+    {
+      instance.model = glm::mat4(1.0f);
+      instance.tint = glm::vec4(1.0f);
+      continue;
+    }
+
+    const float radius = step * std::sqrt((float)i + 1.0f);
+    const float angle = golden_angle * i;
+    const glm::vec3 position(radius * std::cos(angle), 0.0f, radius * std::sin(angle));
+    const float yaw = unit(rng) * glm::radians(360.0f);
+    instance.model = glm::rotate(glm::translate(glm::mat4(1.0f), position), yaw, glm::vec3(0, 1, 0));
+    instance.tint = glm::vec4(0.4f + 0.6f * unit(rng), 0.4f + 0.6f * unit(rng), 0.4f + 0.6f * unit(rng), 1.0f);
+  }
+  return instances;
+}
+
+#endif // !INSTANCING_H
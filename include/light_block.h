@@ -0,0 +1,187 @@
+#ifndef LIGHT_BLOCK_H
+#define LIGHT_BLOCK_H
+
+#include <gl_state.h>
+#include <light_clusters.h>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// GPU side of the lights, shared by every program that binds the "Lights"
+// uniform block to LIGHTS_BINDING and samples the light buffer textures:
+// - the std140 block holds what is shared by all lights and clusters
+// - lightData holds the lights as RGBA32F texels in two streams: the first
+//   MAX_LIGHTS texels are each light's (direction, cutOff), the only part the
+//   disco lights animate, and three texels per light after them hold the
+//   position, color and attenuation, which stay the same from frame to frame
+// - clusterCells holds (offset, count) per cluster and clusterLights the
+//   light indices the cells point into
+// Each of the buffers is written with at most one upload per frame; the
+// static light parameters only when they change.
+
+#define LIGHTS_BINDING 0
+
+struct LightBlockData
+{
+  glm::vec4 ambient;        // rgb, summed over all lights
+  glm::uvec4 clusterDims;   // CLUSTER_X, CLUSTER_Y, CLUSTER_Z, light count
+  glm::vec4 clusterDepth;   // slice = log(depth) * x + y; zw viewport size
+};
+
+static_assert(sizeof(LightBlockData) == 48, "LightBlockData must match the std140 layout");
+
+class LightBlock
+{
+public:
+  LightBlock() = default;
+
+  LightBlock(const LightBlock &) = delete;
+  LightBlock &operator=(const LightBlock &) = delete;
+
+  ~LightBlock()
+  {
+    if (ubo)
+    {
+      const GLuint buffers[4] = {ubo, light_buffer, cell_buffer, index_buffer};
+      const GLuint textures[3] = {light_texture, cell_texture, index_texture};
+      gl_state().deleteBuffers(4, buffers);
+      gl_state().deleteTextures(3, textures);
+    }
+  }
+
+  // allocate the buffers for up to MAX_LIGHTS lights and bind the block to
+  // LIGHTS_BINDING
+  void create()
+  {
+    glGenBuffers(1, &ubo);
+    glGenBuffers(1, &light_buffer);
+    glGenBuffers(1, &cell_buffer);
+    glGenBuffers(1, &index_buffer);
+    glGenTextures(1, &light_texture);
+    glGenTextures(1, &cell_texture);
+    glGenTextures(1, &index_texture);
+
+    gl_state().bindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(LightBlockData), NULL, GL_DYNAMIC_DRAW);
+    gl_state().bindBuffer(GL_UNIFORM_BUFFER, 0);
+    gl_state().bindBufferBase(GL_UNIFORM_BUFFER, LIGHTS_BINDING, ubo);
+
+    gl_state().bindBuffer(GL_TEXTURE_BUFFER, light_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, MAX_LIGHTS * (1 + LIGHT_PARAM_TEXELS) * sizeof(glm::vec4), NULL, GL_DYNAMIC_DRAW);
+    gl_state().bindBuffer(GL_TEXTURE_BUFFER, cell_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, CLUSTER_COUNT * 2 * sizeof(uint32_t), NULL, GL_DYNAMIC_DRAW);
+    gl_state().bindBuffer(GL_TEXTURE_BUFFER, index_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(uint16_t), NULL, GL_DYNAMIC_DRAW);
+    gl_state().bindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    gl_state().bindTexture(GL_TEXTURE_BUFFER, light_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, light_buffer);
+    gl_state().bindTexture(GL_TEXTURE_BUFFER, cell_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, cell_buffer);
+    gl_state().bindTexture(GL_TEXTURE_BUFFER, index_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R16UI, index_buffer);
+    gl_state().bindTexture(GL_TEXTURE_BUFFER, 0);
+
+    GLint max_texels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+    max_indices = (size_t)max_texels;
+  }
+
+  // the shared parameters; only change with the light count, projection or
+  // viewport
+  void updateParams(const glm::vec3 &ambient, size_t light_count, const LightClusters &clusters,
+                    const glm::vec2 &viewport)
+  {
+    LightBlockData data;
+    data.ambient = glm::vec4(ambient, 0.0f);
+    data.clusterDims = glm::uvec4(CLUSTER_X, CLUSTER_Y, CLUSTER_Z, (unsigned)std::min<size_t>(light_count, MAX_LIGHTS));
+    data.clusterDepth = glm::vec4(clusters.getSliceScale(), clusters.getSliceBias(), viewport.x, viewport.y);
+
+    gl_state().bindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(data), &data);
+    gl_state().bindBuffer(GL_UNIFORM_BUFFER, 0);
+  }
+
+  // the directions are uploaded every frame; the static parameters only when
+  // they differ from the last ones uploaded, which for the disco lights is
+  // when the light count changes
+  void updateLights(const SpotLight *lights, size_t count)
+  {
+    count = std::min<size_t>(count, MAX_LIGHTS);
+    directions.resize(count);
+    params.resize(count * LIGHT_PARAM_TEXELS);
+    for (size_t i = 0; i < count; i++)
+    {
+      const SpotLight &l = lights[i];
+      directions[i] = glm::vec4(l.direction, l.cutOff);
+      params[i * LIGHT_PARAM_TEXELS] = glm::vec4(l.position, l.range);
+      params[i * LIGHT_PARAM_TEXELS + 1] = glm::vec4(l.diffuse, l.constant);
+      params[i * LIGHT_PARAM_TEXELS + 2] = glm::vec4(l.linear, l.quadratic, 0.0f, 0.0f);
+    }
+
+    gl_state().bindBuffer(GL_TEXTURE_BUFFER, light_buffer);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, count * sizeof(glm::vec4), directions.data());
+    if (params != uploaded_params)
+    {
+      glBufferSubData(GL_TEXTURE_BUFFER, MAX_LIGHTS * sizeof(glm::vec4), params.size() * sizeof(glm::vec4),
+                      params.data());
+      uploaded_params = params;
+    }
+    gl_state().bindBuffer(GL_TEXTURE_BUFFER, 0);
+  }
+
+  // the index list changes size every frame, so its storage is respecified
+  // (orphaned) instead of written in place
+  void updateClusters(const LightClusters &clusters)
+  {
+    const std::vector<uint16_t> &indices = clusters.getIndices();
+    if (indices.size() > max_indices && !warned)
+    {
+      std::cout << "Cluster light lists exceed GL_MAX_TEXTURE_BUFFER_SIZE (" << indices.size() << " > "
+                << max_indices << "), lights will be missing" << std::endl;
+      warned = true;
+    }
+
+    gl_state().bindBuffer(GL_TEXTURE_BUFFER, cell_buffer);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, CLUSTER_COUNT * 2 * sizeof(uint32_t), clusters.getCells());
+    gl_state().bindBuffer(GL_TEXTURE_BUFFER, index_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(1, std::min(indices.size(), max_indices)) * sizeof(uint16_t),
+                 indices.empty() ? NULL : indices.data(), GL_STREAM_DRAW);
+    gl_state().bindBuffer(GL_TEXTURE_BUFFER, 0);
+  }
+
+  // bind lightData, clusterCells and clusterLights to three consecutive
+  // texture units starting at first_unit
+  void bindTextures(GLuint first_unit) const
+  {
+    const GLuint textures[3] = {light_texture, cell_texture, index_texture};
+    for (int i = 0; i < 3; i++)
+    {
+      gl_state().activeTexture(GL_TEXTURE0 + first_unit + i);
+      gl_state().bindTexture(GL_TEXTURE_BUFFER, textures[i]);
+    }
+    gl_state().activeTexture(GL_TEXTURE0);
+  }
+
+private:
+  GLuint ubo = 0;
+  GLuint light_buffer = 0, cell_buffer = 0, index_buffer = 0;
+  GLuint light_texture = 0, cell_texture = 0, index_texture = 0;
+
+  // texels per light of the static stream
+  static const size_t LIGHT_PARAM_TEXELS = 3;
+
+  // scratch for the two streams, and the static one as last uploaded
+  std::vector<glm::vec4> directions, params, uploaded_params;
+
+  size_t max_indices = 0;
+  bool warned = false;
+};
+
+#endif // !LIGHT_BLOCK_H
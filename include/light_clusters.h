@@ -0,0 +1,353 @@
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// define LIGHT_CLUSTERS_NO_SIMD to build the scalar cone tests instead
+#if (defined(__SSE2__) || defined(_M_X64)) && !defined(LIGHT_CLUSTERS_NO_SIMD)
+#include <emmintrin.h>
+#define LIGHT_CLUSTERS_SSE2 1
+#endif
+
+// Clustered light assignment on the CPU. The view frustum is split into
+// CLUSTER_X x CLUSTER_Y screen tiles and CLUSTER_Z exponential depth slices;
+// every spot light cone is tested against the bounding sphere of each
+// cluster it may touch (four clusters at a time with SSE2) and the result is
+// a light index list per cluster, which shaders/shader.fs walks instead of
+// every light in the scene.
+
+#define CLUSTER_X 16
+#define CLUSTER_Y 12
+#define CLUSTER_Z 24
+#define CLUSTER_COUNT (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+#define MAX_LIGHTS 1024
+
+static_assert(CLUSTER_X % 4 == 0, "cluster rows are tested four at a time");
+
+// world space spot light; LightBlock splits it into the per-frame direction
+// and the static parameters of the lightData buffer texture
+struct SpotLight
+{
+  glm::vec3 position;
+  float range;
+  glm::vec3 direction; // normalized
+  float cutOff;        // cosine of the half angle
+  glm::vec3 diffuse;
+  float constant;
+  float linear;
+  float quadratic;
+};
+
+// distance at which the light's attenuated diffuse falls below one 8-bit step
+inline float light_range(const glm::vec3 &diffuse, float constant, float linear, float quadratic)
+{
+  const float intensity = std::max(diffuse.r, std::max(diffuse.g, diffuse.b));
+  const float limit = intensity * 256.0f - constant;
+  if (limit <= 0.0f)
+    return 0.0f;
+  if (quadratic <= 0.0f)
+    return linear > 0.0f ? limit / linear : INFINITY;
+  return (-linear + std::sqrt(linear * linear + 4.0f * quadratic * limit)) / (2.0f * quadratic);
+}
+
+class LightClusters
+{
+public:
+  // cluster bounds only depend on the projection; depths in front of
+  // cluster_near all fall into the first slice
+  void setProjection(float fovy, float aspect, float near_plane, float far_plane, float cluster_near = 10.0f)
+  {
+    tan_y = std::tan(fovy * 0.5f);
+    tan_x = tan_y * aspect;
+    near_z = near_plane;
+    first_z = std::max(cluster_near, near_plane);
+    far_z = far_plane;
+
+    slice_scale = CLUSTER_Z / std::log(far_z / first_z);
+    slice_bias = -std::log(first_z) * slice_scale;
+
+    for (auto *v : {&center_x, &center_y, &center_z, &radius})
+      v->resize(CLUSTER_COUNT);
+
+    for (int z = 0; z < CLUSTER_Z; z++)
+    {
+      const float z0 = sliceNear(z), z1 = sliceNear(z + 1);
+      for (int y = 0; y < CLUSTER_Y; y++)
+      {
+        const float ny0 = -1.0f + 2.0f * y / CLUSTER_Y, ny1 = -1.0f + 2.0f * (y + 1) / CLUSTER_Y;
+        for (int x = 0; x < CLUSTER_X; x++)
+        {
+          const float nx0 = -1.0f + 2.0f * x / CLUSTER_X, nx1 = -1.0f + 2.0f * (x + 1) / CLUSTER_X;
+
+          // view space AABB of the eight frustum corners, view looks down -z
+          glm::vec3 lo(INFINITY), hi(-INFINITY);
+          for (float depth : {z0, z1})
+          {
+            for (float nx : {nx0, nx1})
+            {
+              for (float ny : {ny0, ny1})
+              {
+                const glm::vec3 p(nx * depth * tan_x, ny * depth * tan_y, -depth);
+                lo = glm::min(lo, p);
+                hi = glm::max(hi, p);
+              }
+            }
+          }
+
+          const size_t c = index(x, y, z);
+          const glm::vec3 center = (lo + hi) * 0.5f;
+          center_x[c] = center.x;
+          center_y[c] = center.y;
+          center_z[c] = center.z;
+          radius[c] = glm::length(hi - center);
+        }
+      }
+    }
+  }
+
+  // bin the lights into clusters; view is the camera's world to view matrix
+  void assign(const SpotLight *lights, size_t count, const glm::mat4 &view)
+  {
+    count = std::min<size_t>(count, MAX_LIGHTS);
+    light_count = count;
+    indices.clear();
+    max_per_cluster = 0;
+
+    transformLights(lights, count, view);
+
+    const size_t words = (count + 63) / 64;
+    std::vector<uint64_t> &bits = slice_bits;
+
+    for (int z = 0; z < CLUSTER_Z; z++)
+    {
+      bits.assign((size_t)CLUSTER_X * CLUSTER_Y * words, 0);
+      const float z0 = sliceNear(z), z1 = sliceNear(z + 1);
+
+      for (size_t l = 0; l < count; l++)
+      {
+        // depth range of the light's bounding sphere within the slice
+        const float depth = -bound_z[l];
+        const float za = std::max(z0, depth - bound_r[l]), zb = std::min(z1, depth + bound_r[l]);
+        if (za > zb || cone_range[l] <= 0.0f)
+          continue;
+
+        int tx0, tx1, ty0, ty1;
+        tileRange(bound_x[l], bound_r[l], za, zb, tan_x, CLUSTER_X, tx0, tx1);
+        tileRange(bound_y[l], bound_r[l], za, zb, tan_y, CLUSTER_Y, ty0, ty1);
+
+        for (int y = ty0; y <= ty1; y++)
+          testRow(l, z, y, tx0, tx1, &bits[(size_t)y * CLUSTER_X * words], words);
+      }
+
+      // emit the per cluster lists in light order
+      for (int y = 0; y < CLUSTER_Y; y++)
+      {
+        for (int x = 0; x < CLUSTER_X; x++)
+        {
+          const size_t c = index(x, y, z);
+          const uint64_t *mask = &bits[((size_t)y * CLUSTER_X + x) * words];
+          cells[c * 2] = (uint32_t)indices.size();
+          for (size_t w = 0; w < words; w++)
+          {
+            for (uint64_t m = mask[w]; m; m &= m - 1)
+              indices.push_back((uint16_t)(w * 64 + count_trailing_zeros(m)));
+          }
+          cells[c * 2 + 1] = (uint32_t)indices.size() - cells[c * 2];
+          max_per_cluster = std::max<size_t>(max_per_cluster, cells[c * 2 + 1]);
+        }
+      }
+    }
+  }
+
+  // (offset, count) into getIndices() for every cluster, x fastest
+  const uint32_t *getCells() const
+  {
+    return cells.data();
+  }
+
+  const std::vector<uint16_t> &getIndices() const
+  {
+    return indices;
+  }
+
+  size_t getMaxLightsPerCluster() const
+  {
+    return max_per_cluster;
+  }
+
+  // slice = log(depth) * scale + bias, as computed by the fragment shader
+  float getSliceScale() const
+  {
+    return slice_scale;
+  }
+
+  float getSliceBias() const
+  {
+    return slice_bias;
+  }
+
+private:
+  float tan_x = 1.0f, tan_y = 1.0f;
+  float near_z = 0.1f, first_z = 10.0f, far_z = 1000.0f;
+  float slice_scale = 1.0f, slice_bias = 0.0f;
+
+  // cluster bounding spheres in view space, structure of arrays
+  std::vector<float> center_x, center_y, center_z, radius;
+
+  // view space lights: cone apex, axis, half angle and range, and the
+  // bounding sphere of the cone
+  std::vector<float> apex_x, apex_y, apex_z, axis_x, axis_y, axis_z, cos_angle, sin_angle, cone_range;
+  std::vector<float> bound_x, bound_y, bound_z, bound_r;
+  size_t light_count = 0;
+
+  std::vector<uint64_t> slice_bits;
+  std::vector<uint32_t> cells = std::vector<uint32_t>(CLUSTER_COUNT * 2, 0);
+  std::vector<uint16_t> indices;
+  size_t max_per_cluster = 0;
+
+  static size_t index(int x, int y, int z)
+  {
+    return ((size_t)z * CLUSTER_Y + y) * CLUSTER_X + x;
+  }
+
+  static int count_trailing_zeros(uint64_t m)
+  {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(m);
+#else
+    int n = 0;
+    while (!(m & 1))
+    {
+      m >>= 1;
+      n++;
+    }
+    return n;
+#endif
+  }
+
+  // near depth of slice z; slice 0 also covers everything in front of it
+  float sliceNear(int z) const
+  {
+    if (z == 0)
+      return near_z;
+    return first_z * std::pow(far_z / first_z, (float)z / CLUSTER_Z);
+  }
+
+  // tiles covered by [c - r, c + r] seen at depths za..zb, conservatively
+  static void tileRange(float c, float r, float za, float zb, float tan_half, int tiles, int &t0, int &t1)
+  {
+    const float lo = c - r, hi = c + r;
+    const float ndc_lo = lo / ((lo >= 0.0f ? zb : za) * tan_half);
+    const float ndc_hi = hi / ((hi >= 0.0f ? za : zb) * tan_half);
+    t0 = std::max(0, (int)std::floor((ndc_lo + 1.0f) * 0.5f * tiles));
+    t1 = std::min(tiles - 1, (int)std::floor((ndc_hi + 1.0f) * 0.5f * tiles));
+  }
+
+  void transformLights(const SpotLight *lights, size_t count, const glm::mat4 &view)
+  {
+    for (auto *v : {&apex_x, &apex_y, &apex_z, &axis_x, &axis_y, &axis_z, &cos_angle, &sin_angle, &cone_range,
+                    &bound_x, &bound_y, &bound_z, &bound_r})
+      v->resize(count);
+
+    for (size_t l = 0; l < count; l++)
+    {
+      const glm::vec3 apex = glm::vec3(view * glm::vec4(lights[l].position, 1.0f));
+      const glm::vec3 axis = glm::normalize(glm::vec3(view * glm::vec4(lights[l].direction, 0.0f)));
+      const float c = lights[l].cutOff, s = std::sqrt(std::max(0.0f, 1.0f - c * c));
+      const float range = lights[l].range;
+
+      apex_x[l] = apex.x;
+      apex_y[l] = apex.y;
+      apex_z[l] = apex.z;
+      axis_x[l] = axis.x;
+      axis_y[l] = axis.y;
+      axis_z[l] = axis.z;
+      cos_angle[l] = c;
+      sin_angle[l] = s;
+      cone_range[l] = range;
+
+      // smallest sphere around the cone: the cap circle for wide cones,
+      // otherwise the sphere through the apex and the cap rim
+      glm::vec3 center;
+      float r;
+      if (c < 0.70710678f)
+      {
+        center = apex + axis * (c * range);
+        r = s * range;
+      }
+      else
+      {
+        r = range / (2.0f * c);
+        center = apex + axis * r;
+      }
+      bound_x[l] = center.x;
+      bound_y[l] = center.y;
+      bound_z[l] = center.z;
+      bound_r[l] = r;
+    }
+  }
+
+  // cone of light l against clusters tx0..tx1 of row y in slice z, setting
+  // bit l of each hit cluster's mask in row
+  void testRow(size_t l, int z, int y, int tx0, int tx1, uint64_t *row, size_t words) const
+  {
+    const size_t base = index(0, y, z);
+    const uint64_t bit = 1ull << (l & 63);
+    const size_t word = l >> 6;
+
+#ifdef LIGHT_CLUSTERS_SSE2
+    const __m128 ax = _mm_set1_ps(apex_x[l]), ay = _mm_set1_ps(apex_y[l]), az = _mm_set1_ps(apex_z[l]);
+    const __m128 dx = _mm_set1_ps(axis_x[l]), dy = _mm_set1_ps(axis_y[l]), dz = _mm_set1_ps(axis_z[l]);
+    const __m128 cos_a = _mm_set1_ps(cos_angle[l]), sin_a = _mm_set1_ps(sin_angle[l]);
+    const __m128 range = _mm_set1_ps(cone_range[l]);
+    const __m128 zero = _mm_setzero_ps();
+
+    for (int x = tx0 & ~3; x <= tx1; x += 4)
+    {
+      const size_t c = base + x;
+      const __m128 r = _mm_loadu_ps(&radius[c]);
+      const __m128 vx = _mm_sub_ps(_mm_loadu_ps(&center_x[c]), ax);
+      const __m128 vy = _mm_sub_ps(_mm_loadu_ps(&center_y[c]), ay);
+      const __m128 vz = _mm_sub_ps(_mm_loadu_ps(&center_z[c]), az);
+
+      const __m128 len_sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+      const __m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, dx), _mm_mul_ps(vy, dy)), _mm_mul_ps(vz, dz));
+      const __m128 across = _mm_sqrt_ps(_mm_max_ps(zero, _mm_sub_ps(len_sq, _mm_mul_ps(along, along))));
+
+      // distance from the sphere center to the cone's side
+      const __m128 side = _mm_sub_ps(_mm_mul_ps(cos_a, across), _mm_mul_ps(along, sin_a));
+
+      __m128 hit = _mm_cmple_ps(side, r);
+      hit = _mm_and_ps(hit, _mm_cmple_ps(along, _mm_add_ps(range, r)));
+      hit = _mm_and_ps(hit, _mm_cmpge_ps(along, _mm_sub_ps(zero, r)));
+
+      int mask = _mm_movemask_ps(hit);
+      for (int k = 0; k < 4; k++)
+      {
+        if ((mask >> k & 1) && x + k >= tx0 && x + k <= tx1)
+          row[(size_t)(x + k) * words + word] |= bit;
+      }
+    }
+#else
+    for (int x = tx0; x <= tx1; x++)
+    {
+      const size_t c = base + x;
+      const float vx = center_x[c] - apex_x[l], vy = center_y[c] - apex_y[l], vz = center_z[c] - apex_z[l];
+      const float len_sq = vx * vx + vy * vy + vz * vz;
+      const float along = vx * axis_x[l] + vy * axis_y[l] + vz * axis_z[l];
+      const float across = std::sqrt(std::max(0.0f, len_sq - along * along));
+      const float side = cos_angle[l] * across - along * sin_angle[l];
+      if (side <= radius[c] && along <= cone_range[l] + radius[c] && along >= -radius[c])
+        row[(size_t)x * words + word] |= bit;
+    }
+#endif
+  }
+};
+
+#endif // !LIGHT_CLUSTERS_H
@@ -0,0 +1,97 @@
+#ifndef LOD_SELECTOR_H
+#define LOD_SELECTOR_H
+
+#include <instancing.h>
+#include <mesh.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Picks levels of detail from how large a mesh appears on screen. A level is
+// good enough while its error, projected to pixels at the mesh's depth,
+// stays within LOD_MAX_PIXELS. Meshes only switch to a coarser level once it
+// is within LOD_HYSTERESIS of that budget, so one sitting on a threshold does
+// not pop back and forth every frame; switching finer happens at once.
+
+#define LOD_MAX_PIXELS 1.0f
+#define LOD_HYSTERESIS 0.7f
+
+class LodSelector
+{
+public:
+  // the perspective projection and the height of the viewport it fills
+  void setProjection(const glm::mat4 &proj, float viewport_height)
+  {
+    pixels_per_unit = 0.5f * viewport_height * proj[1][1];
+  }
+
+  // level for a mesh whose levels have the given errors (in model units,
+  // growing with the level), seen at view space depth; current is the
+  // level it was drawn with last
+  int select(const float *errors, int level_count, float depth, int current) const
+  {
+    const float scale = pixels_per_unit / std::max(depth, 1e-3f);
+    int fine = 0, coarse = 0;
+    for (int level = 1; level < level_count; level++)
+    {
+      const float pixels = errors[level] * scale;
+      if (pixels <= LOD_MAX_PIXELS)
+        fine = level;
+      if (pixels <= LOD_MAX_PIXELS * LOD_HYSTERESIS)
+        coarse = level;
+    }
+    return std::min(fine, std::max(coarse, current));
+  }
+
+  int select(const MeshLod *lods, int level_count, float depth, int current) const
+  {
+    float errors[MESH_LOD_COUNT];
+    level_count = std::min(level_count, MESH_LOD_COUNT);
+    for (int level = 0; level < level_count; level++)
+      errors[level] = lods[level].error;
+    return select(errors, level_count, depth, current);
+  }
+
+  // choose a level for each of the instances listed in members, whose
+  // meshes' levels have the given errors and are centered on center in
+  // model space, and write the instances to sorted grouped by level; level
+  // l's instances start at first[l] and number count[l]. levels holds every
+  // instance's level from one frame to the next.
+  void sortInstances(const InstanceData *instances, const uint32_t *members, size_t member_count,
+                     const glm::vec3 &center, const float *errors, int level_count, const glm::mat4 &view,
+                     uint8_t *levels, std::vector<InstanceData> &sorted, size_t *first, size_t *count) const
+  {
+    std::fill(count, count + level_count, 0);
+    // depth is the negated view space z
+    const glm::vec4 depth_row = -glm::vec4(view[0][2], view[1][2], view[2][2], view[3][2]);
+    for (size_t m = 0; m < member_count; m++)
+    {
+      const uint32_t i = members[m];
+      const float depth = glm::dot(depth_row, instances[i].model * glm::vec4(center, 1.0f));
+      levels[i] = (uint8_t)select(errors, level_count, depth, levels[i]);
+      count[levels[i]]++;
+    }
+
+    size_t offset = 0;
+    for (int level = 0; level < level_count; level++)
+    {
+      first[level] = offset;
+      offset += count[level];
+    }
+
+    sorted.resize(member_count);
+    size_t fill[MESH_LOD_COUNT];
+    std::copy(first, first + level_count, fill);
+    for (size_t m = 0; m < member_count; m++)
+      sorted[fill[levels[members[m]]]++] = instances[members[m]];
+  }
+
+private:
+  float pixels_per_unit = 1.0f;
+};
+
+#endif // !LOD_SELECTOR_H
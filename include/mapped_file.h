@@ -0,0 +1,103 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+// read-only memory mapping of a whole file, unmapped on destruction
+class MappedFile
+{
+public:
+  MappedFile() = default;
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  MappedFile(MappedFile &&other) noexcept
+      : ptr(std::exchange(other.ptr, nullptr)), len(std::exchange(other.len, 0))
+  {
+  }
+
+  MappedFile &operator=(MappedFile &&other) noexcept
+  {
+    if (this != &other)
+    {
+      close();
+      ptr = std::exchange(other.ptr, nullptr);
+      len = std::exchange(other.len, 0);
+    }
+    return *this;
+  }
+
+  ~MappedFile()
+  {
+    close();
+  }
+
+  // returns false if the file cannot be opened or is empty
+  bool open(const std::string &path)
+  {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+      return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+      ::close(fd);
+      return false;
+    }
+
+    void *addr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+    {
+      return false;
+    }
+
+    ptr = addr;
+    len = (size_t)st.st_size;
+    return true;
+  }
+
+  void close()
+  {
+    if (ptr)
+    {
+      munmap(ptr, len);
+      ptr = nullptr;
+      len = 0;
+    }
+  }
+
+  bool isOpen() const
+  {
+    return ptr != nullptr;
+  }
+
+  const char *data() const
+  {
+    return static_cast<const char *>(ptr);
+  }
+
+  size_t size() const
+  {
+    return len;
+  }
+
+private:
+  void *ptr = nullptr;
+  size_t len = 0;
+};
+
+#endif // !MAPPED_FILE_H
@@ -0,0 +1,285 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <mapped_file.h>
+#include <mesh_optimizer.h>
+#include <mesh_simplifier.h>
+#include <obj.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// interleaved vertex as uploaded to the GPU: one buffer per mesh with all
+// attributes in a single 32 byte stride
+struct Vertex
+{
+  float position[3];
+  float normal[3];
+  float texcoord[2];
+};
+
+static_assert(sizeof(Vertex) == 32, "Vertex must stay tightly packed");
+
+// levels of detail per mesh, the full mesh included
+#define MESH_LOD_COUNT 4
+
+// one level of detail: a range of the mesh's index buffer over the shared
+// vertices
+struct MeshLod
+{
+  uint32_t index_offset;
+  uint32_t index_count;
+  // largest distance the surface moved, in model units
+  float error;
+  uint32_t reserved;
+};
+
+static_assert(sizeof(MeshLod) == 16, "MeshLod is stored in the mesh cache");
+
+// GPU-ready indexed mesh: the interleaved unique vertices plus a triangle
+// index buffer, ready to be handed to glBufferData. The index buffer holds
+// the full mesh followed by its simplified levels of detail. The data either
+// lives in a memory-mapped mesh cache or in storage owned by the mesh itself.
+class Mesh
+{
+public:
+  Mesh() = default;
+
+  Mesh(const Mesh &) = delete;
+  Mesh &operator=(const Mesh &) = delete;
+  Mesh(Mesh &&) = default;
+  Mesh &operator=(Mesh &&) = default;
+
+  // deduplicate the face corners of the obj's first shape into unique
+  // vertices, optimize the triangle order for the vertex cache and overdraw
+  // and simplify the levels of detail
+  static Mesh fromObj(const Obj &obj)
+  {
+    const std::vector<tinyobj::shape_t> &shapes = obj.getShapes();
+    const std::vector<tinyobj::real_t> &positions = obj.getVertices();
+    const std::vector<tinyobj::real_t> &normals = obj.getNormals();
+    const std::vector<tinyobj::real_t> &texcoords = obj.getTexCoords();
+
+    // nothing to draw; the mesh still gets its one, empty, level
+    if (shapes.empty() || shapes[0].mesh.indices.empty())
+    {
+      Mesh mesh;
+      mesh.lod_storage.assign(1, MeshLod{0, 0, 0.0f, 0});
+      mesh.setStreams(nullptr, 0, nullptr, 0, mesh.lod_storage.data(), mesh.lod_storage.size());
+      return mesh;
+    }
+
+    const std::vector<tinyobj::index_t> &corners = shapes[0].mesh.indices;
+    const size_t index_count = corners.size();
+
+    // open addressing table from (position, normal, uv) index tuple to the
+    // unique vertex; keys are compared through the unique corner list
+    std::vector<tinyobj::index_t> unique;
+    std::vector<uint32_t> indices(index_count);
+    size_t capacity = 1;
+    while (capacity < index_count * 2)
+      capacity <<= 1;
+    std::vector<uint32_t> table(capacity, UINT32_MAX);
+
+    for (size_t i = 0; i < index_count; i++)
+    {
+      const tinyobj::index_t &c = corners[i];
+      uint32_t h = (uint32_t)c.vertex_index * 0x9e3779b1u ^ (uint32_t)c.normal_index * 0x85ebca77u ^
+                   (uint32_t)c.texcoord_index * 0xc2b2ae3du;
+      size_t slot = (h ^ (h >> 15)) & (capacity - 1);
+
+      for (;; slot = (slot + 1) & (capacity - 1))
+      {
+        uint32_t id = table[slot];
+        if (id == UINT32_MAX)
+        {
+          id = table[slot] = (uint32_t)unique.size();
+          unique.push_back(c);
+          indices[i] = id;
+          break;
+        }
+        const tinyobj::index_t &u = unique[id];
+        if (u.vertex_index == c.vertex_index && u.normal_index == c.normal_index &&
+            u.texcoord_index == c.texcoord_index)
+        {
+          indices[i] = id;
+          break;
+        }
+      }
+    }
+
+    std::vector<Vertex> vertices(unique.size());
+    for (size_t i = 0; i < unique.size(); i++)
+    {
+      int vid = unique[i].vertex_index;
+      int nid = unique[i].normal_index;
+      int tid = unique[i].texcoord_index;
+
+      // vertex positions
+      vertices[i].position[0] = positions[vid * 3];
+      vertices[i].position[1] = positions[vid * 3 + 1];
+      vertices[i].position[2] = positions[vid * 3 + 2];
+
+      // normal positions; corners without one (index -1) get a zero normal
+      for (int k = 0; k < 3; k++)
+        vertices[i].normal[k] = nid >= 0 ? normals[nid * 3 + k] : 0.0f;
+
+      // texture coordinates, zero when the corner has none
+      for (int k = 0; k < 2; k++)
+        vertices[i].texcoord[k] = tid >= 0 ? texcoords[tid * 2 + k] : 0.0f;
+    }
+
+    optimize_vertex_cache(indices.data(), index_count, vertices.size());
+    optimize_overdraw(indices.data(), index_count, vertices[0].position, sizeof(Vertex) / sizeof(float),
+                      vertices.size());
+    std::vector<uint32_t> order = optimize_vertex_fetch(indices.data(), index_count, vertices.size());
+
+    Mesh mesh;
+    mesh.storage.resize(order.size());
+    for (size_t i = 0; i < order.size(); i++)
+      mesh.storage[i] = vertices[order[i]];
+
+    mesh.index_storage = std::move(indices);
+    mesh.buildLods();
+    mesh.setStreams(mesh.storage.data(), mesh.storage.size(), mesh.index_storage.data(),
+                    mesh.index_storage.size(), mesh.lod_storage.data(), mesh.lod_storage.size());
+    return mesh;
+  }
+
+  // borrow the vertices, the indices of every level and the level table
+  // from a mapped file; the mesh keeps the mapping alive
+  static Mesh fromMapping(MappedFile &&file, size_t offset, size_t vertex_count, size_t index_count,
+                          size_t lod_count)
+  {
+    Mesh mesh;
+    mesh.mapping = std::move(file);
+    const char *base = mesh.mapping.data() + offset;
+    const char *index_base = base + vertex_count * sizeof(Vertex);
+    mesh.setStreams(reinterpret_cast<const Vertex *>(base), vertex_count,
+                    reinterpret_cast<const uint32_t *>(index_base), index_count,
+                    reinterpret_cast<const MeshLod *>(index_base + index_count * sizeof(uint32_t)), lod_count);
+    return mesh;
+  }
+
+  const Vertex *getVertices() const
+  {
+    return vertices;
+  }
+
+  // every level's indices, the full mesh first
+  const uint32_t *getIndices() const
+  {
+    return indices;
+  }
+
+  size_t getVertexCount() const
+  {
+    return vertex_count;
+  }
+
+  // indices of the full mesh
+  size_t getIndexCount() const
+  {
+    return lod_count > 0 ? lods[0].index_count : total_index_count;
+  }
+
+  // indices of every level together
+  size_t getTotalIndexCount() const
+  {
+    return total_index_count;
+  }
+
+  size_t getLodCount() const
+  {
+    return lod_count;
+  }
+
+  // level 0 is the full mesh, every further one is coarser
+  const MeshLod &getLod(size_t level) const
+  {
+    return lods[level];
+  }
+
+  const MeshLod *getLods() const
+  {
+    return lods;
+  }
+
+  size_t getVertexBytes() const
+  {
+    return vertex_count * sizeof(Vertex);
+  }
+
+  // the whole index buffer, every level
+  size_t getIndexBytes() const
+  {
+    return total_index_count * sizeof(uint32_t);
+  }
+
+  bool isMapped() const
+  {
+    return mapping.isOpen();
+  }
+
+private:
+  MappedFile mapping;
+  std::vector<Vertex> storage;
+  std::vector<uint32_t> index_storage;
+  std::vector<MeshLod> lod_storage;
+
+  const Vertex *vertices = nullptr;
+  const uint32_t *indices = nullptr;
+  const MeshLod *lods = nullptr;
+  size_t vertex_count = 0;
+  size_t total_index_count = 0;
+  size_t lod_count = 0;
+
+  void setStreams(const Vertex *vertex_base, size_t num_vertices, const uint32_t *index_base, size_t num_indices,
+                  const MeshLod *lod_base, size_t num_lods)
+  {
+    vertices = vertex_base;
+    vertex_count = num_vertices;
+    indices = index_base;
+    total_index_count = num_indices;
+    lods = lod_base;
+    lod_count = num_lods;
+  }
+
+  // simplify the full mesh in index_storage to about a third of the
+  // triangles of the level before, each level starting over from the full
+  // mesh so its error is measured against it; the first simplified level
+  // keeps uv seams, the distant ones let them go. A level that would not be
+  // a fifth smaller than the one before reuses its range.
+  void buildLods()
+  {
+    const size_t full_count = index_storage.size();
+    const float *positions = storage[0].position, *normals = storage[0].normal;
+    const size_t stride = sizeof(Vertex) / sizeof(float);
+    simplifier::Simplifier simplifier(positions, normals, stride, storage.size());
+
+    lod_storage.assign(1, MeshLod{0, (uint32_t)full_count, 0.0f, 0});
+    size_t target = full_count;
+    for (int level = 1; level < MESH_LOD_COUNT; level++)
+    {
+      target = target * 3 / 10 / 3 * 3;
+      float error = 0.0f;
+      std::vector<uint32_t> lod = simplifier.simplify(index_storage.data(), full_count, target, 0.05f, &error,
+                                                      level == 1);
+
+      const MeshLod &previous = lod_storage.back();
+      MeshLod next = previous;
+      if (lod.size() * 5 <= (size_t)previous.index_count * 4)
+      {
+        optimize_vertex_cache(lod.data(), lod.size(), storage.size());
+        next.index_offset = (uint32_t)index_storage.size();
+        next.index_count = (uint32_t)lod.size();
+        next.error = std::max(previous.error, error * simplifier.getScale());
+        index_storage.insert(index_storage.end(), lod.begin(), lod.end());
+      }
+      lod_storage.push_back(next);
+    }
+  }
+};
+
+#endif // !MESH_H
@@ -0,0 +1,161 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <cache_source.h>
+#include <mapped_file.h>
+#include <mesh.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// Binary mesh cache written next to each OBJ (<name>.obj.meshcache). It holds
+// the GPU-ready vertex and index streams of Mesh and its level of detail
+// table so later runs can map them instead of parsing the OBJ text and
+// simplifying the mesh again. Bump MESH_CACHE_VERSION whenever the stream
+// layout changes.
+#define MESH_CACHE_VERSION 4
+
+struct MeshCacheHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t vertex_size;
+  uint64_t source_hash;
+  int64_t source_mtime;
+  uint64_t source_size;
+  uint64_t vertex_count;
+  uint64_t index_count;
+  uint32_t lod_count;
+  uint32_t reserved;
+};
+
+static_assert(sizeof(MeshCacheHeader) == 64, "mesh cache header must keep the vertices 8-byte aligned");
+
+static const char MESH_CACHE_MAGIC[8] = {'T', 'B', 'D', 'M', 'E', 'S', 'H', '\0'};
+
+inline std::string mesh_cache_path(const std::string &obj_path)
+{
+  return obj_path + ".meshcache";
+}
+
+// map the cache of obj_path; returns false when it is missing, stale, damaged
+// or was written by another cache version
+inline bool read_mesh_cache(const std::string &obj_path, Mesh &mesh)
+{
+  MappedFile cache;
+  if (!cache.open(mesh_cache_path(obj_path)) || cache.size() < sizeof(MeshCacheHeader))
+  {
+    return false;
+  }
+
+  MeshCacheHeader header;
+  std::memcpy(&header, cache.data(), sizeof(header));
+  if (std::memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != MESH_CACHE_VERSION || header.vertex_size != sizeof(Vertex) || header.lod_count == 0 ||
+      cache.size() != sizeof(header) + header.vertex_count * sizeof(Vertex) +
+                          header.index_count * sizeof(uint32_t) + header.lod_count * sizeof(MeshLod))
+  {
+    return false;
+  }
+
+  const char *lod_base = cache.data() + sizeof(header) + header.vertex_count * sizeof(Vertex) +
+                         header.index_count * sizeof(uint32_t);
+  for (uint32_t i = 0; i < header.lod_count; i++)
+  {
+    MeshLod lod;
+    std::memcpy(&lod, lod_base + i * sizeof(MeshLod), sizeof(lod));
+    if ((uint64_t)lod.index_offset + lod.index_count > header.index_count)
+    {
+      return false;
+    }
+  }
+
+  if (!source_unchanged(obj_path, header.source_mtime, header.source_size, header.source_hash))
+  {
+    return false;
+  }
+
+  // a damaged index block would send the draws outside the vertex buffer
+  const uint32_t *indices =
+      reinterpret_cast<const uint32_t *>(cache.data() + sizeof(header) + header.vertex_count * sizeof(Vertex));
+  for (uint64_t i = 0; i < header.index_count; i++)
+  {
+    if (indices[i] >= header.vertex_count)
+    {
+      return false;
+    }
+  }
+
+  mesh = Mesh::fromMapping(std::move(cache), sizeof(header), header.vertex_count, header.index_count,
+                           header.lod_count);
+  return true;
+}
+
+// write the cache through a temporary file and rename it into place, so a
+// concurrent reader never sees a partial cache
+inline bool write_mesh_cache(const std::string &obj_path, const Mesh &mesh)
+{
+  MeshCacheHeader header = {};
+  std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+  header.version = MESH_CACHE_VERSION;
+  header.vertex_size = sizeof(Vertex);
+  header.vertex_count = mesh.getVertexCount();
+  header.index_count = mesh.getTotalIndexCount();
+  header.lod_count = (uint32_t)mesh.getLodCount();
+  if (!stat_source(obj_path, header.source_mtime, header.source_size) ||
+      !hash_source(obj_path, header.source_hash))
+  {
+    return false;
+  }
+
+  const std::string cache_path = mesh_cache_path(obj_path);
+  const std::string tmp_path = cache_path + ".tmp";
+  {
+    std::ofstream fout(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!fout)
+    {
+      return false;
+    }
+
+    fout.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    fout.write(reinterpret_cast<const char *>(mesh.getVertices()), mesh.getVertexBytes());
+    fout.write(reinterpret_cast<const char *>(mesh.getIndices()), mesh.getIndexBytes());
+    fout.write(reinterpret_cast<const char *>(mesh.getLods()), mesh.getLodCount() * sizeof(MeshLod));
+    if (!fout)
+    {
+      std::remove(tmp_path.c_str());
+      return false;
+    }
+  }
+
+  return std::rename(tmp_path.c_str(), cache_path.c_str()) == 0;
+}
+
+// load the mesh of an OBJ from its cache, or parse the OBJ and write the cache
+inline Mesh load_mesh(const std::string &obj_path, bool *cache_hit = nullptr)
+{
+  Mesh mesh;
+  bool hit = read_mesh_cache(obj_path, mesh);
+
+  if (!hit)
+  {
+    Obj obj(obj_path);
+    mesh = Mesh::fromObj(obj);
+    if (!write_mesh_cache(obj_path, mesh))
+    {
+      std::cout << "Failed to write mesh cache for " << obj_path << std::endl;
+    }
+  }
+
+  if (cache_hit)
+  {
+    *cache_hit = hit;
+  }
+  return mesh;
+}
+
+#endif // !MESH_CACHE_H
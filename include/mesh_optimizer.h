@@ -0,0 +1,352 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Triangle order optimizations for indexed meshes: post-transform vertex
+// cache locality (Forsyth, "Linear-Speed Vertex Cache Optimisation") followed
+// by overdraw reduction (Sander et al., "Fast Triangle Reordering for Vertex
+// Locality and Reduced Overdraw"), plus a FIFO cache simulation to report the
+// resulting vertex shader invocations.
+
+// number of vertex shader invocations of an index buffer on a FIFO
+// post-transform cache of the given size
+inline size_t simulate_vertex_cache(const uint32_t *indices, size_t index_count, size_t vertex_count,
+                                    size_t cache_size = 16)
+{
+  std::vector<size_t> cached_at(vertex_count, 0);
+  size_t misses = 0;
+
+  // a vertex is in the cache while fewer than cache_size misses happened
+  // since it was last loaded
+  for (size_t i = 0; i < index_count; i++)
+  {
+    uint32_t v = indices[i];
+    if (cached_at[v] == 0 || misses - cached_at[v] >= cache_size)
+    {
+      misses++;
+      cached_at[v] = misses;
+    }
+  }
+
+  return misses;
+}
+
+namespace forsyth
+{
+
+const int CACHE_SIZE = 32;
+
+inline float vertex_score(int cache_position, int remaining_valence)
+{
+  if (remaining_valence == 0)
+    return -1.0f;
+
+  float score = 0.0f;
+  if (cache_position >= 0)
+  {
+    if (cache_position < 3)
+    {
+      // the last triangle's vertices get a fixed score so it is not simply
+      // continued as a strip
+      score = 0.75f;
+    }
+    else
+    {
+      const float scale = 1.0f / (CACHE_SIZE - 3);
+      score = std::pow(1.0f - (cache_position - 3) * scale, 1.5f);
+    }
+  }
+
+  // boost vertices with few triangles left so they are finished off
+  score += 2.0f * std::pow((float)remaining_valence, -0.5f);
+  return score;
+}
+
+} // namespace forsyth
+
+// reorder triangles in place for post-transform vertex cache hits
+inline void optimize_vertex_cache(uint32_t *indices, size_t index_count, size_t vertex_count)
+{
+  const size_t tri_count = index_count / 3;
+  if (tri_count == 0)
+    return;
+
+  // vertex -> triangle adjacency
+  std::vector<uint32_t> valence(vertex_count, 0);
+  for (size_t i = 0; i < index_count; i++)
+    valence[indices[i]]++;
+
+  std::vector<uint32_t> offsets(vertex_count + 1, 0);
+  for (size_t v = 0; v < vertex_count; v++)
+    offsets[v + 1] = offsets[v] + valence[v];
+
+  std::vector<uint32_t> adjacency(index_count);
+  std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+  for (size_t t = 0; t < tri_count; t++)
+  {
+    for (size_t k = 0; k < 3; k++)
+      adjacency[fill[indices[t * 3 + k]]++] = (uint32_t)t;
+  }
+
+  std::vector<int> cache_position(vertex_count, -1);
+  std::vector<float> vscore(vertex_count);
+  for (size_t v = 0; v < vertex_count; v++)
+    vscore[v] = forsyth::vertex_score(-1, valence[v]);
+
+  std::vector<float> tscore(tri_count);
+  std::vector<char> emitted(tri_count, 0);
+  for (size_t t = 0; t < tri_count; t++)
+    tscore[t] = vscore[indices[t * 3]] + vscore[indices[t * 3 + 1]] + vscore[indices[t * 3 + 2]];
+
+  std::vector<uint32_t> output;
+  output.reserve(index_count);
+
+  std::vector<uint32_t> cache, next_cache;
+  cache.reserve(forsyth::CACHE_SIZE + 3);
+  next_cache.reserve(forsyth::CACHE_SIZE + 3);
+
+  size_t best = std::max_element(tscore.begin(), tscore.end()) - tscore.begin();
+  size_t scan = 0;
+
+  for (size_t emitted_count = 0; emitted_count < tri_count; emitted_count++)
+  {
+    if (best == SIZE_MAX)
+    {
+      // nothing adjacent to the cache is left; take the next unemitted one
+      while (emitted[scan])
+        scan++;
+      best = scan;
+    }
+
+    const uint32_t *tri = indices + best * 3;
+    emitted[best] = 1;
+    output.insert(output.end(), tri, tri + 3);
+
+    // detach the triangle from its vertices
+    for (size_t k = 0; k < 3; k++)
+    {
+      uint32_t v = tri[k];
+      uint32_t *begin = &adjacency[offsets[v]], *end = begin + valence[v];
+      *std::find(begin, end, (uint32_t)best) = end[-1];
+      valence[v]--;
+    }
+
+    // LRU cache: the triangle's vertices move to the front
+    next_cache.assign(tri, tri + 3);
+    for (uint32_t v : cache)
+    {
+      if (v != tri[0] && v != tri[1] && v != tri[2])
+        next_cache.push_back(v);
+    }
+    for (size_t i = forsyth::CACHE_SIZE; i < next_cache.size(); i++)
+    {
+      cache_position[next_cache[i]] = -1;
+      vscore[next_cache[i]] = forsyth::vertex_score(-1, valence[next_cache[i]]);
+    }
+    if (next_cache.size() > (size_t)forsyth::CACHE_SIZE)
+      next_cache.resize(forsyth::CACHE_SIZE);
+    cache.swap(next_cache);
+
+    for (size_t i = 0; i < cache.size(); i++)
+    {
+      cache_position[cache[i]] = (int)i;
+      vscore[cache[i]] = forsyth::vertex_score((int)i, valence[cache[i]]);
+    }
+
+    // rescore triangles touching the cache and pick the best one
+    best = SIZE_MAX;
+    float best_score = -1.0f;
+    for (uint32_t v : cache)
+    {
+      for (uint32_t a = offsets[v]; a < offsets[v] + valence[v]; a++)
+      {
+        uint32_t t = adjacency[a];
+        const uint32_t *tv = indices + t * 3;
+        tscore[t] = vscore[tv[0]] + vscore[tv[1]] + vscore[tv[2]];
+        if (tscore[t] > best_score)
+        {
+          best_score = tscore[t];
+          best = t;
+        }
+      }
+    }
+  }
+
+  std::copy(output.begin(), output.end(), indices);
+}
+
+// Reorder clusters of the cache-optimized triangle order so outward-facing
+// clusters are drawn first. Clusters are split where the cache flushes and
+// wherever the locality of a run is already within `threshold` of its
+// cluster, so the vertex cache efficiency is kept. `stride` is the distance
+// between consecutive positions in floats.
+inline void optimize_overdraw(uint32_t *indices, size_t index_count, const float *positions, size_t stride,
+                              size_t vertex_count, float threshold = 1.05f, size_t cache_size = 16)
+{
+  const size_t tri_count = index_count / 3;
+  if (tri_count < 2)
+    return;
+
+  // per triangle cache misses on a FIFO cache
+  std::vector<uint8_t> tri_misses(tri_count);
+  {
+    std::vector<size_t> cached_at(vertex_count, 0);
+    size_t misses = 0;
+    for (size_t t = 0; t < tri_count; t++)
+    {
+      uint8_t tm = 0;
+      for (size_t k = 0; k < 3; k++)
+      {
+        uint32_t v = indices[t * 3 + k];
+        if (cached_at[v] == 0 || misses - cached_at[v] >= cache_size)
+        {
+          misses++;
+          tm++;
+          cached_at[v] = misses;
+        }
+      }
+      tri_misses[t] = tm;
+    }
+  }
+
+  // hard boundaries where all three vertices miss, then soft ones inside
+  std::vector<size_t> clusters;
+  for (size_t t = 0; t < tri_count; t++)
+  {
+    if (t == 0 || tri_misses[t] == 3)
+      clusters.push_back(t);
+  }
+  clusters.push_back(tri_count);
+
+  // soft boundaries: a run may become its own cluster once its misses,
+  // simulated from a flushed cache, are within threshold of its cluster's
+  std::vector<size_t> soft;
+  std::vector<size_t> run_stamp(vertex_count, SIZE_MAX), loaded_at(vertex_count, 0);
+  size_t run_id = 0;
+  for (size_t c = 0; c + 1 < clusters.size(); c++)
+  {
+    const size_t begin = clusters[c], end = clusters[c + 1];
+    size_t cluster_misses = 0;
+    for (size_t t = begin; t < end; t++)
+      cluster_misses += tri_misses[t];
+    const float target = (float)cluster_misses / (end - begin) * threshold;
+
+    soft.push_back(begin);
+    size_t run_start = begin, run_misses = 0;
+    run_id++;
+    for (size_t t = begin; t < end; t++)
+    {
+      for (size_t k = 0; k < 3; k++)
+      {
+        uint32_t v = indices[t * 3 + k];
+        if (run_stamp[v] != run_id || run_misses - loaded_at[v] >= cache_size)
+        {
+          run_misses++;
+          run_stamp[v] = run_id;
+          loaded_at[v] = run_misses;
+        }
+      }
+
+      if (t + 1 < end && (float)run_misses / (t + 1 - run_start) <= target)
+      {
+        soft.push_back(t + 1);
+        run_start = t + 1;
+        run_misses = 0;
+        run_id++;
+      }
+    }
+  }
+  soft.push_back(tri_count);
+
+  // area weighted centroid and normal of every cluster
+  const size_t num_clusters = soft.size() - 1;
+  std::vector<double> sort_key(num_clusters);
+  std::vector<double> centroids(num_clusters * 3, 0.0), normals(num_clusters * 3, 0.0);
+  double mesh_centroid[3] = {0.0, 0.0, 0.0}, mesh_area = 0.0;
+
+  for (size_t c = 0; c < num_clusters; c++)
+  {
+    double area_sum = 0.0;
+    for (size_t t = soft[c]; t < soft[c + 1]; t++)
+    {
+      const float *a = positions + indices[t * 3] * stride;
+      const float *b = positions + indices[t * 3 + 1] * stride;
+      const float *d = positions + indices[t * 3 + 2] * stride;
+      double e1[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+      double e2[3] = {d[0] - a[0], d[1] - a[1], d[2] - a[2]};
+      double n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2],
+                     e1[0] * e2[1] - e1[1] * e2[0]};
+      double area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+      for (size_t k = 0; k < 3; k++)
+      {
+        centroids[c * 3 + k] += (a[k] + b[k] + d[k]) / 3.0 * area;
+        normals[c * 3 + k] += n[k];
+      }
+      area_sum += area;
+    }
+
+    for (size_t k = 0; k < 3; k++)
+    {
+      mesh_centroid[k] += centroids[c * 3 + k];
+      centroids[c * 3 + k] /= area_sum > 0.0 ? area_sum : 1.0;
+    }
+    mesh_area += area_sum;
+
+    double len = std::sqrt(normals[c * 3] * normals[c * 3] + normals[c * 3 + 1] * normals[c * 3 + 1] +
+                           normals[c * 3 + 2] * normals[c * 3 + 2]);
+    for (size_t k = 0; k < 3; k++)
+      normals[c * 3 + k] /= len > 0.0 ? len : 1.0;
+  }
+
+  for (size_t k = 0; k < 3; k++)
+    mesh_centroid[k] /= mesh_area > 0.0 ? mesh_area : 1.0;
+
+  for (size_t c = 0; c < num_clusters; c++)
+  {
+    sort_key[c] = 0.0;
+    for (size_t k = 0; k < 3; k++)
+      sort_key[c] += (centroids[c * 3 + k] - mesh_centroid[k]) * normals[c * 3 + k];
+  }
+
+  std::vector<size_t> order(num_clusters);
+  for (size_t c = 0; c < num_clusters; c++)
+    order[c] = c;
+  std::stable_sort(order.begin(), order.end(),
+                   [&sort_key](size_t a, size_t b) { return sort_key[a] > sort_key[b]; });
+
+  std::vector<uint32_t> output;
+  output.reserve(index_count);
+  for (size_t c : order)
+    output.insert(output.end(), indices + soft[c] * 3, indices + soft[c + 1] * 3);
+  std::copy(output.begin(), output.end(), indices);
+}
+
+// renumber vertices in order of first use so vertex fetch walks memory
+// linearly; returns the old index of every new vertex
+inline std::vector<uint32_t> optimize_vertex_fetch(uint32_t *indices, size_t index_count, size_t vertex_count)
+{
+  std::vector<uint32_t> new_index(vertex_count, UINT32_MAX);
+  std::vector<uint32_t> old_index;
+  old_index.reserve(vertex_count);
+
+  for (size_t i = 0; i < index_count; i++)
+  {
+    uint32_t &remapped = new_index[indices[i]];
+    if (remapped == UINT32_MAX)
+    {
+      remapped = (uint32_t)old_index.size();
+      old_index.push_back(indices[i]);
+    }
+    indices[i] = remapped;
+  }
+
+  return old_index;
+}
+
+#endif // !MESH_OPTIMIZER_H
@@ -0,0 +1,571 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Mesh simplification with quadric error metrics (Garland and Heckbert,
+// "Surface Simplification Using Quadric Error Metrics") by half-edge
+// collapses: a vertex only ever moves onto one of its neighbours, so the
+// vertices left keep their exact positions, normals and texture coordinates
+// and every level indexes the original vertex buffer. Vertices that share a
+// position but not their normal or uv (seams) only collapse along the seam,
+// all their copies at once, and vertices on open borders only along the
+// border, so seams do not tear and borders keep their outline. For distant
+// levels the uv seams may be let go: copies that only differ in their uv
+// then collapse like a single vertex, onto whichever copy of the target is
+// nearest in the index buffer, which smears the texture across the seam but
+// still keeps every normal. Meshes whose uv charts split almost every vertex
+// cannot be reduced otherwise.
+
+namespace simplifier
+{
+
+// symmetric 4x4 quadric of area weighted squared plane distances;
+// error(p) = p^T A p + 2 b.p + c, divided by the total weight
+struct Quadric
+{
+  double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+  double b0 = 0, b1 = 0, b2 = 0, c = 0;
+  double weight = 0;
+
+  // plane n.p + d = 0 with a unit normal
+  void addPlane(double nx, double ny, double nz, double d, double w)
+  {
+    a00 += w * nx * nx, a01 += w * nx * ny, a02 += w * nx * nz;
+    a11 += w * ny * ny, a12 += w * ny * nz, a22 += w * nz * nz;
+    b0 += w * nx * d, b1 += w * ny * d, b2 += w * nz * d;
+    c += w * d * d;
+    weight += w;
+  }
+
+  void add(const Quadric &q)
+  {
+    a00 += q.a00, a01 += q.a01, a02 += q.a02, a11 += q.a11, a12 += q.a12, a22 += q.a22;
+    b0 += q.b0, b1 += q.b1, b2 += q.b2, c += q.c;
+    weight += q.weight;
+  }
+
+  // mean squared distance of p to the planes
+  double error(const float *p) const
+  {
+    const double x = p[0], y = p[1], z = p[2];
+    const double e = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                     2.0 * (b0 * x + b1 * y + b2 * z) + c;
+    return weight > 0.0 ? std::abs(e) / weight : 0.0;
+  }
+};
+
+enum VertexKind : uint8_t
+{
+  // interior vertex with a single copy; may collapse onto any neighbour
+  Manifold,
+  // on an open border; only collapses along it
+  Border,
+  // one of two copies on an attribute seam; only collapses along the seam
+  // (or a vertex whose copies only differ in uv, when seams are let go)
+  Seam,
+  // corners, seam ends and anything more tangled stay put
+  Locked
+};
+
+// outgoing edges of every vertex of an index buffer, a -> b for every
+// triangle corner a followed by b
+struct EdgeAdjacency
+{
+  std::vector<uint32_t> offsets, targets;
+
+  void build(const uint32_t *indices, size_t index_count, size_t vertex_count)
+  {
+    offsets.assign(vertex_count + 1, 0);
+    for (size_t i = 0; i < index_count; i++)
+      offsets[indices[i] + 1]++;
+    for (size_t v = 0; v < vertex_count; v++)
+      offsets[v + 1] += offsets[v];
+
+    targets.resize(index_count);
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < index_count; i += 3)
+    {
+      for (int k = 0; k < 3; k++)
+        targets[fill[indices[i + k]]++] = indices[i + (k + 1) % 3];
+    }
+  }
+
+  bool hasEdge(uint32_t a, uint32_t b) const
+  {
+    for (uint32_t e = offsets[a]; e < offsets[a + 1]; e++)
+    {
+      if (targets[e] == b)
+        return true;
+    }
+    return false;
+  }
+};
+
+// triangles around every position, for the flip test
+struct TriangleAdjacency
+{
+  std::vector<uint32_t> offsets, triangles;
+
+  void build(const uint32_t *indices, size_t index_count, const std::vector<uint32_t> &remap)
+  {
+    offsets.assign(remap.size() + 1, 0);
+    for (size_t i = 0; i < index_count; i++)
+      offsets[remap[indices[i]] + 1]++;
+    for (size_t v = 0; v < remap.size(); v++)
+      offsets[v + 1] += offsets[v];
+
+    triangles.resize(index_count);
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < index_count; i++)
+      triangles[fill[remap[indices[i]]]++] = (uint32_t)(i / 3);
+  }
+};
+
+struct Collapse
+{
+  uint32_t from, to;
+  double error;
+};
+
+class Simplifier
+{
+public:
+  // normals, if given, tell uv seams from hard edges; both are stride
+  // floats apart
+  Simplifier(const float *positions, const float *normals, size_t stride, size_t vertex_count)
+      : positions(positions), normals(normals), stride(stride), vertex_count(vertex_count)
+  {
+    buildPositionRemap();
+  }
+
+  // largest extent of the vertices' bounding box, the unit of the errors
+  float getScale() const
+  {
+    return scale;
+  }
+
+  // remove triangles until at most target_index_count indices are left or
+  // the next collapse would move the surface further than max_error (in
+  // units of getScale()); returns the new indices and sets error to the
+  // largest collapse error, relative to getScale(). Without lock_seams
+  // copies that only differ in uv collapse together; this needs normals.
+  std::vector<uint32_t> simplify(const uint32_t *source, size_t index_count, size_t target_index_count,
+                                 float max_error, float *result_error, bool lock_seams = true)
+  {
+    seams_locked = lock_seams || !normals;
+    std::vector<uint32_t> indices(source, source + index_count);
+    adjacency.build(indices.data(), indices.size(), vertex_count);
+    classifyVertices();
+    computeQuadrics(indices);
+
+    const double limit = (double)max_error * scale * max_error * scale;
+    double worst = 0.0;
+
+    std::vector<uint32_t> collapse_remap(vertex_count);
+    std::vector<uint8_t> touched(vertex_count);
+    std::vector<Collapse> candidates;
+
+    while (indices.size() > target_index_count)
+    {
+      adjacency.build(indices.data(), indices.size(), vertex_count);
+      triangles.build(indices.data(), indices.size(), remap);
+      collectCollapses(indices, candidates);
+      std::sort(candidates.begin(), candidates.end(),
+                [](const Collapse &a, const Collapse &b) { return a.error < b.error; });
+
+      for (size_t v = 0; v < vertex_count; v++)
+        collapse_remap[v] = (uint32_t)v;
+      std::fill(touched.begin(), touched.end(), 0);
+
+      // each collapse removes about two triangles; stop the pass once enough
+      // are gone so the cheapest collapses of the next pass see fresh costs
+      const size_t triangles_needed = (indices.size() - target_index_count) / 3;
+      size_t triangles_removed = 0, collapses = 0;
+      for (const Collapse &c : candidates)
+      {
+        if (c.error > limit || triangles_removed >= triangles_needed)
+          break;
+        const uint32_t v = remap[c.from], t = remap[c.to];
+        if (touched[v] || touched[t] || flips(indices, c.from, c.to))
+          continue;
+        if (!collapseWedges(c.from, c.to, collapse_remap))
+          continue;
+
+        quadrics[t].add(quadrics[v]);
+        worst = std::max(worst, c.error);
+        // the triangles around v change shape, so nothing in its ring may
+        // move again this pass
+        for (uint32_t e = triangles.offsets[v]; e < triangles.offsets[v + 1]; e++)
+        {
+          const uint32_t *tri = &indices[triangles.triangles[e] * 3];
+          touched[remap[tri[0]]] = touched[remap[tri[1]]] = touched[remap[tri[2]]] = 1;
+        }
+        triangles_removed += kind[c.from] == Border ? 1 : 2;
+        collapses++;
+      }
+      if (collapses == 0)
+        break;
+
+      // drop the triangles whose corners now share a position
+      size_t write = 0;
+      for (size_t i = 0; i < indices.size(); i += 3)
+      {
+        const uint32_t a = collapse_remap[indices[i]], b = collapse_remap[indices[i + 1]],
+                       c = collapse_remap[indices[i + 2]];
+        if (remap[a] == remap[b] || remap[b] == remap[c] || remap[a] == remap[c])
+          continue;
+        indices[write++] = a;
+        indices[write++] = b;
+        indices[write++] = c;
+      }
+      indices.resize(write);
+    }
+
+    if (result_error)
+      *result_error = scale > 0.0f ? (float)(std::sqrt(worst) / scale) : 0.0f;
+    return indices;
+  }
+
+private:
+  const float *positions;
+  const float *normals;
+  size_t stride;
+  size_t vertex_count;
+  float scale = 0.0f;
+  bool seams_locked = true;
+
+  // first vertex with the same position, and the next copy in a ring
+  std::vector<uint32_t> remap, wedge;
+  std::vector<VertexKind> kind;
+  // per position, indexed by remap
+  std::vector<Quadric> quadrics;
+
+  EdgeAdjacency adjacency;
+  TriangleAdjacency triangles;
+
+  const float *position(uint32_t v) const
+  {
+    return positions + v * stride;
+  }
+
+  void buildPositionRemap()
+  {
+    remap.resize(vertex_count);
+    wedge.resize(vertex_count);
+
+    size_t capacity = 1;
+    while (capacity < vertex_count * 2)
+      capacity <<= 1;
+    std::vector<uint32_t> table(capacity, UINT32_MAX);
+
+    float lo[3] = {INFINITY, INFINITY, INFINITY}, hi[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (uint32_t v = 0; v < vertex_count; v++)
+    {
+      const float *p = position(v);
+      for (int k = 0; k < 3; k++)
+      {
+        lo[k] = std::min(lo[k], p[k]);
+        hi[k] = std::max(hi[k], p[k]);
+      }
+
+      uint32_t bits[3];
+      std::memcpy(bits, p, sizeof(bits));
+      uint32_t h = bits[0] * 0x9e3779b1u ^ bits[1] * 0x85ebca77u ^ bits[2] * 0xc2b2ae3du;
+      size_t slot = (h ^ (h >> 15)) & (capacity - 1);
+      for (;; slot = (slot + 1) & (capacity - 1))
+      {
+        if (table[slot] == UINT32_MAX)
+        {
+          table[slot] = v;
+          remap[v] = v;
+          wedge[v] = v;
+          break;
+        }
+        if (std::memcmp(position(table[slot]), p, sizeof(bits)) == 0)
+        {
+          const uint32_t first = table[slot];
+          remap[v] = first;
+          wedge[v] = wedge[first];
+          wedge[first] = v;
+          break;
+        }
+      }
+    }
+
+    if (vertex_count > 0)
+      scale = std::max(hi[0] - lo[0], std::max(hi[1] - lo[1], hi[2] - lo[2]));
+  }
+
+  // some copy of b has an edge to some copy of a
+  bool positionEdge(uint32_t a, uint32_t b) const
+  {
+    uint32_t wb = b;
+    do
+    {
+      for (uint32_t e = adjacency.offsets[wb]; e < adjacency.offsets[wb + 1]; e++)
+      {
+        if (remap[adjacency.targets[e]] == remap[a])
+          return true;
+      }
+      wb = wedge[wb];
+    } while (wb != b);
+    return false;
+  }
+
+  // open edge in the index buffer: the triangle on the other side does not
+  // exist, or uses other copies of the vertices
+  bool openEdge(uint32_t a, uint32_t b) const
+  {
+    return !adjacency.hasEdge(b, a);
+  }
+
+  void classifyVertices()
+  {
+    kind.assign(vertex_count, Locked);
+    for (uint32_t v = 0; v < vertex_count; v++)
+    {
+      if (remap[v] != v)
+        continue;
+
+      size_t copies = 0, border_edges = 0;
+      bool simple = true, same_normals = true;
+      uint32_t w = v;
+      do
+      {
+        copies++;
+        size_t open = 0;
+        for (uint32_t e = adjacency.offsets[w]; e < adjacency.offsets[w + 1]; e++)
+        {
+          const uint32_t t = adjacency.targets[e];
+          if (!openEdge(w, t))
+            continue;
+          open++;
+          if (!positionEdge(w, t))
+            border_edges++;
+        }
+        // a border or seam runs through the vertex in a single line
+        simple = simple && open <= 1;
+        if (normals)
+          same_normals = same_normals && std::memcmp(normals + w * stride, normals + v * stride, 3 * sizeof(float)) == 0;
+        w = wedge[w];
+      } while (w != v);
+      const bool border = border_edges > 0;
+
+      VertexKind k = Locked;
+      if ((!simple && seams_locked) || adjacency.offsets[v] == adjacency.offsets[v + 1])
+        k = Locked;
+      else if (copies == 1 && border)
+        k = Border;
+      // a single copy with an open edge that other vertices' copies close
+      // is where a seam ends
+      else if (copies == 1)
+        k = hasOpenEdge(v) ? Locked : Manifold;
+      else if (copies == 2 && !border)
+        k = Seam;
+      // letting uv seams go, any copies sharing their normal act as one
+      // vertex, interior or on a simple border
+      if (!seams_locked && copies > 1 && same_normals && border_edges <= 1)
+        k = border ? Border : Manifold;
+
+      w = v;
+      do
+      {
+        kind[w] = k;
+        w = wedge[w];
+      } while (w != v);
+    }
+  }
+
+  bool hasOpenEdge(uint32_t v) const
+  {
+    for (uint32_t e = adjacency.offsets[v]; e < adjacency.offsets[v + 1]; e++)
+    {
+      if (openEdge(v, adjacency.targets[e]))
+        return true;
+    }
+    return false;
+  }
+
+  void computeQuadrics(const std::vector<uint32_t> &indices)
+  {
+    quadrics.assign(vertex_count, Quadric());
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+      const float *p0 = position(indices[i]), *p1 = position(indices[i + 1]), *p2 = position(indices[i + 2]);
+      const double e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+      const double e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+      double n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+      const double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      if (length == 0.0)
+        continue;
+      for (double &c : n)
+        c /= length;
+      const double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+      const double area = 0.5 * length;
+
+      for (int k = 0; k < 3; k++)
+        quadrics[remap[indices[i + k]]].addPlane(n[0], n[1], n[2], d, area);
+
+      // borders also get a plane through the edge perpendicular to the
+      // triangle, so collapses that pull the outline inwards cost error
+      for (int k = 0; k < 3; k++)
+      {
+        const uint32_t a = indices[i + k], b = indices[i + (k + 1) % 3];
+        if (!openEdge(a, b) || positionEdge(a, b))
+          continue;
+        const float *pa = position(a), *pb = position(b);
+        const double edge[3] = {pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2]};
+        double m[3] = {edge[1] * n[2] - edge[2] * n[1], edge[2] * n[0] - edge[0] * n[2],
+                       edge[0] * n[1] - edge[1] * n[0]};
+        const double m_length = std::sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+        if (m_length == 0.0)
+          continue;
+        for (double &c : m)
+          c /= m_length;
+        const double md = -(m[0] * pa[0] + m[1] * pa[1] + m[2] * pa[2]);
+        // weighted like a strip of surface as wide as the edge is long
+        const double w = m_length * m_length * 2.0;
+        quadrics[remap[a]].addPlane(m[0], m[1], m[2], md, w);
+        quadrics[remap[b]].addPlane(m[0], m[1], m[2], md, w);
+      }
+    }
+  }
+
+  bool canCollapse(uint32_t from, uint32_t to) const
+  {
+    switch (kind[from])
+    {
+    case Manifold:
+      return true;
+    case Border:
+      // along the border onto another border or a corner
+      return (kind[to] == Border || kind[to] == Locked) && (!positionEdge(from, to) || !positionEdge(to, from));
+    case Seam:
+      // along the seam, which is open in the index buffer but closed by
+      // the other copies
+      return (kind[to] == Seam || kind[to] == Locked) && (openEdge(from, to) || openEdge(to, from));
+    default:
+      return false;
+    }
+  }
+
+  void collectCollapses(const std::vector<uint32_t> &indices, std::vector<Collapse> &candidates) const
+  {
+    candidates.clear();
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+      for (int k = 0; k < 3; k++)
+      {
+        const uint32_t a = indices[i + k], b = indices[i + (k + 1) % 3];
+        // interior edges show up in two triangles; take them from one
+        if (kind[a] == Manifold && kind[b] == Manifold && a > b)
+          continue;
+
+        Quadric q = quadrics[remap[a]];
+        q.add(quadrics[remap[b]]);
+        const bool ab = canCollapse(a, b), ba = canCollapse(b, a);
+        const double error_ab = ab ? q.error(position(b)) : INFINITY;
+        const double error_ba = ba ? q.error(position(a)) : INFINITY;
+        if (ab && error_ab <= error_ba)
+          candidates.push_back(Collapse{a, b, error_ab});
+        else if (ba)
+          candidates.push_back(Collapse{b, a, error_ba});
+      }
+    }
+  }
+
+  // moving from onto to turns one of the triangles around from over
+  bool flips(const std::vector<uint32_t> &indices, uint32_t from, uint32_t to) const
+  {
+    const uint32_t f = remap[from], t = remap[to];
+    const float *target = position(to);
+    for (uint32_t e = triangles.offsets[f]; e < triangles.offsets[f + 1]; e++)
+    {
+      const uint32_t *tri = &indices[triangles.triangles[e] * 3];
+      if (remap[tri[0]] == t || remap[tri[1]] == t || remap[tri[2]] == t)
+        continue;
+
+      // corner k is the copy of from
+      const int k = remap[tri[0]] == f ? 0 : remap[tri[1]] == f ? 1 : 2;
+      const float *p0 = position(tri[k]), *p1 = position(tri[(k + 1) % 3]), *p2 = position(tri[(k + 2) % 3]);
+      float before[3], after[3];
+      cross(p0, p1, p2, before);
+      cross(target, p1, p2, after);
+      const float dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+      const float len_sq = (before[0] * before[0] + before[1] * before[1] + before[2] * before[2]) *
+                           (after[0] * after[0] + after[1] * after[1] + after[2] * after[2]);
+      // reject flipped and badly sheared triangles
+      if (dot <= 0.0f || dot * dot < 0.0625f * len_sq)
+        return true;
+    }
+    return false;
+  }
+
+  static void cross(const float *p0, const float *p1, const float *p2, float *n)
+  {
+    const float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    const float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+  }
+
+  // point every copy of from at the copy of to it shares an edge with;
+  // false if some copy has none and seams are locked, which leaves the seam
+  // alone
+  bool collapseWedges(uint32_t from, uint32_t to, std::vector<uint32_t> &collapse_remap) const
+  {
+    uint32_t w = from;
+    do
+    {
+      if (seams_locked && adjacentCopy(w, to) == UINT32_MAX)
+        return false;
+      w = wedge[w];
+    } while (w != from);
+
+    do
+    {
+      const uint32_t u = adjacentCopy(w, to);
+      collapse_remap[w] = u == UINT32_MAX ? to : u;
+      w = wedge[w];
+    } while (w != from);
+    return true;
+  }
+
+  // the copy of to that shares an edge with w, if any
+  uint32_t adjacentCopy(uint32_t w, uint32_t to) const
+  {
+    uint32_t u = to;
+    do
+    {
+      if (adjacency.hasEdge(w, u) || adjacency.hasEdge(u, w))
+        return u;
+      u = wedge[u];
+    } while (u != to);
+    return UINT32_MAX;
+  }
+};
+
+} // namespace simplifier
+
+// simplify an indexed triangle list towards target_index_count indices
+// without moving the surface more than max_error, relative to the extent of
+// the positions; positions and normals are stride floats apart. error
+// receives the largest error actually introduced. lock_seams keeps uv seams
+// intact; hard normal edges always are.
+inline std::vector<uint32_t> simplify_mesh(const uint32_t *indices, size_t index_count, const float *positions,
+                                           const float *normals, size_t stride, size_t vertex_count,
+                                           size_t target_index_count, float max_error, float *error = nullptr,
+                                           bool lock_seams = true)
+{
+  simplifier::Simplifier s(positions, normals, stride, vertex_count);
+  return s.simplify(indices, index_count, target_index_count, max_error, error, lock_seams);
+}
+
+#endif // !MESH_SIMPLIFIER_H
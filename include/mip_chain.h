@@ -0,0 +1,415 @@
+#ifndef MIP_CHAIN_H
+#define MIP_CHAIN_H
+
+#include <block_compression.h>
+#include <mapped_file.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if (defined(__SSE2__) || defined(_M_X64)) && !defined(MIP_CHAIN_NO_SIMD)
+#include <emmintrin.h>
+#define MIP_CHAIN_SSE2 1
+#endif
+
+// Full mip chains of 8-bit textures, built on the CPU so they can be cached
+// and uploaded level by level. The color channels are sRGB encoded, so each
+// level is filtered in linear light: the texels are decoded to linear floats
+// once, every level is a 2x2 box filter of the previous one in float, and
+// only the stored copy of each level is encoded back to 8-bit sRGB. Alpha is
+// linear already. A level of odd size folds its last row or column into the
+// one before. The filter and the encoding run one RGBA texel per SSE2
+// register when the compiler targets it; buildScalar() keeps the scalar
+// loops for comparison.
+
+// one level of a chain: where its tightly packed rows start in the pixels
+struct MipLevel
+{
+  uint64_t offset;
+  uint32_t width;
+  uint32_t height;
+};
+
+static_assert(sizeof(MipLevel) == 16, "MipLevel is stored in the texture cache");
+
+namespace mip_detail
+{
+
+// sRGB code to linear, exact per code
+inline const float *srgb_to_linear_table()
+{
+  static const std::vector<float> table = [] {
+    std::vector<float> t(256);
+    for (int i = 0; i < 256; i++)
+    {
+      const float c = i / 255.0f;
+      t[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+    return t;
+  }();
+  return table.data();
+}
+
+#define MIP_ENCODE_STEPS 4096
+
+// linear, quantized to MIP_ENCODE_STEPS - 1 steps, to the nearest sRGB code;
+// finer than one code everywhere but in the darkest few
+inline const uint8_t *linear_to_srgb_table()
+{
+  static const std::vector<uint8_t> table = [] {
+    std::vector<uint8_t> t(MIP_ENCODE_STEPS);
+    for (int i = 0; i < MIP_ENCODE_STEPS; i++)
+    {
+      const float l = i / (float)(MIP_ENCODE_STEPS - 1);
+      const float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+      t[i] = (uint8_t)std::lround(std::min(std::max(c, 0.0f), 1.0f) * 255.0f);
+    }
+    return t;
+  }();
+  return table.data();
+}
+
+// 8-bit texels of channels channels to linear RGBA floats
+inline void decode(const uint8_t *src, size_t texel_count, int channels, float *dst)
+{
+  const float *to_linear = srgb_to_linear_table();
+  const int color_channels = std::min(channels, 3);
+  for (size_t i = 0; i < texel_count; i++, src += channels, dst += 4)
+  {
+    dst[0] = dst[1] = dst[2] = 0.0f;
+    dst[3] = 1.0f;
+    for (int c = 0; c < color_channels; c++)
+      dst[c] = to_linear[src[c]];
+    // grey images spread their one channel over rgb
+    if (color_channels == 1)
+      dst[1] = dst[2] = dst[0];
+    if (channels == 2 || channels == 4)
+      dst[3] = src[channels - 1] / 255.0f;
+  }
+}
+
+// linear RGBA floats back to 8-bit texels of channels channels
+template <bool Simd>
+void encode(const float *src, size_t texel_count, int channels, uint8_t *dst)
+{
+  const uint8_t *to_srgb = linear_to_srgb_table();
+  const int color_channels = std::min(channels, 3);
+  const bool alpha = channels == 2 || channels == 4;
+  for (size_t i = 0; i < texel_count; i++, src += 4, dst += channels)
+  {
+    int steps[4];
+#ifdef MIP_CHAIN_SSE2
+    if (Simd)
+    {
+      const __m128 clamped = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(steps),
+                       _mm_cvtps_epi32(_mm_mul_ps(clamped, _mm_set1_ps(MIP_ENCODE_STEPS - 1))));
+    }
+    else
+#endif
+    {
+      for (int c = 0; c < 4; c++)
+        steps[c] = (int)std::lround(std::min(std::max(src[c], 0.0f), 1.0f) * (MIP_ENCODE_STEPS - 1));
+    }
+    for (int c = 0; c < color_channels; c++)
+      dst[c] = to_srgb[steps[c]];
+    if (alpha)
+      dst[channels - 1] = (uint8_t)std::lround(std::min(std::max(src[3], 0.0f), 1.0f) * 255.0f);
+  }
+}
+
+// 2x2 box filter of a width x height RGBA float level into the next one
+template <bool Simd>
+void downsample(const float *src, uint32_t width, uint32_t height, float *dst)
+{
+  const uint32_t next_width = std::max(1u, width / 2), next_height = std::max(1u, height / 2);
+  for (uint32_t y = 0; y < next_height; y++)
+  {
+    const float *row0 = src + (size_t)std::min(2 * y, height - 1) * width * 4;
+    const float *row1 = src + (size_t)std::min(2 * y + 1, height - 1) * width * 4;
+    // an odd last row or column is averaged into the texel before it
+    const float *row2 = (height & 1) && y == next_height - 1 && height > 1 ? row1 + (size_t)width * 4 : row1;
+    const float row_weight = row2 != row1 ? 1.0f / 3.0f : 0.5f;
+    float *out = dst + (size_t)y * next_width * 4;
+    const float *rows[3] = {row0, row1, row2};
+    const int row_count = row2 != row1 ? 3 : 2;
+    for (uint32_t x = 0; x < next_width; x++, out += 4)
+    {
+      const uint32_t x0 = std::min(2 * x, width - 1) * 4, x1 = std::min(2 * x + 1, width - 1) * 4;
+      const uint32_t columns[3] = {x0, x1, (width & 1) && x == next_width - 1 && width > 1 ? x1 + 4 : x1};
+      const int column_count = columns[2] != x1 ? 3 : 2;
+      const float weight = row_weight * (column_count == 3 ? 1.0f / 3.0f : 0.5f);
+#ifdef MIP_CHAIN_SSE2
+      if (Simd)
+      {
+        __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1)),
+                                _mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1)));
+        // the taps of an odd remainder
+        if (row_count == 3 || column_count == 3)
+        {
+          for (int r = 0; r < row_count; r++)
+          {
+            for (int k = 0; k < column_count; k++)
+            {
+              if (r == 2 || k == 2)
+                sum = _mm_add_ps(sum, _mm_loadu_ps(rows[r] + columns[k]));
+            }
+          }
+        }
+        _mm_storeu_ps(out, _mm_mul_ps(sum, _mm_set1_ps(weight)));
+        continue;
+      }
+#endif
+      for (int c = 0; c < 4; c++)
+      {
+        float sum = 0.0f;
+        for (int r = 0; r < row_count; r++)
+        {
+          for (int k = 0; k < column_count; k++)
+            sum += rows[r][columns[k] + c];
+        }
+        out[c] = sum * weight;
+      }
+    }
+  }
+}
+
+} // namespace mip_detail
+
+// 8-bit texture with every mip level down to 1x1, level 0 first, all in one
+// block of tightly packed rows or of compressed 4x4 blocks. The pixels
+// either live in a memory-mapped texture cache or in storage owned by the
+// chain itself.
+class MipChain
+{
+public:
+  MipChain() = default;
+
+  MipChain(const MipChain &) = delete;
+  MipChain &operator=(const MipChain &) = delete;
+  MipChain(MipChain &&) = default;
+  MipChain &operator=(MipChain &&) = default;
+
+  // number of levels of a full chain down to 1x1
+  static uint32_t levelCount(uint32_t width, uint32_t height)
+  {
+    uint32_t levels = 1;
+    while (width > 1 || height > 1)
+    {
+      width = std::max(1u, width / 2);
+      height = std::max(1u, height / 2);
+      levels++;
+    }
+    return levels;
+  }
+
+  // filter the chain of a width x height image with channels 8-bit channels
+  static MipChain build(const uint8_t *pixels, uint32_t width, uint32_t height, int channels)
+  {
+    return filter<true>(pixels, width, height, channels);
+  }
+
+  // the same without SIMD, for comparison
+  static MipChain buildScalar(const uint8_t *pixels, uint32_t width, uint32_t height, int channels)
+  {
+    return filter<false>(pixels, width, height, channels);
+  }
+
+  // block compress every level of an uncompressed chain, each level split
+  // over num_threads threads (0 picks the hardware concurrency)
+  static MipChain compress(const MipChain &source, BlockFormat format, size_t num_threads = 0)
+  {
+    MipChain chain;
+    chain.channel_count = source.channel_count;
+    chain.format = format;
+    chain.level_storage.assign(source.levels, source.levels + source.level_count);
+    uint64_t bytes = 0;
+    for (MipLevel &level : chain.level_storage)
+    {
+      level.offset = bytes;
+      bytes += level_bytes(format, level.width, level.height, chain.channel_count);
+    }
+    chain.pixel_storage.resize(bytes);
+
+    for (size_t i = 0; i < chain.level_storage.size(); i++)
+    {
+      const MipLevel &level = chain.level_storage[i];
+      compress_level(source.getLevelData(i), level.width, level.height, source.channel_count, format,
+                     &chain.pixel_storage[level.offset], num_threads);
+    }
+
+    chain.setStreams(chain.pixel_storage.data(), chain.pixel_storage.size(), chain.level_storage.data(),
+                     chain.level_storage.size());
+    return chain;
+  }
+
+  // expand a compressed chain back to 8-bit rows, for contexts without
+  // support for its format and for measuring its error
+  static MipChain decompress(const MipChain &source)
+  {
+    MipChain chain;
+    chain.channel_count = source.channel_count;
+    chain.level_storage.assign(source.levels, source.levels + source.level_count);
+    uint64_t bytes = 0;
+    for (MipLevel &level : chain.level_storage)
+    {
+      level.offset = bytes;
+      bytes += level_bytes(BlockFormat::None, level.width, level.height, chain.channel_count);
+    }
+    chain.pixel_storage.resize(bytes);
+
+    for (size_t i = 0; i < chain.level_storage.size(); i++)
+    {
+      const MipLevel &level = chain.level_storage[i];
+      decompress_level(source.getLevelData(i), level.width, level.height, source.format, chain.channel_count,
+                       &chain.pixel_storage[level.offset]);
+    }
+
+    chain.setStreams(chain.pixel_storage.data(), chain.pixel_storage.size(), chain.level_storage.data(),
+                     chain.level_storage.size());
+    return chain;
+  }
+
+  // borrow the level table followed by the pixels from a mapped file; the
+  // chain keeps the mapping alive
+  static MipChain fromMapping(MappedFile &&file, size_t offset, int channels, BlockFormat format,
+                              size_t level_count, size_t pixel_bytes)
+  {
+    MipChain chain;
+    chain.mapping = std::move(file);
+    chain.channel_count = channels;
+    chain.format = format;
+    const char *base = chain.mapping.data() + offset;
+    chain.setStreams(reinterpret_cast<const uint8_t *>(base + level_count * sizeof(MipLevel)), pixel_bytes,
+                     reinterpret_cast<const MipLevel *>(base), level_count);
+    return chain;
+  }
+
+  bool isValid() const
+  {
+    return level_count > 0;
+  }
+
+  // channels of the uncompressed texels
+  int getChannels() const
+  {
+    return channel_count;
+  }
+
+  BlockFormat getFormat() const
+  {
+    return format;
+  }
+
+  uint32_t getWidth() const
+  {
+    return level_count > 0 ? levels[0].width : 0;
+  }
+
+  uint32_t getHeight() const
+  {
+    return level_count > 0 ? levels[0].height : 0;
+  }
+
+  size_t getLevelCount() const
+  {
+    return level_count;
+  }
+
+  const MipLevel &getLevel(size_t level) const
+  {
+    return levels[level];
+  }
+
+  const MipLevel *getLevels() const
+  {
+    return levels;
+  }
+
+  // tightly packed rows or blocks of one level
+  const uint8_t *getLevelData(size_t level) const
+  {
+    return pixels + levels[level].offset;
+  }
+
+  size_t getLevelBytes(size_t level) const
+  {
+    return level_bytes(format, levels[level].width, levels[level].height, channel_count);
+  }
+
+  // every level's pixels together
+  const uint8_t *getPixels() const
+  {
+    return pixels;
+  }
+
+  size_t getPixelBytes() const
+  {
+    return pixel_bytes;
+  }
+
+  bool isMapped() const
+  {
+    return mapping.isOpen();
+  }
+
+private:
+  MappedFile mapping;
+  std::vector<uint8_t> pixel_storage;
+  std::vector<MipLevel> level_storage;
+
+  const uint8_t *pixels = nullptr;
+  const MipLevel *levels = nullptr;
+  size_t pixel_bytes = 0;
+  size_t level_count = 0;
+  int channel_count = 0;
+  BlockFormat format = BlockFormat::None;
+
+  template <bool Simd>
+  static MipChain filter(const uint8_t *texels, uint32_t width, uint32_t height, int channels)
+  {
+    MipChain chain;
+    chain.channel_count = channels;
+    chain.level_storage.resize(levelCount(width, height));
+    uint64_t bytes = 0;
+    for (MipLevel &level : chain.level_storage)
+    {
+      level = MipLevel{bytes, width, height};
+      bytes += (uint64_t)width * height * channels;
+      width = std::max(1u, width / 2);
+      height = std::max(1u, height / 2);
+    }
+    chain.pixel_storage.resize(bytes);
+
+    const MipLevel &base = chain.level_storage[0];
+    std::copy(texels, texels + (size_t)base.width * base.height * channels, chain.pixel_storage.begin());
+
+    std::vector<float> linear((size_t)base.width * base.height * 4), next(linear.size());
+    mip_detail::decode(texels, (size_t)base.width * base.height, channels, linear.data());
+    for (size_t i = 1; i < chain.level_storage.size(); i++)
+    {
+      const MipLevel &from = chain.level_storage[i - 1], &to = chain.level_storage[i];
+      mip_detail::downsample<Simd>(linear.data(), from.width, from.height, next.data());
+      mip_detail::encode<Simd>(next.data(), (size_t)to.width * to.height, channels,
+                               &chain.pixel_storage[to.offset]);
+      linear.swap(next);
+    }
+
+    chain.setStreams(chain.pixel_storage.data(), chain.pixel_storage.size(), chain.level_storage.data(),
+                     chain.level_storage.size());
+    return chain;
+  }
+
+  void setStreams(const uint8_t *pixel_base, size_t num_bytes, const MipLevel *level_base, size_t num_levels)
+  {
+    pixels = pixel_base;
+    pixel_bytes = num_bytes;
+    levels = level_base;
+    level_count = num_levels;
+  }
+};
+
+#endif // !MIP_CHAIN_H
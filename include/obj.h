@@ -2,42 +2,38 @@
 #define OBJ_H
 
 #define TINYOBJLOADER_IMPLEMENTATION
-#define TINYOBJLOADER_USE_DOUBLE
 #include <tiny_obj_loader.h>
+#include <obj_parser.h>
 
 class Obj
 {
 public:
   Obj(const std::string &file_path) : obj_path(file_path)
   {
-    std::string warn, err;
+    std::string err;
 
-    bool bTriangulate = true;
-    bool bSuc = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err,
-                                 obj_path.c_str(), nullptr, bTriangulate);
-
-    if (!bSuc)
+    if (!obj_parser::parse_file(obj_path, attrib, shapes, err))
     {
-      throw std::runtime_error("tinyobj error:" + err);
+      throw std::runtime_error("obj parse error:" + err);
     }
   }
 
-  std::vector<tinyobj::shape_t> getShapes()
+  const std::vector<tinyobj::shape_t> &getShapes() const
   {
     return shapes;
   }
 
-  std::vector<tinyobj::real_t> getVertices()
+  const std::vector<tinyobj::real_t> &getVertices() const
   {
     return attrib.vertices;
   }
 
-  std::vector<tinyobj::real_t> getNormals()
+  const std::vector<tinyobj::real_t> &getNormals() const
   {
     return attrib.normals;
   }
 
-  std::vector<tinyobj::real_t> getTexCoords()
+  const std::vector<tinyobj::real_t> &getTexCoords() const
   {
     return attrib.texcoords;
   }
@@ -46,7 +42,6 @@ private:
   std::string obj_path;
   tinyobj::attrib_t attrib;
   std::vector<tinyobj::shape_t> shapes;
-  std::vector<tinyobj::material_t> materials;
 };
 
 #endif // !OBJ_H
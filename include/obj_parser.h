@@ -0,0 +1,617 @@
+#ifndef OBJ_PARSER_H
+#define OBJ_PARSER_H
+
+#include <mapped_file.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Multi-threaded OBJ parser. The mapped file is split into line-aligned
+// chunks that are parsed in parallel; a second parallel pass resolves
+// relative indices against the vertex counts of the preceding chunks and
+// triangulates exactly like tinyobj::LoadObj. Positions, normals, texture
+// coordinates, `o`/`g` shapes and smoothing groups are produced; materials,
+// vertex colors, lines, points and tags are ignored.
+//
+// Polygons with more than four corners are handed to tinyobj's internal
+// triangulation, so this header is included by obj.h right after the
+// tinyobj implementation rather than on its own.
+
+namespace obj_parser
+{
+
+// chunks smaller than this are not worth a thread
+const size_t MIN_CHUNK_BYTES = 256 * 1024;
+
+struct Chunk
+{
+  const char *begin = nullptr;
+  const char *end = nullptr;
+
+  // pass 1: raw records
+  std::vector<tinyobj::real_t> v, vn, vt;
+  std::vector<int> corners;           // (v, vt, vn) per face corner, -1 when absent
+  std::vector<uint32_t> face_sizes;   // corners per face
+  std::vector<size_t> relative;       // corners holding an index relative to this chunk
+  std::vector<std::pair<size_t, std::string>> groups;   // face where a new shape starts
+  std::vector<std::pair<size_t, unsigned int>> smoothing; // face where a smoothing group starts
+  std::string error;
+  size_t error_line = 0;                 // line within the chunk
+
+  // pass 2: triangulated faces
+  tinyobj::mesh_t mesh;
+  std::vector<size_t> group_triangles; // first triangle of each entry in groups
+  unsigned int smoothing_in = 0;       // smoothing group active at the chunk start
+};
+
+inline bool is_space(char c)
+{
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline const char *skip_space(const char *p, const char *end)
+{
+  while (p < end && is_space(*p))
+    p++;
+  return p;
+}
+
+// parses a decimal number, exactly rounded for up to 19 significant digits
+// and exponents within the range of exactly representable powers of ten;
+// anything else goes through strtod
+inline const char *parse_real(const char *p, const char *end, tinyobj::real_t &out)
+{
+  static const double pow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                 1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+  p = skip_space(p, end);
+  const char *start = p;
+
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+'))
+  {
+    negative = *p == '-';
+    p++;
+  }
+
+  uint64_t mantissa = 0;
+  int digits = 0, exponent = 0;
+  bool any_digit = false;
+
+  for (; p < end && *p >= '0' && *p <= '9'; p++)
+  {
+    any_digit = true;
+    if (digits < 19)
+    {
+      mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+      digits += mantissa != 0;
+    }
+    else
+    {
+      exponent++;
+      digits++;
+    }
+  }
+
+  if (p < end && *p == '.')
+  {
+    for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+    {
+      any_digit = true;
+      if (digits < 19)
+      {
+        mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+        digits += mantissa != 0;
+        exponent--;
+      }
+      else
+      {
+        digits++;
+      }
+    }
+  }
+
+  if (any_digit && p < end && (*p == 'e' || *p == 'E'))
+  {
+    const char *q = p + 1;
+    bool exp_negative = false;
+    if (q < end && (*q == '-' || *q == '+'))
+    {
+      exp_negative = *q == '-';
+      q++;
+    }
+    if (q < end && *q >= '0' && *q <= '9')
+    {
+      int e = 0;
+      for (; q < end && *q >= '0' && *q <= '9'; q++)
+        e = std::min(e * 10 + (*q - '0'), 100000);
+      exponent += exp_negative ? -e : e;
+      p = q;
+    }
+  }
+
+  if (any_digit && digits <= 19 && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22)
+  {
+    double value = (double)mantissa;
+    value = exponent < 0 ? value / pow10[-exponent] : value * pow10[exponent];
+    out = (tinyobj::real_t)(negative ? -value : value);
+    return p;
+  }
+
+  // slow path: long mantissas, large exponents, inf/nan
+  char buf[128];
+  const char *token_end = start;
+  while (token_end < end && !is_space(*token_end) && *token_end != '\n')
+    token_end++;
+  size_t len = std::min((size_t)(token_end - start), sizeof(buf) - 1);
+  std::memcpy(buf, start, len);
+  buf[len] = '\0';
+
+  char *parsed_end = buf;
+  double value = std::strtod(buf, &parsed_end);
+  if (parsed_end == buf)
+  {
+    out = 0;
+    return start;
+  }
+  out = (tinyobj::real_t)value;
+  return start + (parsed_end - buf);
+}
+
+inline const char *parse_int(const char *p, const char *end, int &out, bool &ok)
+{
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+'))
+  {
+    negative = *p == '-';
+    p++;
+  }
+
+  ok = p < end && *p >= '0' && *p <= '9';
+  int value = 0;
+  for (; p < end && *p >= '0' && *p <= '9'; p++)
+    value = value * 10 + (*p - '0');
+
+  out = negative ? -value : value;
+  return p;
+}
+
+// store the 0-based index of one triple component; `count` is the number of
+// elements of that attribute seen so far in this chunk
+inline bool push_index(Chunk &chunk, int idx, size_t count, bool allow_zero)
+{
+  if (idx > 0)
+  {
+    chunk.corners.push_back(idx - 1);
+    return true;
+  }
+  if (idx == 0)
+  {
+    chunk.corners.push_back(-1);
+    return allow_zero;
+  }
+
+  // negative index: relative to the elements seen so far, which includes the
+  // preceding chunks; resolved in the second pass
+  chunk.relative.push_back(chunk.corners.size());
+  chunk.corners.push_back((int)count + idx);
+  return true;
+}
+
+inline bool parse_face(Chunk &chunk, const char *p, const char *eol)
+{
+  uint32_t size = 0;
+
+  for (p = skip_space(p, eol); p < eol; p = skip_space(p, eol))
+  {
+    int v = 0, vt = 0, vn = 0;
+    bool has_v, has_vt = false, has_vn = false;
+
+    p = parse_int(p, eol, v, has_v);
+    if (!has_v)
+      return false;
+
+    if (p < eol && *p == '/')
+    {
+      p = parse_int(p + 1, eol, vt, has_vt);
+      if (p < eol && *p == '/')
+        p = parse_int(p + 1, eol, vn, has_vn);
+    }
+
+    if (!push_index(chunk, v, chunk.v.size() / 3, false))
+      return false;
+
+    if (has_vt)
+    {
+      if (!push_index(chunk, vt, chunk.vt.size() / 2, true))
+        return false;
+    }
+    else
+      chunk.corners.push_back(-1);
+
+    if (has_vn)
+    {
+      if (!push_index(chunk, vn, chunk.vn.size() / 3, true))
+        return false;
+    }
+    else
+      chunk.corners.push_back(-1);
+
+    // skip anything left of a malformed triple
+    while (p < eol && !is_space(*p))
+      p++;
+    size++;
+  }
+
+  chunk.face_sizes.push_back(size);
+  return true;
+}
+
+// name following a `g` statement, multiple names joined by a single space
+inline std::string parse_group_name(const char *p, const char *eol)
+{
+  std::string name;
+  for (p = skip_space(p, eol); p < eol; p = skip_space(p, eol))
+  {
+    const char *q = p;
+    while (q < eol && !is_space(*q))
+      q++;
+    if (!name.empty())
+      name += ' ';
+    name.append(p, q);
+    p = q;
+  }
+  return name;
+}
+
+inline void parse_chunk(Chunk &chunk)
+{
+  const char *end = chunk.end;
+  size_t line = 0;
+
+  for (const char *p = chunk.begin; p < end; line++)
+  {
+    const char *eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+    if (!eol)
+      eol = end;
+
+    const char *t = skip_space(p, eol);
+    const char *next = eol + 1;
+
+    if (t + 1 < eol && is_space(t[1]))
+    {
+      if (t[0] == 'v')
+      {
+        tinyobj::real_t x = 0, y = 0, z = 0;
+        t = parse_real(t + 2, eol, x);
+        t = parse_real(t, eol, y);
+        parse_real(t, eol, z);
+        chunk.v.push_back(x);
+        chunk.v.push_back(y);
+        chunk.v.push_back(z);
+      }
+      else if (t[0] == 'f')
+      {
+        if (!parse_face(chunk, t + 2, eol))
+        {
+          chunk.error = "Failed to parse `f' line (e.g. a zero value for vertex index)";
+          chunk.error_line = line;
+          return;
+        }
+      }
+      else if (t[0] == 'g')
+      {
+        chunk.groups.emplace_back(chunk.face_sizes.size(), parse_group_name(t + 2, eol));
+      }
+      else if (t[0] == 'o')
+      {
+        const char *name_end = eol;
+        while (name_end > t + 2 && name_end[-1] == '\r')
+          name_end--;
+        chunk.groups.emplace_back(chunk.face_sizes.size(), std::string(t + 2, name_end));
+      }
+      else if (t[0] == 's')
+      {
+        const char *q = skip_space(t + 2, eol);
+        int id = 0;
+        bool ok;
+        if (!(eol - q >= 3 && std::strncmp(q, "off", 3) == 0))
+          parse_int(q, eol, id, ok);
+        chunk.smoothing.emplace_back(chunk.face_sizes.size(), (unsigned int)std::max(id, 0));
+      }
+    }
+    else if (t + 2 < eol && t[0] == 'v' && is_space(t[2]))
+    {
+      if (t[1] == 'n')
+      {
+        tinyobj::real_t x = 0, y = 0, z = 0;
+        t = parse_real(t + 3, eol, x);
+        t = parse_real(t, eol, y);
+        parse_real(t, eol, z);
+        chunk.vn.push_back(x);
+        chunk.vn.push_back(y);
+        chunk.vn.push_back(z);
+      }
+      else if (t[1] == 't')
+      {
+        tinyobj::real_t u = 0, v = 0;
+        t = parse_real(t + 3, eol, u);
+        parse_real(t, eol, v);
+        chunk.vt.push_back(u);
+        chunk.vt.push_back(v);
+      }
+    }
+
+    p = next;
+  }
+}
+
+inline void push_triangle(tinyobj::mesh_t &mesh, const tinyobj::index_t &a, const tinyobj::index_t &b,
+                          const tinyobj::index_t &c, unsigned int smoothing_id)
+{
+  mesh.indices.push_back(a);
+  mesh.indices.push_back(b);
+  mesh.indices.push_back(c);
+  mesh.num_face_vertices.push_back(3);
+  mesh.material_ids.push_back(-1);
+  mesh.smoothing_group_ids.push_back(smoothing_id);
+}
+
+// triangulate the chunk's faces the way tinyobj's exportGroupsToShape does:
+// quads are split along their shorter diagonal and larger polygons are ear
+// clipped by tinyobj itself
+inline void triangulate_chunk(Chunk &chunk, const std::vector<tinyobj::real_t> &v)
+{
+  tinyobj::mesh_t &mesh = chunk.mesh;
+  mesh.indices.reserve(chunk.corners.size() / 3 * 2);
+
+  tinyobj::PrimGroup polygon;
+  polygon.faceGroup.resize(1);
+  std::vector<tinyobj::tag_t> no_tags;
+  tinyobj::shape_t clipped;
+
+  size_t group = 0, smoothing = 0;
+  unsigned int smoothing_id = chunk.smoothing_in;
+  const int *corner = chunk.corners.data();
+
+  for (size_t f = 0; f < chunk.face_sizes.size(); f++)
+  {
+    while (group < chunk.groups.size() && chunk.groups[group].first == f)
+    {
+      chunk.group_triangles.push_back(mesh.num_face_vertices.size());
+      group++;
+    }
+    while (smoothing < chunk.smoothing.size() && chunk.smoothing[smoothing].first == f)
+      smoothing_id = chunk.smoothing[smoothing++].second;
+
+    const uint32_t n = chunk.face_sizes[f];
+    const int *face = corner;
+    corner += n * 3;
+
+    auto index = [face](uint32_t k) {
+      tinyobj::index_t idx;
+      idx.vertex_index = face[k * 3];
+      idx.texcoord_index = face[k * 3 + 1];
+      idx.normal_index = face[k * 3 + 2];
+      return idx;
+    };
+
+    if (n < 3)
+      continue;
+
+    if (n == 3)
+    {
+      push_triangle(mesh, index(0), index(1), index(2), smoothing_id);
+    }
+    else if (n == 4)
+    {
+      const size_t vi[4] = {(size_t)face[0], (size_t)face[3], (size_t)face[6], (size_t)face[9]};
+      if (3 * vi[0] + 2 >= v.size() || 3 * vi[1] + 2 >= v.size() || 3 * vi[2] + 2 >= v.size() ||
+          3 * vi[3] + 2 >= v.size())
+        continue;
+
+      tinyobj::real_t e02x = v[vi[2] * 3] - v[vi[0] * 3];
+      tinyobj::real_t e02y = v[vi[2] * 3 + 1] - v[vi[0] * 3 + 1];
+      tinyobj::real_t e02z = v[vi[2] * 3 + 2] - v[vi[0] * 3 + 2];
+      tinyobj::real_t e13x = v[vi[3] * 3] - v[vi[1] * 3];
+      tinyobj::real_t e13y = v[vi[3] * 3 + 1] - v[vi[1] * 3 + 1];
+      tinyobj::real_t e13z = v[vi[3] * 3 + 2] - v[vi[1] * 3 + 2];
+      tinyobj::real_t sqr02 = e02x * e02x + e02y * e02y + e02z * e02z;
+      tinyobj::real_t sqr13 = e13x * e13x + e13y * e13y + e13z * e13z;
+
+      if (sqr02 < sqr13)
+      {
+        push_triangle(mesh, index(0), index(1), index(2), smoothing_id);
+        push_triangle(mesh, index(0), index(2), index(3), smoothing_id);
+      }
+      else
+      {
+        push_triangle(mesh, index(0), index(1), index(3), smoothing_id);
+        push_triangle(mesh, index(1), index(2), index(3), smoothing_id);
+      }
+    }
+    else
+    {
+      tinyobj::face_t &poly = polygon.faceGroup[0];
+      poly.smoothing_group_id = smoothing_id;
+      poly.vertex_indices.clear();
+      for (uint32_t k = 0; k < n; k++)
+        poly.vertex_indices.emplace_back(face[k * 3], face[k * 3 + 1], face[k * 3 + 2]);
+
+      clipped = tinyobj::shape_t();
+      tinyobj::exportGroupsToShape(&clipped, polygon, no_tags, -1, "", true, v, nullptr);
+      const tinyobj::mesh_t &m = clipped.mesh;
+      mesh.indices.insert(mesh.indices.end(), m.indices.begin(), m.indices.end());
+      mesh.num_face_vertices.insert(mesh.num_face_vertices.end(), m.num_face_vertices.begin(),
+                                    m.num_face_vertices.end());
+      mesh.material_ids.insert(mesh.material_ids.end(), m.material_ids.begin(), m.material_ids.end());
+      mesh.smoothing_group_ids.insert(mesh.smoothing_group_ids.end(), m.smoothing_group_ids.begin(),
+                                      m.smoothing_group_ids.end());
+    }
+  }
+
+  // groups declared after the last face of the chunk
+  for (; group < chunk.groups.size(); group++)
+    chunk.group_triangles.push_back(mesh.num_face_vertices.size());
+}
+
+// run fn(i) for every chunk, one thread per chunk
+template <typename F>
+void for_each_chunk(std::vector<Chunk> &chunks, F fn)
+{
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < chunks.size(); i++)
+    threads.emplace_back(fn, i);
+  fn(0);
+  for (auto &thread : threads)
+    thread.join();
+}
+
+inline void append_mesh(tinyobj::mesh_t &dst, const tinyobj::mesh_t &src, size_t begin, size_t end)
+{
+  dst.indices.insert(dst.indices.end(), src.indices.begin() + begin * 3, src.indices.begin() + end * 3);
+  dst.num_face_vertices.insert(dst.num_face_vertices.end(), src.num_face_vertices.begin() + begin,
+                               src.num_face_vertices.begin() + end);
+  dst.material_ids.insert(dst.material_ids.end(), src.material_ids.begin() + begin,
+                          src.material_ids.begin() + end);
+  dst.smoothing_group_ids.insert(dst.smoothing_group_ids.end(), src.smoothing_group_ids.begin() + begin,
+                                 src.smoothing_group_ids.begin() + end);
+}
+
+// parse a triangulated OBJ from memory; num_threads 0 picks the hardware
+// concurrency
+inline bool parse(const char *data, size_t size, tinyobj::attrib_t &attrib,
+                  std::vector<tinyobj::shape_t> &shapes, std::string &err, size_t num_threads = 0)
+{
+  if (num_threads == 0)
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  const size_t num_chunks = std::max<size_t>(1, std::min(num_threads, size / MIN_CHUNK_BYTES));
+
+  // split at line boundaries
+  std::vector<Chunk> chunks(num_chunks);
+  const char *end = data + size;
+  const char *p = data;
+  for (size_t i = 0; i < num_chunks; i++)
+  {
+    chunks[i].begin = p;
+    const char *split = i + 1 == num_chunks ? end : std::max(p, data + size / num_chunks * (i + 1));
+    const char *eol = static_cast<const char *>(std::memchr(split, '\n', end - split));
+    p = (i + 1 == num_chunks || !eol) ? end : eol + 1;
+    chunks[i].end = p;
+  }
+
+  for_each_chunk(chunks, [&chunks](size_t i) { parse_chunk(chunks[i]); });
+
+  // line numbers are only needed for errors, so count them lazily
+  for (size_t i = 0; i < num_chunks; i++)
+  {
+    if (!chunks[i].error.empty())
+    {
+      size_t line = std::count(data, chunks[i].begin, '\n') + chunks[i].error_line;
+      err = chunks[i].error + ". Line " + std::to_string(line + 1) + ".\n";
+      return false;
+    }
+  }
+
+  // concatenate the attributes and resolve relative indices
+  size_t nv = 0, nvn = 0, nvt = 0;
+  std::vector<size_t> v_offset(num_chunks), vn_offset(num_chunks), vt_offset(num_chunks);
+  for (size_t i = 0; i < num_chunks; i++)
+  {
+    v_offset[i] = nv;
+    vn_offset[i] = nvn;
+    vt_offset[i] = nvt;
+    nv += chunks[i].v.size();
+    nvn += chunks[i].vn.size();
+    nvt += chunks[i].vt.size();
+  }
+
+  attrib = tinyobj::attrib_t();
+  attrib.vertices.resize(nv);
+  attrib.normals.resize(nvn);
+  attrib.texcoords.resize(nvt);
+
+  unsigned int smoothing_id = 0;
+  for (size_t i = 0; i < num_chunks; i++)
+  {
+    chunks[i].smoothing_in = smoothing_id;
+    if (!chunks[i].smoothing.empty())
+      smoothing_id = chunks[i].smoothing.back().second;
+  }
+
+  std::vector<std::string> errors(num_chunks);
+  auto resolve = [&](size_t i) {
+    Chunk &chunk = chunks[i];
+    std::copy(chunk.v.begin(), chunk.v.end(), attrib.vertices.begin() + v_offset[i]);
+    std::copy(chunk.vn.begin(), chunk.vn.end(), attrib.normals.begin() + vn_offset[i]);
+    std::copy(chunk.vt.begin(), chunk.vt.end(), attrib.texcoords.begin() + vt_offset[i]);
+
+    const int offsets[3] = {(int)(v_offset[i] / 3), (int)(vt_offset[i] / 2), (int)(vn_offset[i] / 3)};
+    for (size_t k : chunk.relative)
+    {
+      chunk.corners[k] += offsets[k % 3];
+      if (chunk.corners[k] < 0)
+      {
+        errors[i] = "Failed to parse `f' line (invalid relative vertex index).\n";
+        return;
+      }
+    }
+  };
+  for_each_chunk(chunks, resolve);
+
+  for (const auto &error : errors)
+  {
+    if (!error.empty())
+    {
+      err = error;
+      return false;
+    }
+  }
+
+  for_each_chunk(chunks, [&chunks, &attrib](size_t i) { triangulate_chunk(chunks[i], attrib.vertices); });
+
+  // stitch the chunk meshes into shapes, starting a new one at every `o`/`g`
+  shapes.clear();
+  tinyobj::shape_t shape;
+  for (const Chunk &chunk : chunks)
+  {
+    size_t begin = 0;
+    for (size_t g = 0; g < chunk.groups.size(); g++)
+    {
+      append_mesh(shape.mesh, chunk.mesh, begin, chunk.group_triangles[g]);
+      begin = chunk.group_triangles[g];
+      if (!shape.mesh.indices.empty())
+        shapes.push_back(std::move(shape));
+      shape = tinyobj::shape_t();
+      shape.name = chunk.groups[g].second;
+    }
+    append_mesh(shape.mesh, chunk.mesh, begin, chunk.mesh.num_face_vertices.size());
+  }
+  if (!shape.mesh.indices.empty())
+    shapes.push_back(std::move(shape));
+
+  return true;
+}
+
+inline bool parse_file(const std::string &path, tinyobj::attrib_t &attrib,
+                       std::vector<tinyobj::shape_t> &shapes, std::string &err, size_t num_threads = 0)
+{
+  MappedFile file;
+  if (!file.open(path))
+  {
+    err = "Cannot open file [" + path + "]\n";
+    return false;
+  }
+  return parse(file.data(), file.size(), attrib, shapes, err, num_threads);
+}
+
+} // namespace obj_parser
+
+#endif // !OBJ_PARSER_H
@@ -0,0 +1,245 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+
+#include <gl_state.h>
+#include <hash.h>
+#include <mapped_file.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// On-disk cache of linked shader programs, one file per program in a cache
+// directory (<key>.progcache). A program's key hashes its sources, the
+// defines it was built with and the vendor, renderer and version strings of
+// the driver, so an updated shader or driver simply misses. Loading goes
+// through glProgramBinary, which the driver may still reject, for instance
+// after an update that kept its version string; Shader then compiles the
+// sources and stores the new binary. The entry points are core only from
+// OpenGL 4.1 and the loader is generated for 3.3, so they are resolved by
+// hand where the driver has them (ARB_get_program_binary) and the cache
+// stays disabled otherwise.
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+// bump whenever the file layout changes
+#define PROGRAM_CACHE_VERSION 1
+
+struct ProgramCacheHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t binary_format;
+  uint64_t key;
+  uint64_t binary_size;
+};
+
+static_assert(sizeof(ProgramCacheHeader) == 32, "program cache header is written as is");
+
+static const char PROGRAM_CACHE_MAGIC[8] = {'T', 'B', 'D', 'P', 'R', 'O', 'G', '\0'};
+
+class ProgramCache
+{
+public:
+  typedef void(APIENTRYP GetProgramBinaryProc)(GLuint program, GLsizei buf_size, GLsizei *length,
+                                               GLenum *binary_format, void *binary);
+  typedef void(APIENTRYP ProgramBinaryProc)(GLuint program, GLenum binary_format, const void *binary,
+                                            GLsizei length);
+  typedef void(APIENTRYP ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+
+  // resolve the entry points through the loader the GL functions were loaded
+  // with and keep the binaries in directory; false, leaving the cache
+  // disabled, when the driver cannot hand out program binaries
+  bool init(GLADloadproc load, const std::string &cache_directory = "shaders/cache")
+  {
+    directory = cache_directory;
+    GLint major = 0, minor = 0, formats = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if ((major > 4 || (major == 4 && minor >= 1)) || gl_has_extension("GL_ARB_get_program_binary"))
+    {
+      get_program_binary = (GetProgramBinaryProc)load("glGetProgramBinary");
+      program_binary = (ProgramBinaryProc)load("glProgramBinary");
+      program_parameteri = (ProgramParameteriProc)load("glProgramParameteri");
+      glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    }
+    enabled = get_program_binary && program_binary && program_parameteri && formats > 0;
+
+    driver = std::string(glString(GL_VENDOR)) + '\n' + glString(GL_RENDERER) + '\n' + glString(GL_VERSION) +
+             '\n' + glString(GL_SHADING_LANGUAGE_VERSION);
+    return enabled;
+  }
+
+  bool isEnabled() const
+  {
+    return enabled;
+  }
+
+  // key of a program built from these sources with these defines on this
+  // driver
+  uint64_t key(const std::string &vertex_source, const std::string &fragment_source,
+               const std::string &defines) const
+  {
+    uint64_t hash = fnv1a64(driver);
+    for (const std::string *part : {&vertex_source, &fragment_source, &defines})
+    {
+      // the length keeps moving text between the parts from colliding
+      const uint64_t size = part->size();
+      hash = fnv1a64(&size, sizeof(size), hash);
+      hash = fnv1a64(*part, hash);
+    }
+    return hash;
+  }
+
+  // ask the driver to keep the binary of a program about to be linked
+  void prepare(GLuint program) const
+  {
+    if (enabled)
+      program_parameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+
+  // load the cached binary of key into program; false when there is none or
+  // the driver rejects it, in which case the file is dropped
+  bool load(uint64_t key, GLuint program)
+  {
+    if (!enabled)
+      return false;
+
+    MappedFile file;
+    ProgramCacheHeader header;
+    if (!file.open(path(key)) || file.size() < sizeof(header))
+    {
+      misses++;
+      return false;
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != PROGRAM_CACHE_VERSION || header.key != key ||
+        file.size() != sizeof(header) + header.binary_size)
+    {
+      misses++;
+      return false;
+    }
+
+    program_binary(program, header.binary_format, file.data() + sizeof(header), (GLsizei)header.binary_size);
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked)
+    {
+      rejects++;
+      file.close();
+      std::remove(path(key).c_str());
+      return false;
+    }
+    hits++;
+    return true;
+  }
+
+  // write the binary of a linked program through a temporary file and
+  // rename it into place, so a concurrent reader never sees a partial one
+  bool store(uint64_t key, GLuint program) const
+  {
+    if (!enabled)
+      return false;
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+      return false;
+    std::vector<char> binary(length);
+    ProgramCacheHeader header = {};
+    std::memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic));
+    header.version = PROGRAM_CACHE_VERSION;
+    header.key = key;
+    GLsizei written = 0;
+    GLenum format = 0;
+    get_program_binary(program, length, &written, &format, binary.data());
+    if (written <= 0)
+      return false;
+    header.binary_format = format;
+    header.binary_size = (uint64_t)written;
+
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    const std::string cache_path = path(key);
+    const std::string tmp_path = cache_path + ".tmp";
+    {
+      std::ofstream fout(tmp_path, std::ios::binary | std::ios::trunc);
+      if (!fout)
+        return false;
+      fout.write(reinterpret_cast<const char *>(&header), sizeof(header));
+      fout.write(binary.data(), written);
+      if (!fout)
+      {
+        std::remove(tmp_path.c_str());
+        return false;
+      }
+    }
+    return std::rename(tmp_path.c_str(), cache_path.c_str()) == 0;
+  }
+
+  // remove every cached program, for measuring cold starts
+  void clear() const
+  {
+    std::error_code error;
+    for (const auto &entry : std::filesystem::directory_iterator(directory, error))
+    {
+      if (entry.path().extension() == ".progcache")
+        std::filesystem::remove(entry.path(), error);
+    }
+  }
+
+  // loads that found a binary, found none, and found one the driver refused
+  size_t getHits() const
+  {
+    return hits;
+  }
+
+  size_t getMisses() const
+  {
+    return misses;
+  }
+
+  size_t getRejects() const
+  {
+    return rejects;
+  }
+
+private:
+  GetProgramBinaryProc get_program_binary = nullptr;
+  ProgramBinaryProc program_binary = nullptr;
+  ProgramParameteriProc program_parameteri = nullptr;
+  bool enabled = false;
+  std::string directory;
+  std::string driver;
+  // loads may run on a compile worker while the caller reads these
+  std::atomic<size_t> hits{0};
+  std::atomic<size_t> misses{0};
+  std::atomic<size_t> rejects{0};
+
+  std::string path(uint64_t key) const
+  {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.progcache", (unsigned long long)key);
+    return directory + "/" + name;
+  }
+
+  static const char *glString(GLenum name)
+  {
+    const GLubyte *value = glGetString(name);
+    return value ? reinterpret_cast<const char *>(value) : "";
+  }
+};
+
+#endif // !PROGRAM_CACHE_H
@@ -0,0 +1,159 @@
+#ifndef READBACK_H
+#define READBACK_H
+
+#include <glad/glad.h>
+
+#include <gl_state.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// Asynchronous framebuffer reads through a ring of pixel pack buffers. A
+// request reads the current read framebuffer into the next free buffer and
+// fences it; poll hands every buffer whose fence has signaled to a callback
+// while it is mapped, so nothing on the render thread waits for the GPU.
+
+class ReadbackRing
+{
+public:
+  explicit ReadbackRing(size_t size) : slots(size)
+  {
+  }
+
+  ReadbackRing(const ReadbackRing &) = delete;
+  ReadbackRing &operator=(const ReadbackRing &) = delete;
+
+  ~ReadbackRing()
+  {
+    for (Slot &slot : slots)
+    {
+      if (slot.fence)
+        glDeleteSync(slot.fence);
+      if (slot.pbo)
+        gl_state().deleteBuffers(1, &slot.pbo);
+    }
+  }
+
+  bool hasFreeSlot() const
+  {
+    for (const Slot &slot : slots)
+    {
+      if (!slot.fence)
+        return true;
+    }
+    return false;
+  }
+
+  // read back width x height RGBA pixels, bottom row first, tagged for the
+  // callback; call after the frame's draws and before swapping. Returns
+  // false when every buffer is still in flight.
+  bool request(uint32_t width, uint32_t height, uint64_t tag)
+  {
+    Slot *slot = nullptr;
+    for (Slot &candidate : slots)
+    {
+      if (!candidate.fence)
+      {
+        slot = &candidate;
+        break;
+      }
+    }
+    if (!slot)
+      return false;
+
+    // rgba reads are the driver's fast path; rows are tightly packed
+    const size_t bytes = (size_t)width * height * 4;
+    if (!slot->pbo)
+      glGenBuffers(1, &slot->pbo);
+    gl_state().bindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+    if (slot->capacity < bytes)
+    {
+      glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+      slot->capacity = bytes;
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void *)0);
+    gl_state().bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot->tag = tag;
+    slot->width = width;
+    slot->height = height;
+    return true;
+  }
+
+  // call on_ready(tag, width, height, rgba) for every finished read, oldest
+  // first; the pixels are only valid during the call
+  template <typename F>
+  void poll(F &&on_ready)
+  {
+    collectAll(on_ready, false);
+  }
+
+  // wait for the reads still in flight and hand them over
+  template <typename F>
+  void flush(F &&on_ready)
+  {
+    collectAll(on_ready, true);
+  }
+
+private:
+  struct Slot
+  {
+    GLuint pbo = 0;
+    GLsync fence = 0;
+    size_t capacity = 0;
+    uint64_t tag = 0;
+    uint32_t width = 0, height = 0;
+  };
+
+  std::vector<Slot> slots;
+
+  template <typename F>
+  void collectAll(F &on_ready, bool wait)
+  {
+    for (;;)
+    {
+      // oldest request first, so that consumers see frames in order
+      Slot *oldest = nullptr;
+      for (Slot &slot : slots)
+      {
+        if (slot.fence && (!oldest || slot.tag < oldest->tag))
+          oldest = &slot;
+      }
+      if (!oldest)
+        return;
+
+      const GLenum status = wait ? glClientWaitSync(oldest->fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX)
+                                 : glClientWaitSync(oldest->fence, 0, 0);
+      if (status == GL_TIMEOUT_EXPIRED)
+        return;
+      collect(*oldest, on_ready);
+    }
+  }
+
+  template <typename F>
+  void collect(Slot &slot, F &on_ready)
+  {
+    glDeleteSync(slot.fence);
+    slot.fence = 0;
+
+    const size_t bytes = (size_t)slot.width * slot.height * 4;
+    gl_state().bindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    const void *pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+    if (pixels)
+    {
+      on_ready(slot.tag, slot.width, slot.height, (const uint8_t *)pixels);
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    else
+    {
+      std::cout << "Failed to map read back buffer " << slot.tag << std::endl;
+    }
+    gl_state().bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  }
+};
+
+#endif // !READBACK_H
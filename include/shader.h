@@ -4,79 +4,187 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <gl_state.h>
+#include <program_cache.h>
+
 #include <string>
 #include <fstream>
-#include <sstream>
 #include <iostream>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// includes nested deeper than this are taken for a cycle
+#define SHADER_MAX_INCLUDE_DEPTH 8
+
+// pre-resolved uniform of a Shader, typed by the value it is set with
+template <typename T>
+struct Uniform {
+    int slot = -1;
+
+    bool isValid() const {
+        return slot >= 0;
+    }
+};
+
+// GL types a uniform of type T may be set on
+template <typename T>
+struct UniformType;
+
+template <>
+struct UniformType<bool> {
+    static bool matches(GLenum type) {
+        return type == GL_BOOL || type == GL_INT;
+    }
+};
+
+template <>
+struct UniformType<int> {
+    static bool matches(GLenum type) {
+        // samplers are set with their texture unit
+        return type == GL_INT || type == GL_BOOL || type == GL_SAMPLER_1D || type == GL_SAMPLER_2D ||
+               type == GL_SAMPLER_3D || type == GL_SAMPLER_CUBE || type == GL_SAMPLER_2D_SHADOW ||
+               type == GL_SAMPLER_2D_ARRAY || type == GL_SAMPLER_BUFFER || type == GL_INT_SAMPLER_BUFFER ||
+               type == GL_UNSIGNED_INT_SAMPLER_BUFFER;
+    }
+};
+
+template <>
+struct UniformType<float> {
+    static bool matches(GLenum type) {
+        return type == GL_FLOAT;
+    }
+};
+
+template <>
+struct UniformType<glm::vec2> {
+    static bool matches(GLenum type) {
+        return type == GL_FLOAT_VEC2;
+    }
+};
+
+template <>
+struct UniformType<glm::vec3> {
+    static bool matches(GLenum type) {
+        return type == GL_FLOAT_VEC3;
+    }
+};
+
+template <>
+struct UniformType<glm::vec4> {
+    static bool matches(GLenum type) {
+        return type == GL_FLOAT_VEC4;
+    }
+};
+
+template <>
+struct UniformType<glm::mat2> {
+    static bool matches(GLenum type) {
+        return type == GL_FLOAT_MAT2;
+    }
+};
+
+template <>
+struct UniformType<glm::mat3> {
+    static bool matches(GLenum type) {
+        return type == GL_FLOAT_MAT3;
+    }
+};
+
+template <>
+struct UniformType<glm::mat4> {
+    static bool matches(GLenum type) {
+        return type == GL_FLOAT_MAT4;
+    }
+};
 
 class Shader {
 public:
-    // constructor generates the shader on the fly
-    Shader(const char *vertexPath, const char *fragmentPath) {
-        // retrieve the vertex/fragment source code from filePath
+    // constructor generates the shader on the fly, or loads the linked
+    // program from cache when it holds one for these sources and driver.
+    // Both stages are preprocessed: #include "file" lines are replaced by the
+    // file, found next to the including one, and defines (a block of
+    // "#define NAME VALUE" lines) is inserted after the #version line.
+    // Without wait the compile and link are only issued, so a driver with
+    // KHR_parallel_shader_compile builds the program on its own threads, and
+    // finish() has to be called before the program is used
+    Shader(const char *vertexPath, const char *fragmentPath, ProgramCache *cache = nullptr,
+           const std::string &defines = "", bool wait = true) {
         std::string vertexCode;
         std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        try {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
+        preprocess(vertexPath, defines, vertexCode, 0);
+        preprocess(fragmentPath, defines, fragmentCode, 0);
+
+        ID = glCreateProgram();
+        programCache = cache;
+        if (cache && cache->isEnabled()) {
+            cacheKey = cache->key(vertexCode, fragmentCode, defines);
+            fromCache = cache->load(cacheKey, ID);
         }
-        catch (std::ifstream::failure &e) {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+        if (!fromCache)
+            compile(vertexCode, fragmentCode, cache);
+
+        if (wait)
+            finish();
+    }
+
+    // wait for the link, report compile and link errors, store the program in
+    // the cache and reflect its uniforms; does nothing the second time
+    void finish() {
+        if (finished)
+            return;
+        finished = true;
+
+        if (!fromCache) {
+            checkCompileErrors(vertexShader, "VERTEX");
+            checkCompileErrors(fragmentShader, "FRAGMENT");
+            checkCompileErrors(ID, "PROGRAM");
+
+            // delete the shaders as they're linked into our program now and no longer necessary
+            glDetachShader(ID, vertexShader);
+            glDetachShader(ID, fragmentShader);
+            glDeleteShader(vertexShader);
+            glDeleteShader(fragmentShader);
+
+            GLint linked = GL_FALSE;
+            glGetProgramiv(ID, GL_LINK_STATUS, &linked);
+            if (programCache && linked)
+                programCache->store(cacheKey, ID);
         }
 
-        const char *vShaderCode = vertexCode.c_str();
-        const char *fShaderCode = fragmentCode.c_str();
+        reflectUniforms();
+    }
 
-        // compile shaders
-        unsigned int vertex, fragment;
+    bool isFinished() const {
+        return finished;
+    }
 
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
+    Shader(const Shader &) = delete;
+    Shader &operator=(const Shader &) = delete;
 
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
+    // the program goes with the Shader, so it must not outlive the context;
+    // stages of a build that was never finished go with it
+    ~Shader() {
+        if (!finished) {
+            glDeleteShader(vertexShader);
+            glDeleteShader(fragmentShader);
+        }
+        if (ID)
+            gl_state().deleteProgram(ID);
+    }
 
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+    unsigned int getID() const {
+        return ID;
+    }
 
-        // delete the shaders as they're linked into our program now and no longer necessary
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
+    // whether the program came from the program cache instead of its sources
+    bool isFromCache() const {
+        return fromCache;
     }
 
     // activate the shader
     void use() const {
-        glUseProgram(ID);
+        gl_state().useProgram(ID);
     }
 
     // utility uniform functions
@@ -84,65 +192,282 @@ public:
         return glGetAttribLocation(ID, name.c_str());
     }
 
+    // resolve a uniform once; names are the ones reported by the linker, with
+    // every array element ("lights[2].quadratic") listed. An unknown name or a
+    // type that does not match T gives an invalid handle, which set() ignores
+    template <typename T>
+    Uniform<T> uniform(const std::string &name) const {
+        Uniform<T> handle;
+        auto it = uniformSlots.find(name);
+        if (it == uniformSlots.end())
+            return handle;
+        if (!UniformType<T>::matches(uniforms[it->second].type)) {
+            std::cout << "ERROR::SHADER::UNIFORM_TYPE_MISMATCH: " << name << std::endl;
+            return handle;
+        }
+        handle.slot = it->second;
+        return handle;
+    }
+
+    // typed setters; the program must be in use. Values equal to the last one
+    // set are not uploaded again, the program keeps them
+    void set(Uniform<bool> u, bool value) const {
+        int v = (int) value;
+        if (changed(u.slot, &v, sizeof(v)))
+            glUniform1i(uniforms[u.slot].location, v);
+    }
+
+    void set(Uniform<int> u, int value) const {
+        if (changed(u.slot, &value, sizeof(value)))
+            glUniform1i(uniforms[u.slot].location, value);
+    }
+
+    void set(Uniform<float> u, float value) const {
+        if (changed(u.slot, &value, sizeof(value)))
+            glUniform1f(uniforms[u.slot].location, value);
+    }
+
+    void set(Uniform<glm::vec2> u, const glm::vec2 &value) const {
+        if (changed(u.slot, &value[0], sizeof(value)))
+            glUniform2fv(uniforms[u.slot].location, 1, &value[0]);
+    }
+
+    void set(Uniform<glm::vec3> u, const glm::vec3 &value) const {
+        if (changed(u.slot, &value[0], sizeof(value)))
+            glUniform3fv(uniforms[u.slot].location, 1, &value[0]);
+    }
+
+    void set(Uniform<glm::vec4> u, const glm::vec4 &value) const {
+        if (changed(u.slot, &value[0], sizeof(value)))
+            glUniform4fv(uniforms[u.slot].location, 1, &value[0]);
+    }
+
+    void set(Uniform<glm::mat2> u, const glm::mat2 &mat) const {
+        if (changed(u.slot, &mat[0][0], sizeof(mat)))
+            glUniformMatrix2fv(uniforms[u.slot].location, 1, GL_FALSE, &mat[0][0]);
+    }
+
+    void set(Uniform<glm::mat3> u, const glm::mat3 &mat) const {
+        if (changed(u.slot, &mat[0][0], sizeof(mat)))
+            glUniformMatrix3fv(uniforms[u.slot].location, 1, GL_FALSE, &mat[0][0]);
+    }
+
+    void set(Uniform<glm::mat4> u, const glm::mat4 &mat) const {
+        if (changed(u.slot, &mat[0][0], sizeof(mat)))
+            glUniformMatrix4fv(uniforms[u.slot].location, 1, GL_FALSE, &mat[0][0]);
+    }
+
+    // name based setters, resolved through the reflected table on every call
     void setBool(const std::string &name, bool value) const {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int) value);
+        set(uniform<bool>(name), value);
     }
 
     void setInt(const std::string &name, int value) const {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        set(uniform<int>(name), value);
     }
 
     void setFloat(const std::string &name, float value) const {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        set(uniform<float>(name), value);
     }
 
     void setVec2(const std::string &name, const glm::vec2 &value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        set(uniform<glm::vec2>(name), value);
     }
 
     void setVec2(const std::string &name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        set(uniform<glm::vec2>(name), glm::vec2(x, y));
     }
 
     void setVec3(const std::string &name, const glm::vec3 &value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        set(uniform<glm::vec3>(name), value);
     }
 
     void setVec3(const std::string &name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        set(uniform<glm::vec3>(name), glm::vec3(x, y, z));
     }
 
     void setVec4(const std::string &name, const glm::vec4 &value) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        set(uniform<glm::vec4>(name), value);
     }
 
     void setVec4(const std::string &name, float x, float y, float z, float w) const
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        set(uniform<glm::vec4>(name), glm::vec4(x, y, z, w));
     }
 
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        set(uniform<glm::mat2>(name), mat);
     }
 
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        set(uniform<glm::mat3>(name), mat);
     }
 
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        set(uniform<glm::mat4>(name), mat);
+    }
+
+    // attach a uniform block to a binding point, so programs binding the same
+    // point share one buffer; false if the program has no such block
+    bool bindUniformBlock(const std::string &name, GLuint binding) const {
+        GLuint index = glGetUniformBlockIndex(ID, name.c_str());
+        if (index == GL_INVALID_INDEX)
+            return false;
+        glUniformBlockBinding(ID, index, binding);
+        return true;
+    }
+
+    // glUniform calls issued and skipped because the value was unchanged
+    size_t getUniformUploads() const {
+        return uploads;
+    }
+
+    size_t getUniformSkips() const {
+        return skips;
     }
 
 private:
-    unsigned int ID;
+    // an active uniform and the last value uploaded to it
+    struct UniformSlot {
+        GLint location;
+        GLenum type;
+        bool hasValue;
+        unsigned char value[sizeof(glm::mat4)];
+    };
+
+    unsigned int ID = 0;
+    // stages kept until finish(), for their compile logs
+    unsigned int vertexShader = 0, fragmentShader = 0;
+    ProgramCache *programCache = nullptr;
+    uint64_t cacheKey = 0;
+    bool fromCache = false;
+    bool finished = false;
+    std::unordered_map<std::string, int> uniformSlots;
+    mutable std::vector<UniformSlot> uniforms;
+    mutable size_t uploads = 0;
+    mutable size_t skips = 0;
+
+    // compile both stages and link them into ID; the results are checked by
+    // finish(), so the driver may still be working on them on return
+    void compile(const std::string &vertexCode, const std::string &fragmentCode, const ProgramCache *cache) {
+        const char *vShaderCode = vertexCode.c_str();
+        const char *fShaderCode = fragmentCode.c_str();
+
+        // vertex shader
+        vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertexShader, 1, &vShaderCode, NULL);
+        glCompileShader(vertexShader);
+
+        // fragment Shader
+        fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragmentShader, 1, &fShaderCode, NULL);
+        glCompileShader(fragmentShader);
+
+        // shader Program
+        glAttachShader(ID, vertexShader);
+        glAttachShader(ID, fragmentShader);
+        if (cache)
+            cache->prepare(ID);
+        glLinkProgram(ID);
+    }
+
+    // append the source of path to out, expanding its includes; at depth 0
+    // defines follows the #version line. #line directives keep the line
+    // numbers of compile errors pointing into the file they are in. Includes
+    // are expanded before the GLSL preprocessor runs, so one inside an #if is
+    // still included
+    static bool preprocess(const std::string &path, const std::string &defines, std::string &out, int depth) {
+        std::ifstream file(path);
+        if (!file) {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+            return false;
+        }
+        const std::string directory = path.substr(0, path.find_last_of('/') + 1);
+
+        std::string line;
+        int number = 0;
+        while (std::getline(file, line)) {
+            number++;
+            const size_t first = line.find_first_not_of(" \t");
+            if (first != std::string::npos && line.compare(first, 8, "#include") == 0) {
+                const size_t open = line.find('"', first + 8);
+                const size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+                if (close == std::string::npos || depth >= SHADER_MAX_INCLUDE_DEPTH) {
+                    std::cout << "ERROR::SHADER::BAD_INCLUDE: " << path << ":" << number << ": " << line << std::endl;
+                    return false;
+                }
+                out += "#line 1\n";
+                if (!preprocess(directory + line.substr(open + 1, close - open - 1), "", out, depth + 1))
+                    return false;
+                out += "#line " + std::to_string(number + 1) + "\n";
+                continue;
+            }
+
+            out += line;
+            out += '\n';
+            if (depth == 0 && number == 1 && !defines.empty() && line.compare(0, 8, "#version") == 0) {
+                out += defines;
+                out += "#line 2\n";
+            }
+        }
+        return true;
+    }
+
+    // build the location table of all active uniforms after linking
+    void reflectUniforms() {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+        std::vector<char> buffer(maxLength + 1);
+        for (GLint i = 0; i < count; i++) {
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, i, (GLsizei) buffer.size(), NULL, &size, &type, buffer.data());
+            std::string name = buffer.data();
+
+            // arrays are reported once as "name[0]"; list every element
+            std::string base = name;
+            if (size > 1 && name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+                base = name.substr(0, name.size() - 3);
+
+            for (GLint element = 0; element < size; element++) {
+                std::string elementName = size > 1 ? base + "[" + std::to_string(element) + "]" : name;
+                GLint location = glGetUniformLocation(ID, elementName.c_str());
+                if (location < 0)
+                    continue;
+
+                UniformSlot slot = {location, type, false, {}};
+                uniformSlots[elementName] = (int) uniforms.size();
+                if (element == 0 && elementName != name)
+                    uniformSlots[name] = (int) uniforms.size();
+                uniforms.push_back(slot);
+            }
+        }
+    }
+
+    // compare against the last uploaded value and remember the new one
+    bool changed(int slot, const void *value, size_t size) const {
+        if (slot < 0)
+            return false;
+        UniformSlot &u = uniforms[slot];
+        if (u.hasValue && std::memcmp(u.value, value, size) == 0) {
+            skips++;
+            return false;
+        }
+        std::memcpy(u.value, value, size);
+        u.hasValue = true;
+        uploads++;
+        return true;
+    }
 
     // utility function for checking shader compilation/linking errors.
     static void checkCompileErrors(unsigned int shader, const std::string& type) {
@@ -0,0 +1,322 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <gl_state.h>
+#include <program_cache.h>
+#include <shader.h>
+#include <thread_pool.h>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+// Compile-time specializations of the scene's fragment shader. shaders/shader.fs
+// reads its permutation from defines inserted after the #version line; left
+// out they give the generic program, which picks the light path with the
+// bruteForce uniform, loops up to the light count in the Lights block,
+// branches on every light's cone and samples the diffuse texture. A
+// specialized variant bakes those choices in, so the compiler drops the path
+// not taken, sees a constant loop bound and skips the texture fetch of
+// untextured meshes. Variants are compiled the first time they are asked for
+// and kept by their 64-bit permutation key; the program cache keys their
+// binaries by the same defines.
+//
+// prepare() starts a build early, get() waits for it at first use. With
+// KHR_parallel_shader_compile the driver compiles and links on its own
+// threads; without it a worker thread with a context sharing objects with
+// the caller's builds the variants one after the other, so either way they
+// overlap whatever the caller does in between, such as loading assets.
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// which lights a fragment shades, LIGHTING in shader.fs
+enum class LightingPath : uint8_t
+{
+  // either, by the bruteForce uniform
+  Uniform,
+  // the lights binned into the fragment's cluster
+  Clustered,
+  // every light
+  Forward
+};
+
+// how a light's cone is applied, CONE in shader.fs
+enum class ConeShape : uint8_t
+{
+  // lights whose cone or range misses the fragment are skipped
+  Branch,
+  // no branch; the cone fades in over CONE_EDGE past the cut-off
+  Smooth,
+  // point lights, the cut-off is ignored
+  None
+};
+
+// where variants are built
+enum class ShaderCompileMode
+{
+  // at once by prepare(), blocking it
+  Serial,
+  // by the driver's threads, KHR_parallel_shader_compile
+  Parallel,
+  // by a thread with its own shared context
+  Worker
+};
+
+inline const char *shader_compile_mode_name(ShaderCompileMode mode)
+{
+  switch (mode)
+  {
+  case ShaderCompileMode::Serial:
+    return "serial";
+  case ShaderCompileMode::Parallel:
+    return "parallel";
+  case ShaderCompileMode::Worker:
+    return "worker";
+  }
+  return "";
+}
+
+struct ShaderPermutation
+{
+  LightingPath lighting = LightingPath::Uniform;
+  ConeShape cone = ConeShape::Branch;
+  bool textured = true;
+  // lights of the forward path, 0 to read the count from the Lights block
+  uint32_t light_count = 0;
+
+  // bits 0-1 lighting, 2-3 cone, 4 untextured, 16-47 light count; the
+  // generic program is 0
+  uint64_t key() const
+  {
+    return (uint64_t)lighting | (uint64_t)cone << 2 | (uint64_t)!textured << 4 | (uint64_t)light_count << 16;
+  }
+
+  // the #define block shader.fs is built with; empty for the generic program
+  std::string defines() const
+  {
+    std::string block;
+    if (lighting != LightingPath::Uniform)
+      block += "#define LIGHTING " + std::to_string((int)lighting) + "\n";
+    if (cone != ConeShape::Branch)
+      block += "#define CONE " + std::to_string((int)cone) + "\n";
+    if (!textured)
+      block += "#define TEXTURED 0\n";
+    if (light_count > 0)
+      block += "#define LIGHT_COUNT " + std::to_string(light_count) + "\n";
+    return block;
+  }
+
+  // for logs, e.g. "forward/64 smooth untextured"
+  std::string name() const
+  {
+    if (key() == 0)
+      return "generic";
+    static const char *lightings[] = {"uniform", "clustered", "forward"};
+    static const char *cones[] = {"branch", "smooth", "point"};
+    std::string text = lightings[(int)lighting];
+    if (light_count > 0)
+      text += "/" + std::to_string(light_count);
+    text += std::string(" ") + cones[(int)cone];
+    text += textured ? " textured" : " untextured";
+    return text;
+  }
+};
+
+class ShaderVariants
+{
+public:
+  typedef void(APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+
+  ShaderVariants() = default;
+
+  ShaderVariants(const ShaderVariants &) = delete;
+  ShaderVariants &operator=(const ShaderVariants &) = delete;
+
+  ~ShaderVariants()
+  {
+    stopWorker();
+  }
+
+  // the stages every variant is built from; setup runs once on each new
+  // variant, with its program in use, to bind its blocks and samplers
+  void init(const std::string &vertex, const std::string &fragment, ProgramCache *cache,
+            std::function<void(Shader &)> setup)
+  {
+    vertex_path = vertex;
+    fragment_path = fragment;
+    program_cache = cache;
+    setup_variant = std::move(setup);
+  }
+
+  // let the driver build the variants in the background; false, leaving the
+  // mode as it was, without KHR or ARB_parallel_shader_compile
+  bool enableParallel(GLADloadproc load)
+  {
+    const char *names[] = {"glMaxShaderCompilerThreadsKHR", "glMaxShaderCompilerThreadsARB"};
+    const char *extensions[] = {"GL_KHR_parallel_shader_compile", "GL_ARB_parallel_shader_compile"};
+    for (int i = 0; i < 2; i++)
+    {
+      if (!gl_has_extension(extensions[i]))
+        continue;
+      // as many threads as the driver likes
+      auto max_threads = (MaxShaderCompilerThreadsProc)load(names[i]);
+      if (max_threads)
+        max_threads(0xFFFFFFFFu);
+      mode = ShaderCompileMode::Parallel;
+      return true;
+    }
+    return false;
+  }
+
+  // build the variants on a thread of their own; attach makes a context
+  // sharing objects with the caller's current there and detach releases it.
+  // False, leaving the mode as it was, when attach fails
+  bool startWorker(std::function<bool()> attach, std::function<void()> detach)
+  {
+    worker.reset(new ThreadPool(1));
+    if (!worker->submit(attach).get())
+    {
+      worker.reset();
+      return false;
+    }
+    detach_context = std::move(detach);
+    mode = ShaderCompileMode::Worker;
+    return true;
+  }
+
+  // finish the builds still queued on the worker, let go of its context and
+  // join it; due before the context it shares objects with is destroyed
+  void stopWorker()
+  {
+    if (!worker)
+      return;
+    worker->submit([this] {
+      if (detach_context)
+        detach_context();
+    });
+    worker.reset();
+    mode = ShaderCompileMode::Serial;
+  }
+
+  ShaderCompileMode getMode() const
+  {
+    return mode;
+  }
+
+  // start building the variant of permutation unless it already was
+  void prepare(const ShaderPermutation &permutation)
+  {
+    Variant &variant = variants[permutation.key()];
+    if (variant.started)
+      return;
+    variant.started = true;
+
+    const auto begin = std::chrono::steady_clock::now();
+    const std::string defines = permutation.defines();
+    if (mode == ShaderCompileMode::Worker)
+    {
+      Variant *target = &variant;
+      variant.built = worker->submit([this, target, defines] {
+        target->shader.reset(new Shader(vertex_path.c_str(), fragment_path.c_str(), program_cache, defines));
+        // the caller's context sees the finished program once it rebinds it
+        glFinish();
+      });
+    }
+    else
+    {
+      variant.shader.reset(new Shader(vertex_path.c_str(), fragment_path.c_str(), program_cache, defines,
+                                      mode == ShaderCompileMode::Serial));
+    }
+    issue_ms += ms_since(begin);
+  }
+
+  // whether get() would return without waiting for the build
+  bool isReady(const ShaderPermutation &permutation)
+  {
+    auto it = variants.find(permutation.key());
+    if (it == variants.end() || !it->second.started)
+      return false;
+    const Variant &variant = it->second;
+    if (mode == ShaderCompileMode::Worker && !variant.ready)
+      return variant.built.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    if (variant.ready || variant.shader->isFinished())
+      return true;
+    GLint done = GL_FALSE;
+    glGetProgramiv(variant.shader->getID(), GL_COMPLETION_STATUS_KHR, &done);
+    return done == GL_TRUE;
+  }
+
+  // the variant of permutation, built now or waited for if it has not been
+  Shader &get(const ShaderPermutation &permutation)
+  {
+    prepare(permutation);
+    Variant &variant = variants[permutation.key()];
+    if (!variant.ready)
+    {
+      const auto begin = std::chrono::steady_clock::now();
+      if (variant.built.valid())
+        variant.built.get();
+      variant.shader->finish();
+      variant.shader->use();
+      if (setup_variant)
+        setup_variant(*variant.shader);
+      variant.ready = true;
+      wait_ms += ms_since(begin);
+    }
+    return *variant.shader;
+  }
+
+  size_t getVariantCount() const
+  {
+    return variants.size();
+  }
+
+  // time the calling thread spent starting builds, and waiting for them to
+  // finish and setting the variants up
+  double getIssueMs() const
+  {
+    return issue_ms;
+  }
+
+  double getWaitMs() const
+  {
+    return wait_ms;
+  }
+
+private:
+  struct Variant
+  {
+    std::unique_ptr<Shader> shader;
+    // set by the worker once shader is built
+    std::future<void> built;
+    bool started = false;
+    // finished and set up
+    bool ready = false;
+  };
+
+  std::string vertex_path;
+  std::string fragment_path;
+  ProgramCache *program_cache = nullptr;
+  std::function<void(Shader &)> setup_variant;
+  ShaderCompileMode mode = ShaderCompileMode::Serial;
+  std::unique_ptr<ThreadPool> worker;
+  std::function<void()> detach_context;
+  // nodes keep their address, so the worker can fill them in place
+  std::unordered_map<uint64_t, Variant> variants;
+  double issue_ms = 0.0;
+  double wait_ms = 0.0;
+
+  static double ms_since(std::chrono::steady_clock::time_point begin)
+  {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+  }
+};
+
+#endif // !SHADER_VARIANTS_H
@@ -0,0 +1,152 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <glad/glad.h>
+
+#include <gl_state.h>
+#include <mip_chain.h>
+
+#include <algorithm>
+#include <cstddef>
+
+// Uploads mip chains (mip_chain.h) into immutable textures and sets their
+// sampling. glTexStorage2D is core only from OpenGL 4.2 and the loader is
+// generated for 3.3, so it is resolved by hand where the driver has it
+// (ARB_texture_storage); otherwise every level is specified with
+// glTexImage2D and GL_TEXTURE_MAX_LEVEL caps the chain. Anisotropic
+// filtering comes from EXT/ARB_texture_filter_anisotropic when present.
+// Block compressed chains are uploaded as they are where the context has
+// EXT_texture_compression_s3tc, and expanded on the CPU where it does not.
+
+#ifndef GL_TEXTURE_MAX_ANISOTROPY
+#define GL_TEXTURE_MAX_ANISOTROPY 0x84FE
+#define GL_MAX_TEXTURE_MAX_ANISOTROPY 0x84FF
+#endif
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// largest anisotropy asked for; more costs bandwidth for little on our floor
+#define TEXTURE_MAX_ANISOTROPY 8.0f
+
+// how textures are minified, selectable with --texture-filter
+enum class TextureFilter
+{
+  // level 0 only with GL_LINEAR, as the textures were first uploaded
+  Linear,
+  // the full chain with GL_LINEAR_MIPMAP_LINEAR
+  Trilinear,
+  // trilinear plus up to TEXTURE_MAX_ANISOTROPY samples along the slope
+  Anisotropic
+};
+
+inline const char *texture_filter_name(TextureFilter filter)
+{
+  switch (filter)
+  {
+  case TextureFilter::Linear:
+    return "linear";
+  case TextureFilter::Trilinear:
+    return "trilinear";
+  case TextureFilter::Anisotropic:
+    return "anisotropic";
+  }
+  return "";
+}
+
+// what the current context supports, filled by query()
+struct TextureCaps
+{
+  typedef void(APIENTRYP TexStorage2DProc)(GLenum target, GLsizei levels, GLenum internal_format, GLsizei width,
+                                           GLsizei height);
+
+  TexStorage2DProc tex_storage_2d = nullptr;
+  // 1 without anisotropic filtering
+  float max_anisotropy = 1.0f;
+  // BC1 and BC3 textures
+  bool s3tc = false;
+
+  // look up the optional entry points through the loader the GL functions
+  // were loaded with
+  static TextureCaps query(GLADloadproc load)
+  {
+    TextureCaps caps;
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if (major > 4 || (major == 4 && minor >= 2) || gl_has_extension("GL_ARB_texture_storage"))
+      caps.tex_storage_2d = (TexStorage2DProc)load("glTexStorage2D");
+
+    if ((major > 4 || (major == 4 && minor >= 6)) || gl_has_extension("GL_EXT_texture_filter_anisotropic") ||
+        gl_has_extension("GL_ARB_texture_filter_anisotropic"))
+    {
+      GLfloat max_anisotropy = 1.0f;
+      glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY, &max_anisotropy);
+      caps.max_anisotropy = std::max(1.0f, max_anisotropy);
+    }
+    caps.s3tc = gl_has_extension("GL_EXT_texture_compression_s3tc");
+    return caps;
+  }
+};
+
+// upload the levels of chain the filter samples into texture and set its
+// wrapping and filtering; returns the bytes of texture memory uploaded
+inline size_t upload_mip_chain(GLuint texture, const MipChain &chain, TextureFilter filter,
+                               const TextureCaps &caps)
+{
+  if (chain.getFormat() != BlockFormat::None && !caps.s3tc)
+    return upload_mip_chain(texture, MipChain::decompress(chain), filter, caps);
+
+  static const GLenum formats[] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+  static const GLenum internal_formats[] = {GL_R8, GL_RG8, GL_RGB8, GL_RGBA8};
+  const bool compressed = chain.getFormat() != BlockFormat::None;
+  const GLenum format = formats[chain.getChannels() - 1];
+  GLenum internal_format = internal_formats[chain.getChannels() - 1];
+  if (chain.getFormat() == BlockFormat::Bc1)
+    internal_format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+  else if (chain.getFormat() == BlockFormat::Bc3)
+    internal_format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+  const GLsizei levels = filter == TextureFilter::Linear ? 1 : (GLsizei)chain.getLevelCount();
+
+  gl_state().bindTexture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                  filter == TextureFilter::Linear ? GL_LINEAR : GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+  if (filter == TextureFilter::Anisotropic && caps.max_anisotropy > 1.0f)
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY,
+                    std::min(caps.max_anisotropy, TEXTURE_MAX_ANISOTROPY));
+
+  // rows of the smaller levels are not 4-byte aligned
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  if (caps.tex_storage_2d)
+    caps.tex_storage_2d(GL_TEXTURE_2D, levels, internal_format, (GLsizei)chain.getWidth(),
+                        (GLsizei)chain.getHeight());
+
+  size_t bytes = 0;
+  for (GLsizei i = 0; i < levels; i++)
+  {
+    const MipLevel &level = chain.getLevel(i);
+    const GLsizei width = (GLsizei)level.width, height = (GLsizei)level.height;
+    const GLsizei size = (GLsizei)chain.getLevelBytes(i);
+    if (compressed && caps.tex_storage_2d)
+      glCompressedTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, width, height, internal_format, size,
+                                chain.getLevelData(i));
+    else if (compressed)
+      glCompressedTexImage2D(GL_TEXTURE_2D, i, internal_format, width, height, 0, size, chain.getLevelData(i));
+    else if (caps.tex_storage_2d)
+      glTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, width, height, format, GL_UNSIGNED_BYTE, chain.getLevelData(i));
+    else
+      glTexImage2D(GL_TEXTURE_2D, i, (GLint)internal_format, width, height, 0, format, GL_UNSIGNED_BYTE,
+                   chain.getLevelData(i));
+    bytes += (size_t)size;
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  return bytes;
+}
+
+#endif // !TEXTURE_H
@@ -0,0 +1,186 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <cache_source.h>
+#include <image.h>
+#include <mapped_file.h>
+#include <mip_chain.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// Binary texture cache written next to each image (<name>.texcache). It holds
+// the decoded, vertically flipped texels of every mip level so later runs
+// can map them instead of decoding the image and filtering the chain again.
+// Block compressed chains are cooked from that one and cached beside it
+// (<name>.bc.texcache), a small KTX-like container: the header, the level
+// table and the blocks of every level ready for glCompressedTexSubImage2D.
+// Bump TEXTURE_CACHE_VERSION whenever the layout, the filter or the encoder
+// changes.
+#define TEXTURE_CACHE_VERSION 2
+
+struct TextureCacheHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t channels;
+  uint64_t source_hash;
+  int64_t source_mtime;
+  uint64_t source_size;
+  uint32_t level_count;
+  // a BlockFormat
+  uint32_t format;
+  uint64_t pixel_bytes;
+};
+
+static_assert(sizeof(TextureCacheHeader) == 56, "texture cache header must keep the level table 8-byte aligned");
+
+static const char TEXTURE_CACHE_MAGIC[8] = {'T', 'B', 'D', 'T', 'E', 'X', '\0', '\0'};
+
+inline std::string texture_cache_path(const std::string &image_path, bool block_compressed = false)
+{
+  return image_path + (block_compressed ? ".bc.texcache" : ".texcache");
+}
+
+// the block format opaque images and ones with alpha are compressed to;
+// others stay uncompressed
+inline BlockFormat block_format_for(int channels)
+{
+  return channels == 4 ? BlockFormat::Bc3 : channels == 3 ? BlockFormat::Bc1 : BlockFormat::None;
+}
+
+// map the cache of image_path; returns false when it is missing, stale or
+// was written by another cache version
+inline bool read_texture_cache(const std::string &image_path, bool block_compressed, MipChain &chain)
+{
+  MappedFile cache;
+  if (!cache.open(texture_cache_path(image_path, block_compressed)) || cache.size() < sizeof(TextureCacheHeader))
+  {
+    return false;
+  }
+
+  TextureCacheHeader header;
+  std::memcpy(&header, cache.data(), sizeof(header));
+  if (std::memcmp(header.magic, TEXTURE_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != TEXTURE_CACHE_VERSION || header.channels < 1 || header.channels > 4 ||
+      header.level_count == 0 || header.format > (uint32_t)BlockFormat::Bc3 ||
+      cache.size() != sizeof(header) + header.level_count * sizeof(MipLevel) + header.pixel_bytes)
+  {
+    return false;
+  }
+
+  const char *level_base = cache.data() + sizeof(header);
+  for (uint32_t i = 0; i < header.level_count; i++)
+  {
+    MipLevel level;
+    std::memcpy(&level, level_base + i * sizeof(MipLevel), sizeof(level));
+    if (level.offset + level_bytes((BlockFormat)header.format, level.width, level.height, (int)header.channels) >
+        header.pixel_bytes)
+    {
+      return false;
+    }
+  }
+
+  if (!source_unchanged(image_path, header.source_mtime, header.source_size, header.source_hash))
+  {
+    return false;
+  }
+
+  chain = MipChain::fromMapping(std::move(cache), sizeof(header), (int)header.channels,
+                                (BlockFormat)header.format, header.level_count, header.pixel_bytes);
+  return true;
+}
+
+// write the cache through a temporary file and rename it into place, so a
+// concurrent reader never sees a partial cache
+inline bool write_texture_cache(const std::string &image_path, const MipChain &chain)
+{
+  TextureCacheHeader header = {};
+  std::memcpy(header.magic, TEXTURE_CACHE_MAGIC, sizeof(header.magic));
+  header.version = TEXTURE_CACHE_VERSION;
+  header.channels = (uint32_t)chain.getChannels();
+  header.level_count = (uint32_t)chain.getLevelCount();
+  header.format = (uint32_t)chain.getFormat();
+  header.pixel_bytes = chain.getPixelBytes();
+  if (!stat_source(image_path, header.source_mtime, header.source_size) ||
+      !hash_source(image_path, header.source_hash))
+  {
+    return false;
+  }
+
+  const std::string cache_path = texture_cache_path(image_path, chain.getFormat() != BlockFormat::None);
+  const std::string tmp_path = cache_path + ".tmp";
+  {
+    std::ofstream fout(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!fout)
+    {
+      return false;
+    }
+
+    fout.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    fout.write(reinterpret_cast<const char *>(chain.getLevels()), chain.getLevelCount() * sizeof(MipLevel));
+    fout.write(reinterpret_cast<const char *>(chain.getPixels()), chain.getPixelBytes());
+    if (!fout)
+    {
+      std::remove(tmp_path.c_str());
+      return false;
+    }
+  }
+
+  return std::rename(tmp_path.c_str(), cache_path.c_str()) == 0;
+}
+
+// load the mip chain of an image from its cache, or decode the image, filter
+// its chain and write the cache; check isValid() for decode failures. With
+// block_compressed the chain is compressed from the uncompressed one, which
+// is cached along the way, unless the image has neither three nor four
+// channels.
+inline MipChain load_texture(const std::string &image_path, bool block_compressed = false,
+                             bool *cache_hit = nullptr)
+{
+  MipChain chain;
+  bool hit = read_texture_cache(image_path, block_compressed, chain);
+
+  if (!hit && block_compressed)
+  {
+    MipChain source = load_texture(image_path);
+    const BlockFormat format = block_format_for(source.getChannels());
+    if (source.isValid() && format != BlockFormat::None)
+    {
+      chain = MipChain::compress(source, format);
+      if (!write_texture_cache(image_path, chain))
+      {
+        std::cout << "Failed to write texture cache for " << image_path << std::endl;
+      }
+    }
+    else
+    {
+      chain = std::move(source);
+    }
+  }
+  else if (!hit)
+  {
+    const Image image = Image::load(image_path);
+    if (image.isValid())
+    {
+      chain = MipChain::build(image.getData(), (uint32_t)image.getWidth(), (uint32_t)image.getHeight(),
+                              image.getChannels());
+      if (!write_texture_cache(image_path, chain))
+      {
+        std::cout << "Failed to write texture cache for " << image_path << std::endl;
+      }
+    }
+  }
+
+  if (cache_hit)
+  {
+    *cache_hit = hit;
+  }
+  return chain;
+}
+
+#endif // !TEXTURE_CACHE_H
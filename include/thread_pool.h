@@ -0,0 +1,90 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// fixed-size pool of worker threads running submitted jobs in FIFO order
+class ThreadPool
+{
+public:
+  explicit ThreadPool(size_t num_threads = std::max(1u, std::thread::hardware_concurrency()))
+  {
+    for (size_t i = 0; i < num_threads; i++)
+    {
+      workers.emplace_back([this] { run(); });
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // finishes the queued jobs before joining the workers
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    cv.notify_all();
+    for (auto &worker : workers)
+    {
+      worker.join();
+    }
+  }
+
+  template <typename F>
+  std::future<std::invoke_result_t<F>> submit(F &&job)
+  {
+    using R = std::invoke_result_t<F>;
+    auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(job));
+    std::future<R> result = task->get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      jobs.emplace([task] { (*task)(); });
+    }
+    cv.notify_one();
+    return result;
+  }
+
+  size_t size() const
+  {
+    return workers.size();
+  }
+
+private:
+  std::vector<std::thread> workers;
+  std::queue<std::function<void()>> jobs;
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool stopping = false;
+
+  void run()
+  {
+    for (;;)
+    {
+      std::function<void()> job;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+        if (jobs.empty())
+        {
+          return;
+        }
+        job = std::move(jobs.front());
+        jobs.pop();
+      }
+      job();
+    }
+  }
+};
+
+#endif // !THREAD_POOL_H
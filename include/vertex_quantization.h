@@ -0,0 +1,276 @@
+#ifndef VERTEX_QUANTIZATION_H
+#define VERTEX_QUANTIZATION_H
+
+#include <mesh.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Compact vertex formats decoded in shaders/shader_compact.vs:
+// - positions as unorm16 relative to the mesh AABB
+// - normals octahedral-encoded in two snorm16 or two snorm8 components
+// - texture coordinates as half floats
+// The 16-bit normal format is 16 bytes per vertex, the 8-bit one 12 bytes,
+// against 32 bytes for Vertex.
+
+enum class NormalEncoding
+{
+  Oct16,
+  Oct8
+};
+
+struct CompactVertex16
+{
+  uint16_t position[4]; // w is padding
+  int16_t normal[2];
+  uint16_t texcoord[2];
+};
+
+struct CompactVertex8
+{
+  uint16_t position[3];
+  int8_t normal[2];
+  uint16_t texcoord[2];
+};
+
+static_assert(sizeof(CompactVertex16) == 16, "CompactVertex16 must stay tightly packed");
+static_assert(sizeof(CompactVertex8) == 12, "CompactVertex8 must stay tightly packed");
+
+struct QuantizedMesh
+{
+  NormalEncoding normal_encoding = NormalEncoding::Oct16;
+  size_t stride = 0;
+  size_t vertex_count = 0;
+  std::vector<uint8_t> vertices;
+
+  // position = offset + unorm16 * scale
+  float position_offset[3] = {0.0f, 0.0f, 0.0f};
+  float position_scale[3] = {1.0f, 1.0f, 1.0f};
+
+  // largest decode errors over all vertices; positions in object units,
+  // normals in degrees
+  float max_position_error = 0.0f;
+  float max_normal_error = 0.0f;
+  float max_texcoord_error = 0.0f;
+};
+
+// IEEE half with round to nearest even; out of range values become infinity
+inline uint16_t float_to_half(float value)
+{
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+
+  const uint32_t sign = (bits >> 16) & 0x8000u;
+  const uint32_t abs = bits & 0x7fffffffu;
+
+  if (abs >= 0x7f800000u)
+    return (uint16_t)(sign | 0x7c00u | (abs > 0x7f800000u ? 0x200u : 0u));
+  if (abs >= 0x477ff000u)
+    return (uint16_t)(sign | 0x7c00u);
+
+  // subnormal halves
+  if (abs < 0x38800000u)
+  {
+    float magnitude;
+    std::memcpy(&magnitude, &abs, sizeof(magnitude));
+    return (uint16_t)(sign | (uint32_t)std::nearbyint(magnitude * 16777216.0f));
+  }
+
+  const uint32_t rounded = abs + 0x0fffu + ((abs >> 13) & 1u);
+  return (uint16_t)(sign | ((rounded - 0x38000000u) >> 13));
+}
+
+inline float half_to_float(uint16_t half)
+{
+  const uint32_t sign = (uint32_t)(half & 0x8000u) << 16;
+  const uint32_t exponent = (half >> 10) & 0x1fu;
+  const uint32_t mantissa = half & 0x3ffu;
+
+  if (exponent == 0)
+  {
+    const float magnitude = mantissa / 16777216.0f;
+    return sign ? -magnitude : magnitude;
+  }
+
+  uint32_t bits;
+  if (exponent == 31)
+    bits = sign | 0x7f800000u | (mantissa << 13);
+  else
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+namespace octahedral
+{
+
+// unit vector to the [-1, 1]^2 octahedral square
+inline void encode(const float n[3], float &u, float &v)
+{
+  const float l1 = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+  if (l1 == 0.0f)
+  {
+    u = v = 0.0f;
+    return;
+  }
+
+  u = n[0] / l1;
+  v = n[1] / l1;
+  if (n[2] < 0.0f)
+  {
+    const float x = u, y = v;
+    u = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+    v = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+  }
+}
+
+// same math as oct_decode in shader_compact.vs
+inline void decode(float u, float v, float n[3])
+{
+  n[0] = u;
+  n[1] = v;
+  n[2] = 1.0f - std::fabs(u) - std::fabs(v);
+  const float t = std::max(-n[2], 0.0f);
+  n[0] += n[0] >= 0.0f ? -t : t;
+  n[1] += n[1] >= 0.0f ? -t : t;
+
+  const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+  n[0] /= length;
+  n[1] /= length;
+  n[2] /= length;
+}
+
+inline float angle_degrees(const float a[3], const float b[3])
+{
+  const float la = std::sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+  const float lb = std::sqrt(b[0] * b[0] + b[1] * b[1] + b[2] * b[2]);
+  if (la == 0.0f || lb == 0.0f)
+    return 0.0f;
+  const float c = (a[0] * b[0] + a[1] * b[1] + a[2] * b[2]) / (la * lb);
+  return std::acos(std::min(1.0f, std::max(-1.0f, c))) * (180.0f / 3.14159265f);
+}
+
+// snorm quantization with max = 2^(bits-1) - 1; tries the four neighbouring
+// grid points and keeps the one that decodes closest to n
+inline void encode_snorm(const float n[3], int max, int &qu, int &qv)
+{
+  float u, v;
+  encode(n, u, v);
+
+  const int fu = (int)std::floor(u * max), fv = (int)std::floor(v * max);
+  float best = INFINITY;
+  for (int du = 0; du < 2; du++)
+  {
+    for (int dv = 0; dv < 2; dv++)
+    {
+      const int cu = std::min(max, std::max(-max, fu + du));
+      const int cv = std::min(max, std::max(-max, fv + dv));
+      float d[3];
+      decode((float)cu / max, (float)cv / max, d);
+      const float error = angle_degrees(n, d);
+      if (error < best)
+      {
+        best = error;
+        qu = cu;
+        qv = cv;
+      }
+    }
+  }
+}
+
+} // namespace octahedral
+
+inline uint16_t quantize_unorm16(float value, float offset, float scale)
+{
+  const float t = scale > 0.0f ? (value - offset) / scale : 0.0f;
+  return (uint16_t)std::lround(std::min(1.0f, std::max(0.0f, t)) * 65535.0f);
+}
+
+// encode the vertices of mesh into the compact format and measure the decode
+// error; the index buffer of mesh is reused as is
+inline QuantizedMesh quantize_mesh(const Mesh &mesh, NormalEncoding normal_encoding)
+{
+  QuantizedMesh out;
+  out.normal_encoding = normal_encoding;
+  out.stride = normal_encoding == NormalEncoding::Oct16 ? sizeof(CompactVertex16) : sizeof(CompactVertex8);
+  out.vertex_count = mesh.getVertexCount();
+  out.vertices.resize(out.vertex_count * out.stride);
+
+  const Vertex *vertices = mesh.getVertices();
+  if (out.vertex_count == 0)
+    return out;
+
+  float lo[3], hi[3];
+  for (int k = 0; k < 3; k++)
+    lo[k] = hi[k] = vertices[0].position[k];
+  for (size_t i = 1; i < out.vertex_count; i++)
+  {
+    for (int k = 0; k < 3; k++)
+    {
+      lo[k] = std::min(lo[k], vertices[i].position[k]);
+      hi[k] = std::max(hi[k], vertices[i].position[k]);
+    }
+  }
+  for (int k = 0; k < 3; k++)
+  {
+    out.position_offset[k] = lo[k];
+    out.position_scale[k] = hi[k] - lo[k];
+  }
+
+  const int normal_max = normal_encoding == NormalEncoding::Oct16 ? 32767 : 127;
+
+  for (size_t i = 0; i < out.vertex_count; i++)
+  {
+    const Vertex &v = vertices[i];
+
+    uint16_t position[3];
+    for (int k = 0; k < 3; k++)
+      position[k] = quantize_unorm16(v.position[k], out.position_offset[k], out.position_scale[k]);
+
+    int qu, qv;
+    octahedral::encode_snorm(v.normal, normal_max, qu, qv);
+
+    const uint16_t texcoord[2] = {float_to_half(v.texcoord[0]), float_to_half(v.texcoord[1])};
+
+    uint8_t *dst = &out.vertices[i * out.stride];
+    if (normal_encoding == NormalEncoding::Oct16)
+    {
+      CompactVertex16 c = {{position[0], position[1], position[2], 0},
+                           {(int16_t)qu, (int16_t)qv},
+                           {texcoord[0], texcoord[1]}};
+      std::memcpy(dst, &c, sizeof(c));
+    }
+    else
+    {
+      CompactVertex8 c = {{position[0], position[1], position[2]},
+                          {(int8_t)qu, (int8_t)qv},
+                          {texcoord[0], texcoord[1]}};
+      std::memcpy(dst, &c, sizeof(c));
+    }
+
+    // decode the way the vertex shader does and keep the worst error
+    for (int k = 0; k < 3; k++)
+    {
+      const float decoded = out.position_offset[k] + position[k] / 65535.0f * out.position_scale[k];
+      out.max_position_error = std::max(out.max_position_error, std::fabs(decoded - v.position[k]));
+    }
+
+    float normal[3];
+    octahedral::decode((float)qu / normal_max, (float)qv / normal_max, normal);
+    out.max_normal_error = std::max(out.max_normal_error, octahedral::angle_degrees(v.normal, normal));
+
+    for (int k = 0; k < 2; k++)
+      out.max_texcoord_error =
+          std::max(out.max_texcoord_error, std::fabs(half_to_float(texcoord[k]) - v.texcoord[k]));
+  }
+
+  return out;
+}
+
+#endif // !VERTEX_QUANTIZATION_H
@@ -0,0 +1,239 @@
+#ifndef VIDEO_RECORDER_H
+#define VIDEO_RECORDER_H
+
+#include <thread_pool.h>
+#include <yuv.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <csignal>
+#endif
+
+// Streams RGBA frames, bottom row first as read back from GL, to a .y4m file
+// or as raw I420 frames to the stdin of a command such as ffmpeg. Frames are
+// converted to YUV 4:2:0 on a pool of workers and written in order by a
+// writer thread. When more than a few frames are queued, because the
+// conversion or the sink cannot keep up, new frames are dropped and counted
+// instead of making the caller wait.
+
+class VideoRecorder
+{
+public:
+  explicit VideoRecorder(size_t workers = std::max(1u, std::thread::hardware_concurrency()))
+      : converters(workers), max_queued(workers + 2)
+  {
+  }
+
+  VideoRecorder(const VideoRecorder &) = delete;
+  VideoRecorder &operator=(const VideoRecorder &) = delete;
+
+  ~VideoRecorder()
+  {
+    close();
+  }
+
+  // a .y4m file at path, or with pipe set the command to start and write raw
+  // frames to; width and height are rounded down to even sizes
+  bool open(const std::string &target, bool pipe, uint32_t width, uint32_t height, int fps)
+  {
+    frame_width = width & ~1u;
+    frame_height = height & ~1u;
+    raw = pipe;
+
+    if (pipe)
+    {
+#ifdef _WIN32
+      sink = _popen(target.c_str(), "wb");
+#else
+      // a sink that exits early should end the recording, not the program
+      std::signal(SIGPIPE, SIG_IGN);
+      sink = popen(target.c_str(), "w");
+#endif
+    }
+    else
+    {
+      sink = fopen(target.c_str(), "wb");
+    }
+    if (!sink)
+    {
+      std::cout << "Failed to open " << target << std::endl;
+      return false;
+    }
+
+    if (!raw)
+      fprintf(sink, "YUV4MPEG2 W%u H%u F%d:1 Ip A1:1 C420jpeg\n", frame_width, frame_height, fps);
+    return true;
+  }
+
+  bool isOpen() const
+  {
+    return sink != nullptr;
+  }
+
+  uint32_t getWidth() const
+  {
+    return frame_width;
+  }
+
+  uint32_t getHeight() const
+  {
+    return frame_height;
+  }
+
+  // whether a frame submitted now would be queued rather than dropped
+  bool canAccept() const
+  {
+    return sink && !failed && queued < max_queued;
+  }
+
+  // count a frame the caller skipped, e.g. because canAccept() was false
+  void drop()
+  {
+    dropped++;
+  }
+
+  // copy the frame and queue it; returns false if it was dropped
+  bool submit(const uint8_t *rgba, uint32_t width, uint32_t height)
+  {
+    if (!canAccept() || width < frame_width || height < frame_height)
+    {
+      dropped++;
+      return false;
+    }
+    if (submitted == 0)
+      begin = std::chrono::steady_clock::now();
+    submitted++;
+    queued++;
+
+    // the frame is cropped to the recording size from the top left
+    std::shared_ptr<std::vector<uint8_t>> pixels = acquire((size_t)frame_width * frame_height * 4);
+    const size_t row_bytes = (size_t)frame_width * 4;
+    for (uint32_t y = 0; y < frame_height; y++)
+    {
+      std::memcpy(pixels->data() + y * row_bytes, rgba + ((size_t)(height - frame_height + y) * width) * 4,
+                  row_bytes);
+    }
+
+    const uint32_t w = frame_width, h = frame_height;
+    auto converted = std::make_shared<std::future<std::shared_ptr<std::vector<uint8_t>>>>(converters.submit([=] {
+      std::shared_ptr<std::vector<uint8_t>> planes = acquire((size_t)w * h * 3 / 2);
+      uint8_t *y_plane = planes->data();
+      yuv::rgba_to_i420(pixels->data(), w, h, y_plane, y_plane + w * h, y_plane + w * h + w * h / 4);
+      release(pixels);
+      return planes;
+    }));
+
+    writer.submit([this, converted] {
+      std::shared_ptr<std::vector<uint8_t>> planes = converted->get();
+      if (!failed)
+      {
+        const bool ok = (raw || fwrite("FRAME\n", 1, 6, sink) == 6) &&
+                        fwrite(planes->data(), 1, planes->size(), sink) == planes->size();
+        if (ok)
+        {
+          written++;
+          end = std::chrono::steady_clock::now();
+        }
+        else
+        {
+          failed = true;
+          std::cout << "Recording sink closed, stopping the recording" << std::endl;
+        }
+      }
+      release(planes);
+      queued--;
+    });
+    return true;
+  }
+
+  // finish the queued frames and close the sink
+  void close()
+  {
+    if (!sink)
+      return;
+    // the writer runs its jobs in order, so an empty one finishes last
+    writer.submit([] {}).wait();
+#ifdef _WIN32
+    raw ? _pclose(sink) : fclose(sink);
+#else
+    raw ? pclose(sink) : fclose(sink);
+#endif
+    sink = nullptr;
+  }
+
+  size_t getWritten() const
+  {
+    return written;
+  }
+
+  size_t getDropped() const
+  {
+    return dropped;
+  }
+
+  // frames written per second between the first submitted and the last
+  // written frame
+  double getSustainedFps() const
+  {
+    const double seconds = std::chrono::duration<double>(end - begin).count();
+    return written > 1 && seconds > 0.0 ? (written - 1) / seconds : 0.0;
+  }
+
+private:
+  ThreadPool converters;
+  ThreadPool writer{1};
+  FILE *sink = nullptr;
+  bool raw = false;
+  std::atomic<bool> failed{false};
+  uint32_t frame_width = 0, frame_height = 0;
+
+  const size_t max_queued;
+  std::atomic<size_t> queued{0};
+  size_t submitted = 0;
+  std::atomic<size_t> written{0};
+  size_t dropped = 0;
+  std::chrono::steady_clock::time_point begin, end;
+
+  // frame buffers are reused instead of allocated for every frame
+  std::mutex pool_mutex;
+  std::vector<std::shared_ptr<std::vector<uint8_t>>> free_buffers;
+
+  std::shared_ptr<std::vector<uint8_t>> acquire(size_t size)
+  {
+    {
+      std::lock_guard<std::mutex> lock(pool_mutex);
+      for (size_t i = 0; i < free_buffers.size(); i++)
+      {
+        if (free_buffers[i]->size() == size)
+        {
+          std::shared_ptr<std::vector<uint8_t>> buffer = free_buffers[i];
+          free_buffers.erase(free_buffers.begin() + i);
+          return buffer;
+        }
+      }
+    }
+    return std::make_shared<std::vector<uint8_t>>(size);
+  }
+
+  void release(const std::shared_ptr<std::vector<uint8_t>> &buffer)
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    free_buffers.push_back(buffer);
+  }
+};
+
+#endif // !VIDEO_RECORDER_H
@@ -0,0 +1,156 @@
+#ifndef YUV_H
+#define YUV_H
+
+#include <cstddef>
+#include <cstdint>
+
+// define YUV_NO_SIMD to build the scalar conversion instead
+#if (defined(__SSE2__) || defined(_M_X64)) && !defined(YUV_NO_SIMD)
+#include <emmintrin.h>
+#define YUV_SSE2 1
+#endif
+
+// RGBA to planar YUV 4:2:0 (I420) with BT.601 limited range coefficients in
+// 8.8 fixed point, the format raw video tools expect by default. Chroma is
+// taken from the average of each 2x2 block, i.e. centered like C420jpeg.
+// The SSE2 path converts eight pixels of two rows at a time and gives the
+// same bytes as the scalar one.
+
+namespace yuv
+{
+
+inline uint8_t luma(int r, int g, int b)
+{
+  return (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+inline uint8_t chroma_u(int r, int g, int b)
+{
+  return (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+}
+
+inline uint8_t chroma_v(int r, int g, int b)
+{
+  return (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+// two rows of even width into two luma rows and one row of each chroma plane,
+// starting at pixel x
+inline void convert_rows_scalar(const uint8_t *row0, const uint8_t *row1, size_t x, size_t width, uint8_t *y0,
+                                uint8_t *y1, uint8_t *u, uint8_t *v)
+{
+  for (; x < width; x += 2)
+  {
+    const uint8_t *p[4] = {row0 + 4 * x, row0 + 4 * x + 4, row1 + 4 * x, row1 + 4 * x + 4};
+    y0[x] = luma(p[0][0], p[0][1], p[0][2]);
+    y0[x + 1] = luma(p[1][0], p[1][1], p[1][2]);
+    y1[x] = luma(p[2][0], p[2][1], p[2][2]);
+    y1[x + 1] = luma(p[3][0], p[3][1], p[3][2]);
+
+    const int r = (p[0][0] + p[1][0] + p[2][0] + p[3][0] + 2) >> 2;
+    const int g = (p[0][1] + p[1][1] + p[2][1] + p[3][1] + 2) >> 2;
+    const int b = (p[0][2] + p[1][2] + p[2][2] + p[3][2] + 2) >> 2;
+    u[x / 2] = chroma_u(r, g, b);
+    v[x / 2] = chroma_v(r, g, b);
+  }
+}
+
+#ifdef YUV_SSE2
+// (a0 + a1, a2 + a3, b0 + b1, b2 + b3) of two madd results
+inline __m128i sum_pairs(__m128i a, __m128i b)
+{
+  const __m128i sa =
+      _mm_add_epi32(_mm_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0)), _mm_shuffle_epi32(a, _MM_SHUFFLE(2, 0, 3, 1)));
+  const __m128i sb =
+      _mm_add_epi32(_mm_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0)), _mm_shuffle_epi32(b, _MM_SHUFFLE(2, 0, 3, 1)));
+  return _mm_unpacklo_epi64(sa, sb);
+}
+
+// luma of four rgba pixels as 32-bit lanes
+inline __m128i luma4(__m128i pixels)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i coeffs = _mm_set_epi16(0, 25, 129, 66, 0, 25, 129, 66);
+  const __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), coeffs);
+  const __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), coeffs);
+  const __m128i sum = sum_pairs(lo, hi);
+  return _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(128)), 8), _mm_set1_epi32(16));
+}
+
+// rounded rgba averages of the two 2x2 blocks in four pixels of two rows, as
+// 16-bit lanes (block 0 in the low half)
+inline __m128i block_average(__m128i top, __m128i bottom)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i left = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+  const __m128i right = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+  const __m128i block0 = _mm_add_epi16(left, _mm_srli_si128(left, 8));
+  const __m128i block1 = _mm_add_epi16(right, _mm_srli_si128(right, 8));
+  return _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(block0, block1), _mm_set1_epi16(2)), 2);
+}
+
+// u or v of the blocks averaged in a and b as 32-bit lanes
+inline __m128i chroma4(__m128i a, __m128i b, __m128i coeffs)
+{
+  const __m128i sum = sum_pairs(_mm_madd_epi16(a, coeffs), _mm_madd_epi16(b, coeffs));
+  return _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(128)), 8), _mm_set1_epi32(128));
+}
+
+inline void store4(uint8_t *out, __m128i values)
+{
+  const __m128i words = _mm_packs_epi32(values, values);
+  const __m128i bytes = _mm_packus_epi16(words, words);
+  const int packed = _mm_cvtsi128_si32(bytes);
+  out[0] = (uint8_t)packed;
+  out[1] = (uint8_t)(packed >> 8);
+  out[2] = (uint8_t)(packed >> 16);
+  out[3] = (uint8_t)(packed >> 24);
+}
+#endif
+
+inline void convert_rows(const uint8_t *row0, const uint8_t *row1, size_t width, uint8_t *y0, uint8_t *y1, uint8_t *u,
+                         uint8_t *v)
+{
+  size_t x = 0;
+#ifdef YUV_SSE2
+  const __m128i u_coeffs = _mm_set_epi16(0, 112, -74, -38, 0, 112, -74, -38);
+  const __m128i v_coeffs = _mm_set_epi16(0, -18, -94, 112, 0, -18, -94, 112);
+  for (; x + 8 <= width; x += 8)
+  {
+    const __m128i a0 = _mm_loadu_si128((const __m128i *)(row0 + 4 * x));
+    const __m128i b0 = _mm_loadu_si128((const __m128i *)(row0 + 4 * x + 16));
+    const __m128i a1 = _mm_loadu_si128((const __m128i *)(row1 + 4 * x));
+    const __m128i b1 = _mm_loadu_si128((const __m128i *)(row1 + 4 * x + 16));
+
+    const __m128i luma0 = _mm_packus_epi16(_mm_packs_epi32(luma4(a0), luma4(b0)), _mm_setzero_si128());
+    const __m128i luma1 = _mm_packus_epi16(_mm_packs_epi32(luma4(a1), luma4(b1)), _mm_setzero_si128());
+    _mm_storel_epi64((__m128i *)(y0 + x), luma0);
+    _mm_storel_epi64((__m128i *)(y1 + x), luma1);
+
+    const __m128i avg_a = block_average(a0, a1), avg_b = block_average(b0, b1);
+    store4(u + x / 2, chroma4(avg_a, avg_b, u_coeffs));
+    store4(v + x / 2, chroma4(avg_a, avg_b, v_coeffs));
+  }
+#endif
+  convert_rows_scalar(row0, row1, x, width, y0, y1, u, v);
+}
+
+// I420 planes of an even sized rgba image stored bottom row first, as read
+// back from GL; the output is top row first. Rows [first, last) of the output
+// only, both even, so that bands can be converted concurrently.
+inline void rgba_to_i420(const uint8_t *rgba, size_t width, size_t height, uint8_t *y_plane, uint8_t *u_plane,
+                         uint8_t *v_plane, size_t first = 0, size_t last = SIZE_MAX)
+{
+  last = last < height ? last : height;
+  for (size_t row = first; row + 1 < last; row += 2)
+  {
+    const uint8_t *row0 = rgba + (height - row - 1) * width * 4;
+    const uint8_t *row1 = row0 - width * 4;
+    convert_rows(row0, row1, width, y_plane + row * width, y_plane + (row + 1) * width,
+                 u_plane + row / 2 * (width / 2), v_plane + row / 2 * (width / 2));
+  }
+}
+
+} // namespace yuv
+
+#endif // !YUV_H
@@ -5,199 +5,835 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <GLFW/glfw3.h>
-#include <stb_image.h>
 
-#include <filesystem>
-#include <fstream>
+#include <algorithm>
+#include <asset_loader.h>
+#include <chrono>
+#include <cpu_profiler.h>
+#include <cstddef>
+#include <cstdio>
 #include <iostream>
-#include <obj.h>
+#include <disco_lights.h>
+#include <filesystem>
+#include <frame_capture.h>
+#include <frustum_culling.h>
+#include <gl_state.h>
+#include <gpu_profiler.h>
+#include <headless.h>
+#include <instancing.h>
+#include <light_block.h>
+#include <lod_selector.h>
 #include <shader.h>
+#include <shader_variants.h>
+#include <texture.h>
 #include <sstream>
 #include <string>
 #include <vector>
+#include <vertex_quantization.h>
 #include <assert.h>
 
-void dump_framebuffer_to_ppm(std::string prefix, uint32_t width,
-                             uint32_t height);
-
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 
 void process_input(GLFWwindow *window);
 
-void get_position_from_angle(float angle, float radius, float &adj_pos, float &opp_pos);
+// terminates glfw when main returns, if it was initialized; declared before
+// everything owning GL objects, it outlives them, so they are released while
+// the context still exists
+struct GlfwSession
+{
+  bool initialized = false;
+
+  ~GlfwSession()
+  {
+    if (initialized)
+      glfwTerminate();
+  }
+};
 
-static uint32_t ss_id = 0;
+// set by process_input, read back after the frame has been drawn
+static bool capture_requested = false;
 
 const unsigned int SCR_WIDTH = 1024;
 const unsigned int SCR_HEIGHT = 768;
 
 const std::vector<std::string> obj_paths = {"asset/timmy.obj", "asset/bucket.obj", "asset/floor.obj"};
 const std::vector<std::string> img_paths = {"asset/timmy.png", "asset/bucket.jpg", "asset/floor.jpeg"};
+// meshes repeated for every member of a --crowd; the floor is drawn once
+const std::vector<bool> crowd_members = {true, true, false};
+// distance between the members of a crowd, a little more than Timmy's width
+const float CROWD_SPACING = 220.0f;
 std::vector<GLuint> VAOs(obj_paths.size());
+// three vertex buffers per mesh: the float and compact layouts use the first,
+// the double layout one per attribute stream
 std::vector<GLuint> VBOs(obj_paths.size() * 3);
 std::vector<unsigned int> textures(obj_paths.size());
-std::vector<unsigned int> vbuffer_sizes(obj_paths.size());
+// meshes whose texture failed to load are drawn untextured
+std::vector<bool> textured(obj_paths.size(), false);
+// optional texture entry points of the context
+TextureCaps texture_caps;
+// linked programs kept from earlier runs
+ProgramCache program_cache;
+std::vector<GLuint> EBOs(obj_paths.size());
+// index ranges of every mesh's levels of detail, the full mesh first
+std::vector<std::vector<MeshLod>> mesh_lods(obj_paths.size());
+// local bounds of every mesh for frustum culling and picking the levels
+std::vector<Bounds> mesh_bounds(obj_paths.size());
+// framebuffer size for the cluster lookup in shader.fs
+glm::vec2 viewport_size(SCR_WIDTH, SCR_HEIGHT);
+bool viewport_changed = true;
+// dequantization of the compact vertex layouts
+std::vector<glm::vec3> position_offsets(obj_paths.size(), glm::vec3(0.0f));
+std::vector<glm::vec3> position_scales(obj_paths.size(), glm::vec3(1.0f));
 
-void setup_objs(std::vector<Obj> objs, std::vector<std::string> imgs);
+// vertex formats selectable with --vertex-layout to compare upload bytes
+// and frame time
+enum class VertexLayout
+{
+  // one interleaved float buffer, 32 bytes per vertex
+  Float,
+  // three GL_DOUBLE buffers like the original renderer, 64 bytes per vertex
+  Double,
+  // quantized positions, octahedral normals and half float uvs, 16 or 12
+  // bytes per vertex
+  Compact16,
+  Compact8
+};
 
-std::vector<Obj> load_objs(std::vector<std::string> obj_paths);
+const char *vertex_layout_name(VertexLayout layout);
 
-int main()
+// command line options
+struct Options
 {
-  // initialize and configure
-  glfwInit();
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  // print frame times once per second, with vsync off
+  bool stats = false;
+  VertexLayout vertex_layout = VertexLayout::Float;
+  // number of spot lights, at most MAX_LIGHTS; the first three are the
+  // original red, green and blue lights
+  size_t lights = 3;
+  // shade every light for every fragment instead of the clustered lists
+  bool brute_force_lighting = false;
+  // file format of the screenshots taken with p
+  ImageFormat capture_format = ImageFormat::Ppm;
+  // window size
+  unsigned int width = SCR_WIDTH, height = SCR_HEIGHT;
+  // record every frame to a .y4m file, or as raw I420 frames to the stdin
+  // of a command
+  std::string record;
+  bool record_pipe = false;
+  // render offscreen without a window, see headless.h
+  bool headless = false;
+  // stop after this many frames, 0 to run until the window is closed;
+  // headless runs default to one frame and capture the last one
+  size_t frames = 0;
+  // time the clear, light upload, each object's draw and captures on the GPU,
+  // printed with the frame times and optionally streamed per frame to a
+  // .csv or .json file
+  bool gpu_profile = false;
+  std::string gpu_profile_path;
+  // write the CPU zones to a Chrome trace at exit; needs a TBD_PROFILE build
+  std::string trace;
+  // draw this many Timmys with their buckets, instanced; 0 draws the
+  // original scene without instancing
+  size_t crowd = 0;
+  // skip objects and crowd members outside the view frustum
+  bool cull = true;
+  // draw simplified meshes where they appear small enough
+  bool lod = true;
+  TextureFilter texture_filter = TextureFilter::Anisotropic;
+  // upload the textures as BC1 or BC3 blocks instead of 8-bit texels
+  bool texture_compression = true;
+  // load linked programs from shaders/cache instead of compiling them
+  bool program_cache = true;
+  // draw with shader.fs specialized for the lighting, light count and
+  // texture of each draw instead of the generic program
+  bool shader_variants = true;
+  // how the variants apply the spot cones; smooth skips the branch but fades
+  // the cone edges, so the image differs from the generic program's
+  ConeShape cone = ConeShape::Branch;
+  // build the variants on the driver's threads where it can, else on a
+  // worker thread with a shared context; serial builds them up front
+  ShaderCompileMode shader_compile = ShaderCompileMode::Parallel;
+};
 
-#ifdef __APPLE__
-  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
+Options options;
 
-  // glfw window creation
-  GLFWwindow *window =
-      glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Timmy and the Bucket are at Disco", NULL, NULL);
-  if (window == NULL)
-  {
-    std::cout << "Failed to create GLFW window" << std::endl;
-    glfwTerminate();
+bool parse_options(int argc, char **argv);
+
+// rolling frame time, printed once per second with --stats
+struct FrameStats
+{
+  TimePoint window_begin = std::chrono::steady_clock::now();
+  TimePoint last = window_begin;
+  size_t frames = 0;
+  double worst_ms = 0.0;
+  // printed after the frame times if enabled
+  const GpuProfiler *gpu = nullptr;
+  // crowd members and triangles drawn in the last frame
+  size_t visible_instances = 0;
+  size_t triangles = 0;
+  // binds and enables passed on to GL and dropped as redundant by gl_state()
+  // in the last frame
+  size_t gl_issued = 0;
+  size_t gl_elided = 0;
+
+  void tick();
+};
+
+void setup_objs(AssetJobs &jobs, const std::vector<std::string> &obj_paths,
+                const std::vector<std::string> &imgs);
+
+size_t upload_mesh(size_t i, const Mesh &mesh);
+
+size_t upload_mesh_double(size_t i, const Mesh &mesh);
+
+size_t upload_mesh_compact(size_t i, const Mesh &mesh, NormalEncoding normal_encoding);
+
+void print_mesh_stats(const Mesh &mesh);
+
+const MeshLod &mesh_lod(size_t i, int level);
+
+size_t upload_texture(size_t i, const MipChain &chain);
+
+ShaderPermutation scene_permutation(bool textured_mesh);
+
+// a variant of the scene's program and its uniform handles
+struct SceneProgram
+{
+  Shader *shader;
+  Uniform<glm::mat4> model, view, projection;
+  Uniform<glm::vec3> position_offset, position_scale;
+  Uniform<float> normal_scale;
+};
+
+SceneProgram resolve_scene_program(Shader &shader);
+
+int main(int argc, char **argv)
+{
+  if (!parse_options(argc, argv))
     return -1;
-  }
-  glfwMakeContextCurrent(window);
-  glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
-  // load all OpenGL function pointers
-  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+  PROFILE_THREAD("main");
+  PROFILE_BEGIN(startup, "startup");
+  const auto startup_begin = std::chrono::steady_clock::now();
+
+  // parse meshes and decode textures on worker threads while the window,
+  // context and shader are being set up
+  ThreadPool pool;
+  AssetJobs jobs = start_asset_jobs(pool, obj_paths, img_paths, options.texture_compression);
+
+  GLFWwindow *window = NULL;
+  HeadlessContext headless;
+  GlfwSession glfw_session;
+  GLADloadproc gl_loader = HeadlessContext::loader();
+  int framebuffer_width = options.width, framebuffer_height = options.height;
+  if (options.headless)
   {
-    std::cout << "Failed to initialize GLAD" << std::endl;
-    return -1;
+    // the context, GL functions and offscreen framebuffer in one go
+    PROFILE_ZONE("create headless context");
+    if (!headless.create(options.width, options.height))
+      return -1;
+  }
+  else
+  {
+    // initialize and configure
+    PROFILE_BEGIN(glfw_init, "glfwInit");
+    glfwInit();
+    PROFILE_END(glfw_init);
+    glfw_session.initialized = true;
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+    // glfw window creation
+    PROFILE_BEGIN(create_window, "create window and context");
+    window = glfwCreateWindow(options.width, options.height, "Timmy and the Bucket are at Disco", NULL, NULL);
+    if (window == NULL)
+    {
+      std::cout << "Failed to create GLFW window" << std::endl;
+      return -1;
+    }
+    glfwMakeContextCurrent(window);
+    PROFILE_END(create_window);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
+
+    // load all OpenGL function pointers
+    PROFILE_BEGIN(glad, "load GL functions");
+    const bool gl_loaded = gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+    PROFILE_END(glad);
+    if (!gl_loaded)
+    {
+      std::cout << "Failed to initialize GLAD" << std::endl;
+      return -1;
+    }
+    gl_loader = (GLADloadproc)glfwGetProcAddress;
+
+    // measure frame time without the display refresh rate capping it
+    if (options.stats)
+      glfwSwapInterval(0);
   }
+  viewport_size = glm::vec2(framebuffer_width, framebuffer_height);
+  texture_caps = TextureCaps::query(gl_loader);
+  if (options.program_cache)
+    program_cache.init(gl_loader);
 
   // configure global OpenGL state
-  glEnable(GL_DEPTH_TEST);
-  glEnable(GL_CULL_FACE);
+  gl_state().enable(GL_DEPTH_TEST);
+  gl_state().enable(GL_CULL_FACE);
   glCullFace(GL_BACK);
   // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
   // build and compile shader program
-  Shader shader("shaders/shader.vs", "shaders/shader.fs");
+  const bool compact = options.vertex_layout == VertexLayout::Compact16 ||
+                       options.vertex_layout == VertexLayout::Compact8;
+  PROFILE_BEGIN(compile, "compile shaders");
+  const char *vertex_shader = options.crowd > 0 ? "shaders/shader_instanced.vs"
+                              : compact          ? "shaders/shader_compact.vs"
+                                                 : "shaders/shader.vs";
+  // every variant binds the Lights block and samples the light buffer
+  // textures from units 1 to 3
+  ShaderVariants scene_shaders;
+  scene_shaders.init(vertex_shader, "shaders/shader.fs", &program_cache, [](Shader &variant) {
+    variant.bindUniformBlock("Lights", LIGHTS_BINDING);
+    variant.set(variant.uniform<int>("lightData"), 1);
+    variant.set(variant.uniform<int>("clusterCells"), 2);
+    variant.set(variant.uniform<int>("clusterLights"), 3);
+    variant.set(variant.uniform<bool>("bruteForce"), options.brute_force_lighting);
+  });
+  GLFWwindow *compile_window = NULL;
+  if (options.shader_compile == ShaderCompileMode::Parallel)
+    scene_shaders.enableParallel(gl_loader);
+  if (options.shader_compile != ShaderCompileMode::Serial && scene_shaders.getMode() == ShaderCompileMode::Serial)
+  {
+    // the worker's context shares the main one's objects: a second EGL
+    // context when headless, a hidden window's otherwise
+    if (options.headless && headless.createShared())
+    {
+      scene_shaders.startWorker([&headless] { return headless.attachShared(true); },
+                                [&headless] { headless.attachShared(false); });
+    }
+    else if (!options.headless)
+    {
+      glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+      compile_window = glfwCreateWindow(1, 1, "shader compiler", NULL, window);
+      glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+      if (compile_window)
+      {
+        scene_shaders.startWorker(
+            [compile_window] {
+              glfwMakeContextCurrent(compile_window);
+              return true;
+            },
+            [] { glfwMakeContextCurrent(NULL); });
+      }
+    }
+  }
+  // every variant this run may draw with, built while the assets load: the
+  // one of textured meshes and the one of meshes whose texture fails
+  scene_shaders.prepare(scene_permutation(true));
+  scene_shaders.prepare(scene_permutation(false));
+  std::cout << "Started building " << scene_shaders.getVariantCount() << " variants of " << vertex_shader
+            << " + shaders/shader.fs (" << shader_compile_mode_name(scene_shaders.getMode()) << ") in "
+            << scene_shaders.getIssueMs() << " ms" << std::endl;
+  PROFILE_END(compile);
+
+  // lights live in buffers shared by every program binding the Lights block
+  LightBlock lights;
+  lights.create();
+  lights.bindTextures(1);
+
+  std::vector<DiscoLight> disco_lights = make_disco_lights(options.lights);
+  std::vector<SpotLight> frame_lights;
+  std::cout << disco_lights.size() << " spot lights, "
+            << (options.brute_force_lighting ? "every light shaded per fragment" : "clustered") << std::endl;
+
+  setup_objs(jobs, obj_paths, img_paths);
+
+  // the variant each mesh is drawn with, waited for here if still building,
+  // its uniforms resolved once instead of looking names up every frame
+  PROFILE_BEGIN(wait_shaders, "wait for shaders");
+  std::vector<SceneProgram> scene_programs;
+  std::vector<size_t> mesh_programs(VAOs.size());
+  for (size_t i = 0; i < VAOs.size(); i++)
+  {
+    Shader &variant = scene_shaders.get(scene_permutation(textured[i]));
+    size_t p = 0;
+    while (p < scene_programs.size() && scene_programs[p].shader != &variant)
+      p++;
+    if (p == scene_programs.size())
+    {
+      scene_programs.push_back(resolve_scene_program(variant));
+      std::cout << "Drawing with the " << scene_permutation(textured[i]).name() << " variant" << std::endl;
+    }
+    mesh_programs[i] = p;
+  }
+  const char *cache_state = "off";
+  if (program_cache.isEnabled())
+    cache_state = program_cache.getRejects() > 0 ? "rejected" : program_cache.getMisses() > 0 ? "miss" : "hit";
+  std::cout << "Shaders ready after waiting " << scene_shaders.getWaitMs() << " ms (program cache " << cache_state
+            << ")" << std::endl;
+  PROFILE_END(wait_shaders);
+
+  // a crowd draws every mesh instanced, one draw call per mesh and level of
+  // detail: Timmy and the bucket share the crowd's instances, the floor has
+  // a single one
+  InstanceBuffer crowd_instances, single_instance;
+  std::vector<InstanceData> crowd;
+  // the crowd's world space boxes, each enclosing Timmy and the bucket;
+  // culling and picking levels reupload only the visible members every
+  // frame, grouped by level
+  InstanceCuller crowd_culler;
+  Bounds member_bounds;
+  std::vector<uint32_t> visible_members;
+  std::vector<InstanceData> visible_crowd;
+  std::vector<uint8_t> crowd_levels;
+  float member_errors[MESH_LOD_COUNT] = {};
+  size_t level_first[MESH_LOD_COUNT] = {}, level_count[MESH_LOD_COUNT] = {};
+  if (options.crowd > 0)
+  {
+    crowd = make_crowd(options.crowd, CROWD_SPACING);
+    const InstanceData identity = {glm::mat4(1.0f), glm::vec4(1.0f)};
+    crowd_instances.upload(crowd.data(), crowd.size());
+    single_instance.upload(&identity, 1);
+    for (size_t i = 0; i < VAOs.size(); i++)
+    {
+      InstanceBuffer &instances = crowd_members[i] ? crowd_instances : single_instance;
+      instances.attach(VAOs[i]);
+      if (!crowd_members[i])
+        continue;
+      member_bounds = merge_bounds(member_bounds, mesh_bounds[i]);
+      for (int level = 0; level < MESH_LOD_COUNT; level++)
+        member_errors[level] = std::max(member_errors[level], mesh_lod(i, level).error);
+    }
+    crowd_culler.setInstances(&crowd[0].model, sizeof(InstanceData), crowd.size(), member_bounds);
+    // every member, for picking levels without culling
+    visible_members.resize(crowd.size());
+    for (size_t m = 0; m < crowd.size(); m++)
+      visible_members[m] = (uint32_t)m;
+    visible_crowd.reserve(crowd.size());
+    crowd_levels.assign(crowd.size(), 0);
+    level_count[0] = crowd.size();
+    std::cout << "Crowd of " << options.crowd << " Timmys and buckets, instanced" << std::endl;
+  }
+  // level each object was drawn with last, for the hysteresis
+  std::vector<int> mesh_levels(VAOs.size(), 0);
+  LodSelector lod_selector;
+  PROFILE_END(startup);
 
-  std::vector<Obj> objs = load_objs(obj_paths);
-  setup_objs(objs, img_paths);
+  std::cout << "Startup took " << ms_between(startup_begin, std::chrono::steady_clock::now()) << " ms"
+            << std::endl;
 
   glm::mat4 model = glm::mat4(1.0f);
   glm::mat4 view = glm::lookAt(glm::vec3(50, 100, 200), glm::vec3(0, 80, 0),
                                glm::vec3(0, 1, 0));
+  const float aspect = viewport_size.x / viewport_size.y;
   glm::mat4 proj =
-      glm::perspective(glm::radians(60.0f), 4.0f / 3.0f, 0.1f, 1000.0f);
+      glm::perspective(glm::radians(60.0f), aspect, 0.1f, 1000.0f);
 
-  float spotDirRx = 50.0f;
-  float spotDirRz = -50.0f;
-  float thetaR = std::atan2(spotDirRz, spotDirRx);
+  // the cluster grid has to match the projection
+  LightClusters clusters;
+  clusters.setProjection(glm::radians(60.0f), aspect, 0.1f, 1000.0f);
 
-  float spotDirGx = -50.0f;
-  float spotDirGz = -50.0f;
-  float thetaG = std::atan2(spotDirGz, spotDirGx);
-
-  float spotDirBx = 0.0f;
-  float spotDirBz = 50.0f;
-  float thetaB = std::atan2(spotDirBz, spotDirBx);
+  GpuProfiler gpu_profiler(options.gpu_profile);
+  const size_t gpu_clear = gpu_profiler.addSection("clear");
+  const size_t gpu_lights = gpu_profiler.addSection("lights");
+  std::vector<size_t> gpu_objects;
+  for (const std::string &path : obj_paths)
+    gpu_objects.push_back(gpu_profiler.addSection(std::filesystem::path(path).stem().string()));
+  const size_t gpu_capture = gpu_profiler.addSection("capture");
+  if (!options.gpu_profile_path.empty() && !gpu_profiler.openStream(options.gpu_profile_path))
+    return -1;
 
-  float radiusR = std::sqrt(spotDirRx * spotDirRx + spotDirRz * spotDirRz);
-  float radiusG = std::sqrt(spotDirGx * spotDirGx + spotDirGz * spotDirGz);
-  float radiusB = std::sqrt(spotDirBx * spotDirBx + spotDirBz * spotDirBz);
+  FrameStats frame_stats;
+  if (gpu_profiler.isEnabled())
+    frame_stats.gpu = &gpu_profiler;
+  FrameCapture capture(options.capture_format);
+  FrameRecorder recorder;
+  if (!options.record.empty())
+  {
+    if (!recorder.open(options.record, options.record_pipe, framebuffer_width, framebuffer_height, 60))
+      return -1;
+    std::cout << "Recording " << recorder.getVideo().getWidth() << "x" << recorder.getVideo().getHeight()
+              << (options.record_pipe ? " raw I420 frames to " : " to ") << options.record << std::endl;
+  }
 
-  // render loop
-  while (!glfwWindowShouldClose(window))
+  // render loop; the state changes of the setup are not a frame's
+  gl_state().resetCounters();
+  for (size_t frame = 1; options.headless || !glfwWindowShouldClose(window); frame++)
   {
-    process_input(window);
+    PROFILE_ZONE("frame");
+    PROFILE_BEGIN(input, "input");
+    if (!options.headless)
+      process_input(window);
+    // the last frame of a headless run is its output
+    const bool last_frame = frame == options.frames;
+    if (last_frame && options.headless)
+      capture_requested = true;
+    capture.poll();
+    if (recorder.isOpen())
+      recorder.poll();
+    PROFILE_END(input);
+
+    gpu_profiler.beginFrame();
 
     // background color
+    gpu_profiler.begin(gpu_clear);
     glClearColor(0.3f, 0.4f, 0.5f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    gpu_profiler.end(gpu_clear);
 
-    // point light position
-    glm::vec3 lightPos(0, 200, 0);
-    glm::vec3 spotDirR(spotDirRx, -200, spotDirRz);
-    glm::vec3 spotDirG(spotDirGx, -200, spotDirGz);
-    glm::vec3 spotDirB(spotDirBx, -200, spotDirBz);
-
-    thetaR += 0.05f;
-    thetaG += 0.05f;
-    thetaB += 0.05f;
-
-    get_position_from_angle(thetaR, radiusR, spotDirRx, spotDirRz);
-    get_position_from_angle(thetaG, radiusG, spotDirGx, spotDirGz);
-    get_position_from_angle(thetaB, radiusB, spotDirBx, spotDirBz);
-
-    // activate shader
-    shader.use();
-    shader.setMat4("model", model);
-    shader.setMat4("view", view);
-    shader.setMat4("projection", proj);
-
-    shader.setVec3("lights[0].position", lightPos);
-    shader.setVec3("lights[0].direction", spotDirR);
-    shader.setFloat("lights[0].cutOff", glm::cos(M_PI / 6.0f));
-    shader.setVec3("lights[0].ambient", 0.2f, 0.2f, 0.2f);
-    shader.setVec3("lights[0].diffuse", 1.0f, 0.0f, 0.0f);
-    shader.setFloat("lights[0].constant", 1.0f);
-    shader.setFloat("lights[0].linear", 0.35e-4f);
-    shader.setFloat("lights[0].quadratic", 0.44e-4);
-
-    shader.setVec3("lights[1].position", lightPos);
-    shader.setVec3("lights[1].direction", spotDirG);
-    shader.setFloat("lights[1].cutOff", glm::cos(M_PI / 6.0f));
-    shader.setVec3("lights[1].ambient", 0.2f, 0.2f, 0.2f);
-    shader.setVec3("lights[1].diffuse", 0.0f, 1.0f, 0.0f);
-    shader.setFloat("lights[1].constant", 1.0f);
-    shader.setFloat("lights[1].linear", 0.35e-4f);
-    shader.setFloat("lights[1].quadratic", 0.44e-4);
-
-    shader.setVec3("lights[2].position", lightPos);
-    shader.setVec3("lights[2].direction", spotDirB);
-    shader.setFloat("lights[2].cutOff", glm::cos(M_PI / 6.0f));
-    shader.setVec3("lights[2].ambient", 0.2f, 0.2f, 0.2f);
-    shader.setVec3("lights[2].diffuse", 0.0f, 0.0f, 1.0f);
-    shader.setFloat("lights[2].constant", 1.0f);
-    shader.setFloat("lights[2].linear", 0.35e-4f);
-    shader.setFloat("lights[2].quadratic", 0.44e-4);
+    // the camera of every variant in use; each program keeps its values
+    PROFILE_BEGIN(uniforms, "uniforms");
+    for (const SceneProgram &program : scene_programs)
+    {
+      program.shader->use();
+      program.shader->set(program.model, model);
+      program.shader->set(program.view, view);
+      program.shader->set(program.projection, proj);
+      if (compact)
+        program.shader->set(program.normal_scale, options.vertex_layout == VertexLayout::Compact16
+                                                      ? 1.0f / 32767.0f
+                                                      : 1.0f / 127.0f);
+    }
+    PROFILE_END(uniforms);
+
+    // move the spot lights and bin them into the clusters they touch
+    PROFILE_BEGIN(update_lights, "lights");
+    gpu_profiler.begin(gpu_lights);
+    animate_disco_lights(disco_lights, frame_lights);
+    lights.updateLights(frame_lights.data(), frame_lights.size());
+    if (!options.brute_force_lighting)
+    {
+      clusters.assign(frame_lights.data(), frame_lights.size(), view);
+      lights.updateClusters(clusters);
+    }
+    if (viewport_changed)
+    {
+      lights.updateParams(total_ambient(disco_lights), disco_lights.size(), clusters, viewport_size);
+      viewport_changed = false;
+    }
+    gpu_profiler.end(gpu_lights);
+    PROFILE_END(update_lights);
+
+    PROFILE_BEGIN(draws, "draws");
+
+    // gather the crowd members in view into the instance buffer, grouped by
+    // the level of detail each one is drawn with
+    const Frustum frustum = Frustum::fromMatrix(proj * view);
+    lod_selector.setProjection(proj, viewport_size.y);
+    if (options.crowd > 0 && (options.cull || options.lod))
+    {
+      PROFILE_ZONE("cull and pick levels");
+      size_t members = crowd.size();
+      if (options.cull)
+        members = crowd_culler.cull(frustum, visible_members.data());
+      if (options.lod)
+      {
+        lod_selector.sortInstances(crowd.data(), visible_members.data(), members, member_bounds.center,
+                                   member_errors, MESH_LOD_COUNT, view, crowd_levels.data(), visible_crowd,
+                                   level_first, level_count);
+      }
+      else
+      {
+        visible_crowd.resize(members);
+        for (size_t m = 0; m < members; m++)
+          visible_crowd[m] = crowd[visible_members[m]];
+        level_count[0] = members;
+      }
+      crowd_instances.upload(visible_crowd.data(), visible_crowd.size());
+    }
+    size_t visible_instances = 0;
+    for (int level = 0; level < MESH_LOD_COUNT; level++)
+      visible_instances += level_count[level];
+    frame_stats.visible_instances = visible_instances;
+    frame_stats.triangles = 0;
 
     // render container
-    for (size_t i = 0; i < objs.size(); i++)
+    for (size_t i = 0; i < VAOs.size(); i++)
     {
-      glBindTexture(GL_TEXTURE_2D, textures[i]);
-      glBindVertexArray(VAOs[i]);
-      glDrawArrays(GL_TRIANGLES, 0, vbuffer_sizes[i] / 3);
+      const bool crowd_member = options.crowd > 0 && crowd_members[i];
+      if (options.cull && !crowd_member && !frustum.intersects(mesh_bounds[i], model))
+        continue;
+      if (crowd_member && visible_instances == 0)
+        continue;
+      gpu_profiler.begin(gpu_objects[i]);
+      const SceneProgram &program = scene_programs[mesh_programs[i]];
+      program.shader->use();
+      if (compact)
+      {
+        program.shader->set(program.position_offset, position_offsets[i]);
+        program.shader->set(program.position_scale, position_scales[i]);
+      }
+      gl_state().bindTexture(GL_TEXTURE_2D, textures[i]);
+      if (crowd_member)
+      {
+        for (int level = 0; level < MESH_LOD_COUNT; level++)
+        {
+          if (level_count[level] == 0)
+            continue;
+          const MeshLod &lod = mesh_lod(i, level);
+          if (options.lod)
+            crowd_instances.attach(VAOs[i], level_first[level]);
+          gl_state().bindVertexArray(VAOs[i]);
+          glDrawElementsInstanced(GL_TRIANGLES, lod.index_count, GL_UNSIGNED_INT,
+                                  (void *)(lod.index_offset * sizeof(uint32_t)), (GLsizei)level_count[level]);
+          frame_stats.triangles += lod.index_count / 3 * level_count[level];
+        }
+      }
+      else
+      {
+        if (options.lod)
+        {
+          const float depth = -(view * model * glm::vec4(mesh_bounds[i].center, 1.0f)).z;
+          mesh_levels[i] = lod_selector.select(mesh_lods[i].data(), (int)mesh_lods[i].size(), depth, mesh_levels[i]);
+        }
+        const MeshLod &lod = mesh_lod(i, mesh_levels[i]);
+        gl_state().bindVertexArray(VAOs[i]);
+        if (options.crowd > 0)
+          glDrawElementsInstanced(GL_TRIANGLES, lod.index_count, GL_UNSIGNED_INT,
+                                  (void *)(lod.index_offset * sizeof(uint32_t)), 1);
+        else
+          glDrawElements(GL_TRIANGLES, lod.index_count, GL_UNSIGNED_INT, (void *)(lod.index_offset * sizeof(uint32_t)));
+        frame_stats.triangles += lod.index_count / 3;
+      }
+      gpu_profiler.end(gpu_objects[i]);
     }
+    PROFILE_END(draws);
 
-    // swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-    glfwSwapBuffers(window);
-    glfwPollEvents();
+    PROFILE_BEGIN(read_back, "capture");
+    int buffer_width = options.width, buffer_height = options.height;
+    if (!options.headless)
+      glfwGetFramebufferSize(window, &buffer_width, &buffer_height);
+    const bool reading_back = capture_requested || recorder.isOpen();
+    if (reading_back)
+      gpu_profiler.begin(gpu_capture);
+    if (capture_requested)
+    {
+      capture.request(buffer_width, buffer_height);
+      capture_requested = false;
+    }
+    if (recorder.isOpen())
+      recorder.request(buffer_width, buffer_height);
+    if (reading_back)
+      gpu_profiler.end(gpu_capture);
+    gpu_profiler.endFrame();
+    PROFILE_END(read_back);
+
+    // swap buffers and poll IO events (keys pressed/released, mouse moved etc.);
+    // offscreen frames only need to be submitted
+    if (options.headless)
+    {
+      PROFILE_ZONE("flush");
+      glFlush();
+    }
+    else
+    {
+      PROFILE_BEGIN(swap, "swap");
+      glfwSwapBuffers(window);
+      PROFILE_END(swap);
+      PROFILE_ZONE("poll events");
+      glfwPollEvents();
+    }
+
+    frame_stats.gl_issued = gl_state().getIssued();
+    frame_stats.gl_elided = gl_state().getElided();
+    gl_state().resetCounters();
+    if (options.stats)
+      frame_stats.tick();
+    if (last_frame)
+      break;
+  }
+
+  capture.flush();
+  gpu_profiler.finish();
+  if (recorder.isOpen())
+  {
+    recorder.finish();
+    const VideoRecorder &video = recorder.getVideo();
+    std::cout << "Recorded " << video.getWritten() << " frames at " << video.getSustainedFps() << " fps, dropped "
+              << recorder.getDroppedReadback() << " (read back busy) + " << video.getDropped()
+              << " (sink behind)" << std::endl;
   }
 
-  // terminate, clearing all previously allocated GLFW resources.
-  glfwTerminate();
+#ifdef TBD_PROFILE
+  if (!options.trace.empty())
+    cpu_profiler::write_chrome_trace(options.trace);
+#endif
+
+  scene_shaders.stopWorker();
   return 0;
 }
 
-void get_position_from_angle(float angle, float radius, float &adj_pos, float &opp_pos)
+bool parse_options(int argc, char **argv)
 {
-  adj_pos = radius * (float)cos(angle);
-  opp_pos = -radius * (float)sin(angle);
+  for (int i = 1; i < argc; i++)
+  {
+    const std::string arg = argv[i];
+    if (arg == "--stats")
+      options.stats = true;
+    else if (arg == "--headless")
+      options.headless = true;
+    else if (arg == "--frames" && i + 1 < argc)
+      options.frames = std::stoul(argv[++i]);
+    else if (arg == "--gpu-profile")
+      options.gpu_profile = options.stats = true;
+    else if (arg.rfind("--gpu-profile=", 0) == 0)
+    {
+      options.gpu_profile = options.stats = true;
+      options.gpu_profile_path = arg.substr(14);
+    }
+    else if (arg.rfind("--trace=", 0) == 0)
+    {
+      options.trace = arg.substr(8);
+#ifndef TBD_PROFILE
+      std::cout << "--trace needs a build with TBD_PROFILE defined, no trace will be written" << std::endl;
+#endif
+    }
+    else if (arg == "--crowd" && i + 1 < argc)
+      options.crowd = std::stoul(argv[++i]);
+    else if (arg == "--cull=on")
+      options.cull = true;
+    else if (arg == "--cull=off")
+      options.cull = false;
+    else if (arg == "--lod=on")
+      options.lod = true;
+    else if (arg == "--lod=off")
+      options.lod = false;
+    else if (arg == "--texture-filter=linear")
+      options.texture_filter = TextureFilter::Linear;
+    else if (arg == "--texture-filter=trilinear")
+      options.texture_filter = TextureFilter::Trilinear;
+    else if (arg == "--texture-filter=anisotropic")
+      options.texture_filter = TextureFilter::Anisotropic;
+    else if (arg == "--texture-compression=bc")
+      options.texture_compression = true;
+    else if (arg == "--texture-compression=none")
+      options.texture_compression = false;
+    else if (arg == "--program-cache=on")
+      options.program_cache = true;
+    else if (arg == "--program-cache=off")
+      options.program_cache = false;
+    else if (arg == "--shader-variants=specialized")
+      options.shader_variants = true;
+    else if (arg == "--shader-variants=generic")
+      options.shader_variants = false;
+    else if (arg == "--cone=branch")
+      options.cone = ConeShape::Branch;
+    else if (arg == "--cone=smooth")
+      options.cone = ConeShape::Smooth;
+    else if (arg == "--shader-compile=parallel")
+      options.shader_compile = ShaderCompileMode::Parallel;
+    else if (arg == "--shader-compile=worker")
+      options.shader_compile = ShaderCompileMode::Worker;
+    else if (arg == "--shader-compile=serial")
+      options.shader_compile = ShaderCompileMode::Serial;
+    else if (arg == "--lights" && i + 1 < argc)
+      options.lights = std::min<size_t>(MAX_LIGHTS, std::stoul(argv[++i]));
+    else if (arg == "--lighting=clustered")
+      options.brute_force_lighting = false;
+    else if (arg == "--lighting=forward")
+      options.brute_force_lighting = true;
+    else if (arg == "--capture-format=ppm")
+      options.capture_format = ImageFormat::Ppm;
+    else if (arg == "--capture-format=png")
+      options.capture_format = ImageFormat::Png;
+    else if (arg == "--capture-format=ppm-ascii")
+      options.capture_format = ImageFormat::AsciiPpm;
+    else if (arg.rfind("--size=", 0) == 0)
+    {
+      if (sscanf(arg.c_str() + 7, "%ux%u", &options.width, &options.height) != 2)
+      {
+        std::cout << "Bad window size " << arg << ", expected --size=WxH" << std::endl;
+        return false;
+      }
+    }
+    else if (arg.rfind("--record=", 0) == 0)
+    {
+      options.record = arg.substr(9);
+      options.record_pipe = false;
+    }
+    else if (arg.rfind("--record-pipe=", 0) == 0)
+    {
+      options.record = arg.substr(14);
+      options.record_pipe = true;
+    }
+    else if (arg == "--vertex-layout=float")
+      options.vertex_layout = VertexLayout::Float;
+    else if (arg == "--vertex-layout=double")
+      options.vertex_layout = VertexLayout::Double;
+    else if (arg == "--vertex-layout=compact")
+      options.vertex_layout = VertexLayout::Compact16;
+    else if (arg == "--vertex-layout=compact8")
+      options.vertex_layout = VertexLayout::Compact8;
+    else
+    {
+      std::cout << "Unknown option " << arg << "\n"
+                << "usage: TimmyBucketDisco [--stats] [--vertex-layout=float|double|compact|compact8] [--lights N]\n"
+                << "                        [--lighting=clustered|forward] [--capture-format=ppm|png|ppm-ascii]\n"
+                << "                        [--size=WxH] [--record=out.y4m | --record-pipe=COMMAND]\n"
+                << "                        [--headless] [--frames N] [--gpu-profile[=out.csv|out.json]]\n"
+                << "                        [--trace=out.json] [--crowd N] [--cull=on|off]\n"
+                << "                        [--lod=on|off] [--texture-filter=linear|trilinear|anisotropic]\n"
+                << "                        [--texture-compression=bc|none] [--program-cache=on|off]\n"
+                << "                        [--shader-variants=specialized|generic] [--cone=branch|smooth]\n"
+                << "                        [--shader-compile=parallel|worker|serial]"
+                << std::endl;
+      return false;
+    }
+  }
+  if (options.headless && options.frames == 0)
+    options.frames = 1;
+  if (options.crowd > 0 && (options.vertex_layout == VertexLayout::Compact16 ||
+                            options.vertex_layout == VertexLayout::Compact8))
+  {
+    std::cout << "--crowd needs the float or double vertex layout" << std::endl;
+    return false;
+  }
+  return true;
 }
 
-std::vector<Obj> load_objs(std::vector<std::string> obj_paths)
+const char *vertex_layout_name(VertexLayout layout)
 {
-  std::vector<Obj> objs;
-
-  for (auto path : obj_paths)
+  switch (layout)
   {
-    Obj obj(path.c_str());
-    objs.push_back(obj);
+  case VertexLayout::Double:
+    return "double";
+  case VertexLayout::Compact16:
+    return "compact";
+  case VertexLayout::Compact8:
+    return "compact8";
+  default:
+    return "float";
   }
+}
+
+void FrameStats::tick()
+{
+  const TimePoint now = std::chrono::steady_clock::now();
+  worst_ms = std::max(worst_ms, ms_between(last, now));
+  last = now;
+  frames++;
 
-  return objs;
+  const double window_ms = ms_between(window_begin, now);
+  if (window_ms >= 1000.0)
+  {
+    std::cout << "frame " << window_ms / frames << " ms avg, " << worst_ms << " ms worst, "
+              << frames * 1000.0 / window_ms << " fps (" << vertex_layout_name(options.vertex_layout)
+              << " vertex layout)" << std::endl;
+    std::cout << "  " << triangles << " triangles drawn";
+    if (options.crowd > 0)
+      std::cout << ", " << visible_instances << " of " << options.crowd << " crowd members";
+    std::cout << ", " << gl_issued << " state changes issued, " << gl_elided << " elided" << std::endl;
+    if (gpu)
+      gpu->print();
+    window_begin = now;
+    frames = 0;
+    worst_ms = 0.0;
+  }
 }
 
 // process all input: query GLFW whether relevant keys are pressed/released this
@@ -210,10 +846,8 @@ void process_input(GLFWwindow *window)
   // press p to capture screen
   if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS)
   {
-    std::cout << "Capture Window " << ss_id << std::endl;
-    int buffer_width, buffer_height;
-    glfwGetFramebufferSize(window, &buffer_width, &buffer_height);
-    dump_framebuffer_to_ppm("tmp", buffer_width, buffer_height);
+    std::cout << "Capture Window" << std::endl;
+    capture_requested = true;
   }
 }
 
@@ -224,123 +858,304 @@ void framebuffer_size_callback(GLFWwindow *window, int width, int height)
   // make sure the viewport matches the new window dimensions; note that width
   // and height will be significantly larger than specified on retina displays.
   glViewport(0, 0, width, height);
+  viewport_size = glm::vec2(width, height);
+  viewport_changed = true;
 }
 
-void dump_framebuffer_to_ppm(std::string prefix, uint32_t width,
-                             uint32_t height)
+// upload meshes and textures in whichever order their worker jobs finish, so
+// startup waits for the slowest asset rather than the sum of all of them
+void setup_objs(AssetJobs &jobs, const std::vector<std::string> &obj_paths,
+                const std::vector<std::string> &imgs)
 {
-  int pixelChannel = 3;
-  int totalPixelSize = pixelChannel * width * height * sizeof(GLubyte);
-  GLubyte *pixels = new GLubyte[totalPixelSize];
-  glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels);
-
-  std::string fileName = prefix + std::to_string(ss_id) + ".ppm";
-  std::filesystem::path filePath = std::filesystem::current_path() / fileName;
-  std::ofstream fout(filePath.string());
-
-  fout << "P3\n"
-       << width << " " << height << "\n"
-       << 255 << std::endl;
-  for (size_t i = 0; i < height; i++)
+  PROFILE_ZONE("setup_objs");
+  const int num_objs = obj_paths.size();
+  glGenVertexArrays(num_objs, &VAOs[0]);
+  glGenBuffers(num_objs * 3, &VBOs[0]);
+  glGenBuffers(num_objs, &EBOs[0]);
+  glGenTextures(num_objs, &textures[0]);
+
+  size_t remaining = jobs.meshes.size() + jobs.textures.size();
+  double slowest_ms = 0.0, total_ms = 0.0;
+  size_t upload_bytes = 0, texture_bytes = 0;
+
+  while (remaining > 0)
   {
-    for (size_t j = 0; j < width; j++)
+    bool uploaded = false;
+
+    for (size_t i = 0; i < jobs.meshes.size(); i++)
+    {
+      if (!is_ready(jobs.meshes[i]))
+        continue;
+
+      PROFILE_ZONE("upload mesh");
+      MeshJob job = jobs.meshes[i].get();
+      size_t bytes = 0;
+      switch (options.vertex_layout)
+      {
+      case VertexLayout::Float:
+        bytes = upload_mesh(i, job.mesh);
+        break;
+      case VertexLayout::Double:
+        bytes = upload_mesh_double(i, job.mesh);
+        break;
+      case VertexLayout::Compact16:
+        bytes = upload_mesh_compact(i, job.mesh, NormalEncoding::Oct16);
+        break;
+      case VertexLayout::Compact8:
+        bytes = upload_mesh_compact(i, job.mesh, NormalEncoding::Oct8);
+        break;
+      }
+      upload_bytes += bytes;
+
+      const double job_ms = ms_between(job.begin, job.end);
+      slowest_ms = std::max(slowest_ms, job_ms);
+      total_ms += job_ms;
+      std::cout << "Loaded " << obj_paths[i] << " (mesh cache " << (job.cache_hit ? "hit" : "miss")
+                << ") in " << job_ms << " ms [" << ms_between(jobs.begin, job.begin) << " - "
+                << ms_between(jobs.begin, job.end) << " ms], uploaded at "
+                << ms_between(jobs.begin, std::chrono::steady_clock::now()) << " ms (" << bytes / 1024
+                << " KB)" << std::endl;
+      print_mesh_stats(job.mesh);
+      mesh_lods[i].assign(job.mesh.getLods(), job.mesh.getLods() + job.mesh.getLodCount());
+      mesh_bounds[i] = compute_bounds(job.mesh.getVertices()[0].position, sizeof(Vertex) / sizeof(float),
+                                      job.mesh.getVertexCount());
+      remaining--;
+      uploaded = true;
+    }
+
+    for (size_t i = 0; i < jobs.textures.size(); i++)
     {
-      size_t cur = pixelChannel * ((height - i - 1) * width + j);
-      fout << (int)pixels[cur] << " " << (int)pixels[cur + 1] << " "
-           << (int)pixels[cur + 2] << " ";
+      if (!is_ready(jobs.textures[i]))
+        continue;
+
+      PROFILE_ZONE("upload texture");
+      TextureJob job = jobs.textures[i].get();
+      if (!job.chain.isValid())
+      {
+        std::cout << "Failed to load texture " << imgs[i] << ", drawing " << obj_paths[i] << " untextured"
+                  << std::endl;
+        remaining--;
+        uploaded = true;
+        continue;
+      }
+      const size_t bytes = upload_texture(i, job.chain);
+      textured[i] = true;
+      texture_bytes += bytes;
+
+      const double job_ms = ms_between(job.begin, job.end);
+      slowest_ms = std::max(slowest_ms, job_ms);
+      total_ms += job_ms;
+      std::cout << "Loaded " << imgs[i] << " (texture cache " << (job.cache_hit ? "hit" : "miss") << ") in "
+                << job_ms << " ms [" << ms_between(jobs.begin, job.begin) << " - "
+                << ms_between(jobs.begin, job.end) << " ms], uploaded at "
+                << ms_between(jobs.begin, std::chrono::steady_clock::now()) << " ms (" << job.chain.getWidth()
+                << "x" << job.chain.getHeight() << " " << block_format_name(job.chain.getFormat()) << ", "
+                << job.chain.getLevelCount() << " levels, " << bytes / 1024 << " KB)" << std::endl;
+      remaining--;
+      uploaded = true;
     }
-    fout << std::endl;
+
+    if (!uploaded && remaining > 0)
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
   }
 
-  ss_id++;
+  std::cout << "Assets ready after " << ms_between(jobs.begin, std::chrono::steady_clock::now())
+            << " ms (slowest asset " << slowest_ms << " ms, sum of assets " << total_ms << " ms), "
+            << upload_bytes / 1024 << " KB of vertex and index data uploaded ("
+            << vertex_layout_name(options.vertex_layout) << " vertex layout), " << texture_bytes / 1024
+            << " KB of texture memory (" << texture_filter_name(options.texture_filter) << " filtering"
+            << (texture_caps.tex_storage_2d ? "" : ", without glTexStorage2D")
+            << (options.texture_compression && !texture_caps.s3tc ? ", BC expanded for want of S3TC" : "") << ")"
+            << std::endl;
+}
 
-  delete[] pixels;
-  fout.flush();
-  fout.close();
+// the texture's whole chain, or only level 0 for --texture-filter=linear;
+// returns the bytes uploaded
+size_t upload_texture(size_t i, const MipChain &chain)
+{
+  return upload_mip_chain(textures[i], chain, options.texture_filter, texture_caps);
 }
 
-void setup_objs(std::vector<Obj> objs, std::vector<std::string> imgs)
+// the generic program, or shader.fs specialized for this run's lighting, cone
+// and a mesh with or without a texture
+ShaderPermutation scene_permutation(bool textured_mesh)
 {
-  const int num_objs = objs.size();
-  glGenVertexArrays(num_objs, &VAOs[0]);
-  glGenBuffers(num_objs * 3, &VBOs[0]);
-  glGenTextures(num_objs, &textures[0]);
+  ShaderPermutation permutation;
+  if (!options.shader_variants)
+    return permutation;
+  permutation.lighting = options.brute_force_lighting ? LightingPath::Forward : LightingPath::Clustered;
+  if (options.brute_force_lighting)
+    permutation.light_count = (uint32_t)std::min<size_t>(options.lights, MAX_LIGHTS);
+  permutation.cone = options.cone;
+  permutation.textured = textured_mesh;
+  return permutation;
+}
+
+SceneProgram resolve_scene_program(Shader &shader)
+{
+  SceneProgram program;
+  program.shader = &shader;
+  program.model = shader.uniform<glm::mat4>("model");
+  program.view = shader.uniform<glm::mat4>("view");
+  program.projection = shader.uniform<glm::mat4>("projection");
+  program.position_offset = shader.uniform<glm::vec3>("positionOffset");
+  program.position_scale = shader.uniform<glm::vec3>("positionScale");
+  program.normal_scale = shader.uniform<float>("normalScale");
+  return program;
+}
+
+// one interleaved float buffer per mesh; returns the bytes uploaded
+size_t upload_mesh(size_t i, const Mesh &mesh)
+{
+  gl_state().bindVertexArray(VAOs[i]);
+
+  gl_state().bindBuffer(GL_ARRAY_BUFFER, VBOs[i * 3]);
+  glBufferData(GL_ARRAY_BUFFER, mesh.getVertexBytes(), mesh.getVertices(), GL_STATIC_DRAW);
+
+  // vertices
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, position));
+  glEnableVertexAttribArray(0);
+
+  // normals
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, normal));
+  glEnableVertexAttribArray(1);
+
+  // texture coordinates
+  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, texcoord));
+  glEnableVertexAttribArray(2);
+
+  // triangle indices
+  gl_state().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBOs[i]);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.getIndexBytes(), mesh.getIndices(), GL_STATIC_DRAW);
 
-  for (size_t i = 0; i < num_objs; i++)
+  gl_state().bindVertexArray(0);
+  return mesh.getVertexBytes() + mesh.getIndexBytes();
+}
+
+// the original layout, kept for --vertex-layout=double: positions, normals and
+// texture coordinates widened to double in three separate buffers
+size_t upload_mesh_double(size_t i, const Mesh &mesh)
+{
+  const size_t count = mesh.getVertexCount();
+  const Vertex *vertices = mesh.getVertices();
+
+  std::vector<double> positions(count * 3), normals(count * 3), texcoords(count * 2);
+  for (size_t v = 0; v < count; v++)
   {
-    std::vector<tinyobj::shape_t> shapes = objs[i].getShapes();
-    std::vector<tinyobj::real_t> vertices = objs[i].getVertices();
-    std::vector<tinyobj::real_t> normals = objs[i].getNormals();
-    std::vector<tinyobj::real_t> texcoords = objs[i].getTexCoords();
+    std::copy(vertices[v].position, vertices[v].position + 3, &positions[v * 3]);
+    std::copy(vertices[v].normal, vertices[v].normal + 3, &normals[v * 3]);
+    std::copy(vertices[v].texcoord, vertices[v].texcoord + 2, &texcoords[v * 2]);
+  }
 
-    std::vector<tinyobj::real_t> vbuffer, nbuffer, tbuffer;
-    for (auto id : shapes[0].mesh.indices)
-    {
-      int vid = id.vertex_index;
-      int nid = id.normal_index;
-      int tid = id.texcoord_index;
-
-      // vertex positions
-      vbuffer.push_back(vertices[vid * 3]);
-      vbuffer.push_back(vertices[vid * 3 + 1]);
-      vbuffer.push_back(vertices[vid * 3 + 2]);
-
-      // normal positions
-      nbuffer.push_back(normals[nid * 3]);
-      nbuffer.push_back(normals[nid * 3 + 1]);
-      nbuffer.push_back(normals[nid * 3 + 2]);
-
-      // texture coordinates
-      tbuffer.push_back(texcoords[tid * 2]);
-      tbuffer.push_back(texcoords[tid * 2 + 1]);
-    }
+  gl_state().bindVertexArray(VAOs[i]);
 
-    vbuffer_sizes[i] = vbuffer.size();
+  // vertices
+  gl_state().bindBuffer(GL_ARRAY_BUFFER, VBOs[i * 3]);
+  glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(double), positions.data(), GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 3, GL_DOUBLE, GL_FALSE, 3 * sizeof(double), (void *)0);
+  glEnableVertexAttribArray(0);
 
-    int width, height, nrChannels;
-    stbi_set_flip_vertically_on_load(true);
-    unsigned char *data = stbi_load(imgs[i].c_str(), &width, &height, &nrChannels, 0);
+  // normals
+  gl_state().bindBuffer(GL_ARRAY_BUFFER, VBOs[i * 3 + 1]);
+  glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(double), normals.data(), GL_STATIC_DRAW);
+  glVertexAttribPointer(1, 3, GL_DOUBLE, GL_FALSE, 3 * sizeof(double), (void *)0);
+  glEnableVertexAttribArray(1);
 
-    if (!data)
-    {
-      std::cout << "Failed to load texture" << std::endl;
-      exit(-1);
-    }
+  // texture coordinates
+  gl_state().bindBuffer(GL_ARRAY_BUFFER, VBOs[i * 3 + 2]);
+  glBufferData(GL_ARRAY_BUFFER, texcoords.size() * sizeof(double), texcoords.data(), GL_STATIC_DRAW);
+  glVertexAttribPointer(2, 2, GL_DOUBLE, GL_FALSE, 2 * sizeof(double), (void *)0);
+  glEnableVertexAttribArray(2);
+
+  // triangle indices
+  gl_state().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBOs[i]);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.getIndexBytes(), mesh.getIndices(), GL_STATIC_DRAW);
+
+  gl_state().bindVertexArray(0);
+  return count * 8 * sizeof(double) + mesh.getIndexBytes();
+}
+
+// quantized vertices decoded by shader_compact.vs; prints the decode error
+// and returns the bytes uploaded
+size_t upload_mesh_compact(size_t i, const Mesh &mesh, NormalEncoding normal_encoding)
+{
+  const QuantizedMesh quantized = quantize_mesh(mesh, normal_encoding);
+  position_offsets[i] = glm::make_vec3(quantized.position_offset);
+  position_scales[i] = glm::make_vec3(quantized.position_scale);
+
+  const GLsizei stride = (GLsizei)quantized.stride;
+  const size_t normal_offset = normal_encoding == NormalEncoding::Oct16 ? offsetof(CompactVertex16, normal)
+                                                                        : offsetof(CompactVertex8, normal);
+  const size_t texcoord_offset = normal_encoding == NormalEncoding::Oct16 ? offsetof(CompactVertex16, texcoord)
+                                                                          : offsetof(CompactVertex8, texcoord);
+
+  gl_state().bindVertexArray(VAOs[i]);
+
+  gl_state().bindBuffer(GL_ARRAY_BUFFER, VBOs[i * 3]);
+  glBufferData(GL_ARRAY_BUFFER, quantized.vertices.size(), quantized.vertices.data(), GL_STATIC_DRAW);
+
+  // vertices
+  glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void *)0);
+  glEnableVertexAttribArray(0);
+
+  // normals; left unnormalized since GL 3.3 maps signed integers to [-1, 1]
+  // differently from later versions, the shader scales them instead
+  glVertexAttribPointer(1, 2, normal_encoding == NormalEncoding::Oct16 ? GL_SHORT : GL_BYTE, GL_FALSE, stride,
+                        (void *)normal_offset);
+  glEnableVertexAttribArray(1);
+
+  // texture coordinates
+  glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void *)texcoord_offset);
+  glEnableVertexAttribArray(2);
+
+  // triangle indices
+  gl_state().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBOs[i]);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.getIndexBytes(), mesh.getIndices(), GL_STATIC_DRAW);
+
+  gl_state().bindVertexArray(0);
 
-    glBindTexture(GL_TEXTURE_2D, textures[i]);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-    stbi_image_free(data);
-
-    glBindVertexArray(VAOs[i]);
-
-    // vertices
-    glBindBuffer(GL_ARRAY_BUFFER, VBOs[i * 3]);
-    glBufferData(GL_ARRAY_BUFFER, vbuffer.size() * sizeof(tinyobj::real_t), &vbuffer[0],
-                 GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_DOUBLE, GL_FALSE, 3 * sizeof(tinyobj::real_t),
-                          (void *)0);
-    glEnableVertexAttribArray(0);
-
-    // normals
-    glBindBuffer(GL_ARRAY_BUFFER, VBOs[i * 3 + 1]);
-    glBufferData(GL_ARRAY_BUFFER, nbuffer.size() * sizeof(tinyobj::real_t), &nbuffer[0],
-                 GL_STATIC_DRAW);
-    glVertexAttribPointer(1, 3, GL_DOUBLE, GL_FALSE, 3 * sizeof(tinyobj::real_t),
-                          (void *)0);
-    glEnableVertexAttribArray(1);
-
-    // texture coordinates
-    glBindBuffer(GL_ARRAY_BUFFER, VBOs[i * 3 + 2]);
-    glBufferData(GL_ARRAY_BUFFER, tbuffer.size() * sizeof(tinyobj::real_t), &tbuffer[0],
-                 GL_STATIC_DRAW);
-    glVertexAttribPointer(2, 2, GL_DOUBLE, GL_FALSE, 2 * sizeof(tinyobj::real_t),
-                          (void *)0);
-    glEnableVertexAttribArray(2);
-
-    glBindVertexArray(0);
+  std::cout << "  " << quantized.stride << " bytes per vertex (float " << sizeof(Vertex) << ", double "
+            << 8 * sizeof(double) << "), max error: position " << quantized.max_position_error
+            << " (AABB " << quantized.position_scale[0] << " x " << quantized.position_scale[1] << " x "
+            << quantized.position_scale[2] << "), normal " << quantized.max_normal_error << " deg, uv "
+            << quantized.max_texcoord_error << std::endl;
+
+  return quantized.vertices.size() + mesh.getIndexBytes();
+}
+
+// vertex count, memory and vertex shader invocations of the indexed mesh
+// compared with drawing every triangle corner with glDrawArrays, then the
+// triangles, error and vertex shader invocations of each level of detail
+void print_mesh_stats(const Mesh &mesh)
+{
+  const size_t corners = mesh.getIndexCount();
+  const size_t triangles = corners / 3;
+  const size_t invocations = simulate_vertex_cache(mesh.getIndices(), corners, mesh.getVertexCount());
+
+  std::cout << "  vertices " << corners << " -> " << mesh.getVertexCount() << ", memory "
+            << corners * sizeof(Vertex) / 1024 << " KB -> "
+            << (mesh.getVertexBytes() + corners * sizeof(uint32_t)) / 1024
+            << " KB, vertex shader invocations " << corners << " -> " << invocations << " (ACMR 3.00 -> "
+            << (double)invocations / triangles << ")" << std::endl;
+
+  const Bounds bounds = compute_bounds(mesh.getVertices()[0].position, sizeof(Vertex) / sizeof(float),
+                                       mesh.getVertexCount());
+  const glm::vec3 extent = bounds.max - bounds.min;
+  const float size = std::max(extent.x, std::max(extent.y, extent.z));
+  for (size_t level = 1; level < mesh.getLodCount(); level++)
+  {
+    const MeshLod &lod = mesh.getLod(level);
+    const size_t lod_invocations =
+        simulate_vertex_cache(mesh.getIndices() + lod.index_offset, lod.index_count, mesh.getVertexCount());
+    std::cout << "  LOD " << level << ": " << lod.index_count / 3 << " triangles ("
+              << 100.0 * lod.index_count / corners << "%), error " << lod.error << " ("
+              << (size > 0.0f ? 100.0f * lod.error / size : 0.0f) << "% of the mesh size), vertex shader invocations "
+              << lod_invocations << std::endl;
   }
-}
\ No newline at end of file
+}
+
+// level of detail of mesh i, or its coarsest one
+const MeshLod &mesh_lod(size_t i, int level)
+{
+  return mesh_lods[i][std::min<size_t>(level, mesh_lods[i].size() - 1)];
+}
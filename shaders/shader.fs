@@ -1,70 +1,119 @@
 #version 330 core
 
+// Permutation, defined after the #version line by ShaderVariants (see
+// include/shader_variants.h); whatever is left undefined falls back to the
+// generic program.
+#define LIGHTING_UNIFORM 0   // clustered or every light, by the bruteForce uniform
+#define LIGHTING_CLUSTERED 1
+#define LIGHTING_FORWARD 2   // every light
+#define CONE_BRANCH 0        // skip the lights whose cone misses the fragment
+#define CONE_SMOOTH 1        // branchless, fading in over CONE_EDGE
+#define CONE_NONE 2          // point lights
+
+#ifndef LIGHTING
+#define LIGHTING LIGHTING_UNIFORM
+#endif
+#ifndef CONE
+#define CONE CONE_BRANCH
+#endif
+#ifndef TEXTURED
+#define TEXTURED 1
+#endif
+// lights shaded by the forward path, 0 to read the count from the Lights block
+#ifndef LIGHT_COUNT
+#define LIGHT_COUNT 0
+#endif
+// cosine past the cut-off at which a smooth cone reaches full strength
+#define CONE_EDGE 0.005
+
 struct Material {
     sampler2D diffuse;
 };
 
-struct Light {
-    vec3 position;
-    vec3 direction;
+// std140 mirror of LightBlockData in include/light_block.h
+layout (std140) uniform Lights {
+    vec4 ambient;      // rgb, summed over all lights
+    uvec4 clusterDims; // tiles in x and y, depth slices, light count
+    vec4 clusterDepth; // slice = log(depth) * x + y; zw viewport size
+};
 
-    float cutOff;
+#include "spot_light.glsl"
 
-    vec3 ambient;
-    vec3 diffuse;
+// (offset, count) per cluster into clusterLights
+uniform usamplerBuffer clusterCells;
+uniform usamplerBuffer clusterLights;
 
-    float constant;
-    float linear;
-    float quadratic;
-};
+#if LIGHTING == LIGHTING_UNIFORM
+// shade every light instead of only the ones binned into the fragment's cluster
+uniform bool bruteForce;
+#endif
 
-#define NR_LIGHTS 3 
+uniform mat4 view;
 
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 UV;
+in vec3 Tint;
 
 out vec4 FragColor;
 
 uniform Material material;
-uniform Light lights[NR_LIGHTS];
 
-vec3 CalcSpotLight(Light light, vec3 normal, vec3 fragPos);
+vec3 ShadeAllLights(vec3 norm, vec3 albedo);
+vec3 ShadeCluster(vec3 norm, vec3 albedo);
 
 void main()
 {
     vec3 norm = normalize(Normal);
-    vec3 result = vec3(0.0);
-
-    for(int i = 0; i < NR_LIGHTS; i++){
-        result += CalcSpotLight(lights[i], norm, FragPos);
+#if TEXTURED
+    vec3 albedo = texture(material.diffuse, UV).rgb * Tint;
+#else
+    vec3 albedo = Tint;
+#endif
+    vec3 result = ambient.rgb * albedo;
+
+#if LIGHTING == LIGHTING_UNIFORM
+    if(bruteForce){
+        result += ShadeAllLights(norm, albedo);
+    }
+    else{
+        result += ShadeCluster(norm, albedo);
     }
+#elif LIGHTING == LIGHTING_FORWARD
+    result += ShadeAllLights(norm, albedo);
+#else
+    result += ShadeCluster(norm, albedo);
+#endif
 
     FragColor = vec4(result, 1.0);
 }
 
-vec3 CalcSpotLight(Light light, vec3 normal, vec3 fragPos)
+vec3 ShadeAllLights(vec3 norm, vec3 albedo)
 {
-    vec3 lightDir = normalize(light.position - fragPos);
-
-    float theta = dot(lightDir, normalize(-light.direction));
-
-    if(theta > light.cutOff){
-        // ambient
-        vec3 ambient = light.ambient * texture(material.diffuse, UV).rgb;
-
-        // diffuse
-        vec3 norm = normalize(Normal);
-        float diff = max(dot(norm, lightDir), 0.0);
-        vec3 diffuse = light.diffuse * diff * texture(material.diffuse, UV).rgb;
+#if LIGHT_COUNT > 0
+    const int count = LIGHT_COUNT;
+#else
+    int count = int(clusterDims.w);
+#endif
+    vec3 result = vec3(0.0);
+    for(int i = 0; i < count; i++){
+        result += CalcSpotLight(FetchLight(i), norm, FragPos, albedo);
+    }
+    return result;
+}
 
-        // attenuation
-        float distance = length(light.position - FragPos);
-        float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * distance * distance);
+vec3 ShadeCluster(vec3 norm, vec3 albedo)
+{
+    ivec3 dims = ivec3(clusterDims.xyz);
+    float depth = -(view * vec4(FragPos, 1.0)).z;
+    int slice = clamp(int(log(depth) * clusterDepth.x + clusterDepth.y), 0, dims.z - 1);
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy / clusterDepth.zw * vec2(dims.xy)), ivec2(0), dims.xy - 1);
 
-        diffuse *= attenuation;
-        return (ambient + diffuse);
+    uvec2 cell = texelFetch(clusterCells, (slice * dims.y + tile.y) * dims.x + tile.x).xy;
+    vec3 result = vec3(0.0);
+    for(uint k = 0u; k < cell.y; k++){
+        int i = int(texelFetch(clusterLights, int(cell.x + k)).r);
+        result += CalcSpotLight(FetchLight(i), norm, FragPos, albedo);
     }
-
-    return (light.ambient * texture(material.diffuse, UV).rgb);
-}
\ No newline at end of file
+    return result;
+}
@@ -6,6 +6,7 @@ layout (location = 2) in vec2 aTexCoord;
 out vec3 Normal;
 out vec2 UV;
 out vec3 FragPos;
+out vec3 Tint;
 
 uniform mat4 model;
 uniform mat4 view;
@@ -17,4 +18,5 @@ void main()
     Normal = normalize(mat3(model) * aNormal);
     UV = aTexCoord;
     FragPos = vec3(model * vec4(aPos, 1.0));
+    Tint = vec3(1.0);
 }
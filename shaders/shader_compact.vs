@@ -0,0 +1,38 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;      // unorm16 in the mesh AABB
+layout (location = 1) in vec2 aNormal;   // octahedral snorm16/snorm8, unnormalized
+layout (location = 2) in vec2 aTexCoord; // half float
+
+out vec3 Normal;
+out vec2 UV;
+out vec3 FragPos;
+out vec3 Tint;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+// per mesh dequantization
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+uniform float normalScale; // 1/32767 or 1/127
+
+vec3 oct_decode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+void main()
+{
+    vec3 pos = positionOffset + aPos * positionScale;
+    vec3 normal = oct_decode(clamp(aNormal * normalScale, -1.0, 1.0));
+
+    gl_Position = projection * view * model * vec4(pos, 1.0);
+    Normal = normalize(mat3(model) * normal);
+    UV = aTexCoord;
+    FragPos = vec3(model * vec4(pos, 1.0));
+    Tint = vec3(1.0);
+}
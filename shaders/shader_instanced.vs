@@ -0,0 +1,25 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoord;
+// per instance, see InstanceData in include/instancing.h
+layout (location = 3) in mat4 aModel;    // locations 3 to 6
+layout (location = 7) in vec4 aTint;
+
+out vec3 Normal;
+out vec2 UV;
+out vec3 FragPos;
+out vec3 Tint;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    vec4 worldPos = aModel * vec4(aPos, 1.0);
+    gl_Position = projection * view * worldPos;
+    Normal = normalize(mat3(aModel) * aNormal);
+    UV = aTexCoord;
+    FragPos = vec3(worldPos);
+    Tint = aTint.rgb;
+}
@@ -0,0 +1,64 @@
+// spot lights of the light buffer, included by shader.fs after its
+// permutation defines
+
+struct Light {
+    vec3 position;
+    float range;
+
+    vec3 direction;
+    float cutOff;
+
+    vec3 diffuse;
+
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+// (direction, cutOff) per light, then three texels of static parameters per
+// light from LIGHT_PARAMS on, see LightBlock in include/light_block.h
+uniform samplerBuffer lightData;
+
+// MAX_LIGHTS in include/light_clusters.h
+#define LIGHT_PARAMS 1024
+
+Light FetchLight(int i)
+{
+    vec4 d = texelFetch(lightData, i);
+    vec4 t0 = texelFetch(lightData, LIGHT_PARAMS + i * 3);
+    vec4 t1 = texelFetch(lightData, LIGHT_PARAMS + i * 3 + 1);
+    vec4 t2 = texelFetch(lightData, LIGHT_PARAMS + i * 3 + 2);
+    return Light(t0.xyz, t0.w, d.xyz, d.w, t1.xyz, t1.w, t2.x, t2.y);
+}
+
+// diffuse only; the ambient of all lights is added once in main
+vec3 CalcSpotLight(Light light, vec3 normal, vec3 fragPos, vec3 albedo)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+    float distance = length(light.position - fragPos);
+
+#if CONE == CONE_BRANCH
+    float theta = dot(lightDir, -light.direction);
+    if(!(theta > light.cutOff && distance < light.range))
+        return vec3(0.0);
+    float cone = 1.0;
+#elif CONE == CONE_SMOOTH
+    // no branch: the cone fades in over CONE_EDGE past the cut-off and the
+    // window below already reaches zero at the range
+    float cone = smoothstep(light.cutOff, light.cutOff + CONE_EDGE, dot(lightDir, -light.direction));
+#else
+    float cone = 1.0;
+#endif
+
+    // diffuse
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 diffuse = light.diffuse * diff * albedo;
+
+    // attenuation, windowed to reach zero at the light's range so that
+    // lights left out of a cluster contribute nothing there
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * distance * distance);
+    float window = clamp(1.0 - pow(distance / light.range, 4.0), 0.0, 1.0);
+    attenuation *= window * window;
+
+    return diffuse * (attenuation * cone);
+}